@@ -0,0 +1,60 @@
+/*
+ * McuFlashHostConfig.h
+ *
+ * Host bindings of McuFlash, for the flash emulation in fsl_iap_host.c. Passed to every file of a
+ * host build with -include, so the sources keep their include order and need no host specific
+ * code, see doc/readme.txt:
+ *
+ *    gcc -include host/McuFlashHostConfig.h -Ihost -Isource ...
+ */
+
+#ifndef MCUFLASHHOSTCONFIG_H_
+#define MCUFLASHHOSTCONFIG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*!
+ * @brief Emulation only: reads from the memory mapped flash like a memcpy() on the target.
+ * @return 0 on success, non-zero if the range touches an erased page, where the target takes a bus fault.
+ */
+int FLASH_HOST_MappedRead(void *dest, uint32_t start, size_t lengthInBytes);
+
+/*!
+ * @brief Emulation only: address of the memory mapped flash, for reading it in place like on the target.
+ * @return Pointer to the data, NULL if the range is outside the flash or touches an erased page.
+ */
+const void *FLASH_HOST_Map(uint32_t start, size_t lengthInBytes);
+
+/*! @brief Emulation only: modeled flash time converted to cycles of the 96 MHz core clock, wraps around like DWT->CYCCNT. */
+uint32_t FLASH_HOST_GetCycleCounter(void);
+
+/*! @brief Emulation only: mutex for McuFlash_CONFIG_READ_LOCK(), host tests read from several threads. */
+void FLASH_HOST_Lock(void);
+
+/*! @brief Emulation only: releases FLASH_HOST_Lock(). */
+void FLASH_HOST_Unlock(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+/* there is no DWT on the host: McuFlash measures its flash operations with the modeled clock */
+#define McuFlash_CONFIG_CYCLE_COUNTER()      FLASH_HOST_GetCycleCounter()
+#define McuFlash_CONFIG_CYCLE_COUNTER_INIT() do { } while (0)
+
+/* flash addresses are not host addresses: mapped reads go through the emulation, which models the bus fault */
+#define McuFlash_CONFIG_MAPPED_READ(dst, addr, nofBytes) FLASH_HOST_MappedRead((dst), (uint32_t)(addr), (nofBytes))
+
+/* the flash is not at its target address on the host: data gets mapped through the emulation */
+#define McuFlash_CONFIG_MAP_ADDRESS(addr, nofBytes) FLASH_HOST_Map((uint32_t)(addr), (nofBytes))
+
+/* the concurrent littlefs readers of host/readers_stress.c read from several threads */
+#define McuFlash_CONFIG_READ_LOCK()   FLASH_HOST_Lock()
+#define McuFlash_CONFIG_READ_UNLOCK() FLASH_HOST_Unlock()
+
+#endif /* MCUFLASHHOSTCONFIG_H_ */
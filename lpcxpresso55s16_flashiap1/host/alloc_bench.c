@@ -0,0 +1,231 @@
+/*
+ * alloc_bench.c
+ *
+ * Block allocator of littlefs, two measurements:
+ *  - 'speed <blocks> <percent used>': CPU time of lfs_alloc() on a synthetic volume, without flash.
+ *    With LFS_FREEMAP one random used block gets freed after each allocation, so the fill level
+ *    stays the same. Without it, the lookahead window gets refilled with random blocks 2000 times.
+ *    The hash of the allocated blocks shows if two builds allocate the same sequence.
+ *  - 'adjacent': how many of the blocks of two files written in turn follow the previous block of
+ *    the same file, on a volume where every other block is in use.
+ * lfs_alloc() and lfs_ctz_find() are static, so lfs.c is included here instead of being linked.
+ *
+ *    gcc -O2 -include host/McuFlashHostConfig.h -Ihost -Isource -DMcuLittleFS_CONFIG_IMAGE_END=0 \
+ *        host/fsl_iap_host.c source/McuFlash.c source/McuLittleFSBlockDevice.c \
+ *        source/McuLittleFS.c source/lfs_util.c host/alloc_bench.c -o alloc_bench
+ *    ./alloc_bench speed 65536 90
+ *    ./alloc_bench adjacent
+ */
+
+#include "lfs.c"
+
+#include <time.h>
+#include "fsl_iap_host.h"
+#include "McuLib.h"
+#include "McuLittleFS.h"
+#include "McuLittleFSBlockDevice.h"
+
+#define NOF_ALLOCS  (200000) /* LFS_FREEMAP */
+#define NOF_FILLS   (2000)   /* lookahead window */
+
+static uint32_t randomState = 1;
+
+static uint32_t Random(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+static double NowNs(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static int Speed(lfs_block_t nofBlocks, int percentUsed)
+{
+    static struct lfs_config cfg;
+    static lfs_t lfs;
+    lfs_block_t block;
+    long n = 0;
+    uint32_t hash = 0;
+    double start, time = 0;
+
+    cfg.block_count = nofBlocks;
+    cfg.lookahead_size = 256;
+    lfs.cfg = &cfg;
+#if LFS_FREEMAP
+    lfs.free.map = calloc(2 * ((nofBlocks + 31) / 32), sizeof(uint32_t));
+    lfs.free.inflight = lfs.free.map + (nofBlocks + 31) / 32;
+    for (lfs_block_t i = 0; i < nofBlocks; i++)
+    {
+        if ((int)(Random() % 100) < percentUsed)
+        {
+            lfs.free.map[i / 32] |= 1U << (i % 32);
+        }
+    }
+    lfs.free.valid = true;
+    lfs.free.off = 0;
+    lfs_alloc_ack(&lfs);
+    lfs.free.built = true; /* the map is complete, no traversal */
+#if LFS_ALLOC_RESERVE > 0
+    for (int i = 0; i < LFS_ALLOC_RESERVE; i++)
+    {
+        lfs.free.reserved[i] = LFS_BLOCK_NULL;
+    }
+#endif
+    start = NowNs();
+    for (n = 0; n < NOF_ALLOCS; n++)
+    {
+        if (lfs_alloc(&lfs, &block) != 0)
+        {
+            printf("no space\n");
+            return 1;
+        }
+        hash = hash * 31 + block;
+        for (;;) /* keep the fill level: free a random used block */
+        {
+            lfs_block_t victim = Random() % nofBlocks;
+            if (victim != block && (lfs.free.map[victim / 32] & (1U << (victim % 32))))
+            {
+                lfs.free.map[victim / 32] &= ~(1U << (victim % 32));
+                break;
+            }
+        }
+        if (n % 16 == 15)
+        {
+            lfs_alloc_ack(&lfs);
+            lfs.free.built = true;
+        }
+    }
+    time = NowNs() - start;
+#else
+    lfs.free.buffer = calloc(cfg.lookahead_size, 1);
+    for (int r = 0; r < NOF_FILLS; r++)
+    {
+        for (int i = 0; i < (int)(8 * cfg.lookahead_size); i++)
+        {
+            if ((int)(Random() % 100) < percentUsed)
+            {
+                lfs.free.buffer[i / 32] |= 1U << (i % 32);
+            }
+            else
+            {
+                lfs.free.buffer[i / 32] &= ~(1U << (i % 32));
+            }
+        }
+        lfs.free.off = 0;
+        lfs.free.size = 8 * cfg.lookahead_size;
+        lfs.free.i = 0;
+        lfs.free.ack = nofBlocks;
+        start = NowNs();
+        while (lfs.free.i != lfs.free.size)
+        {
+            if (lfs_alloc(&lfs, &block) != 0)
+            {
+                printf("no space\n");
+                return 1;
+            }
+            n++;
+            hash = hash * 31 + block + lfs.free.ack;
+        }
+        time += NowNs() - start;
+    }
+#endif
+    printf("%s, %u blocks %d%% used: %ld allocations, %.1f ns per allocation, sequence %08x\n",
+           LFS_FREEMAP ? "free block map" : "lookahead window", (unsigned)nofBlocks, percentUsed, n, time / n,
+           (unsigned)hash);
+    return 0;
+}
+
+/* number of blocks of the file which follow the block before them, *nofBlocks gets the number of blocks */
+static int AdjacentBlocks(lfs_t *lfs, const char *path, int *nofBlocks)
+{
+    lfs_file_t file;
+    lfs_block_t prev = LFS_BLOCK_NULL, block;
+    lfs_off_t off;
+    int adjacent = 0;
+
+    *nofBlocks = 0;
+    lfs_file_open(lfs, &file, path, LFS_O_RDONLY);
+    /* steps smaller than a block, as the CTZ pointers at the start of the blocks take some space */
+    for (lfs_off_t pos = 0; pos < file.ctz.size; pos += lfs->cfg->block_size - 64)
+    {
+        lfs_ctz_find(lfs, NULL, &file.cache, file.ctz.head, file.ctz.size, pos, &block, &off);
+        if (block != prev)
+        {
+            if (prev != LFS_BLOCK_NULL && block == prev + 1)
+            {
+                adjacent++;
+            }
+            prev = block;
+            (*nofBlocks)++;
+        }
+    }
+    lfs_file_close(lfs, &file);
+    return adjacent;
+}
+
+static int Adjacent(void)
+{
+    static uint8_t buf[1024];
+    char path[16];
+    int nofBlocksA, nofBlocksB, adjacentA, adjacentB;
+    lfs_t *lfs;
+    lfs_file_t a, b, file;
+
+    if (McuLittleFS_block_device_init() != LFS_ERR_OK || McuLFS_Format() != ERR_OK || McuLFS_Mount() != ERR_OK)
+    {
+        printf("mount failed\n");
+        return 1;
+    }
+    lfs = McuLFS_GetFileSystem();
+    memset(buf, 0x5a, sizeof(buf));
+    /* 60 small files, then every other one gets removed */
+    for (int i = 0; i < 60; i++)
+    {
+        sprintf(path, "s%d", i);
+        lfs_file_open(lfs, &file, path, LFS_O_WRONLY | LFS_O_CREAT);
+        lfs_file_write(lfs, &file, buf, sizeof(buf));
+        lfs_file_write(lfs, &file, buf, sizeof(buf));
+        lfs_file_close(lfs, &file);
+    }
+    for (int i = 0; i < 60; i += 2)
+    {
+        sprintf(path, "s%d", i);
+        lfs_remove(lfs, path);
+    }
+    /* two files written in turn */
+    lfs_file_open(lfs, &a, "a", LFS_O_WRONLY | LFS_O_CREAT);
+    lfs_file_open(lfs, &b, "b", LFS_O_WRONLY | LFS_O_CREAT);
+    for (int i = 0; i < 24; i++)
+    {
+        lfs_file_write(lfs, &a, buf, sizeof(buf));
+        lfs_file_write(lfs, &b, buf, sizeof(buf));
+    }
+    lfs_file_close(lfs, &a);
+    lfs_file_close(lfs, &b);
+
+    adjacentA = AdjacentBlocks(lfs, "a", &nofBlocksA);
+    adjacentB = AdjacentBlocks(lfs, "b", &nofBlocksB);
+    printf("a: %d of %d block transitions adjacent, b: %d of %d\n", adjacentA, nofBlocksA - 1, adjacentB,
+           nofBlocksB - 1);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 4 && strcmp(argv[1], "speed") == 0)
+    {
+        return Speed((lfs_block_t)atoi(argv[2]), atoi(argv[3]));
+    }
+    if (argc == 2 && strcmp(argv[1], "adjacent") == 0)
+    {
+        return Adjacent();
+    }
+    printf("usage: %s speed <blocks> <percent used> | adjacent\n", argv[0]);
+    return 1;
+}
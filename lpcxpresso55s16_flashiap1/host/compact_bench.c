@@ -0,0 +1,102 @@
+/*
+ * compact_bench.c
+ *
+ * Latency of rewriting small configuration files, to compare the metadata compaction settings
+ * McuLittleFS_CONFIG_FILESYSTEM_METADATA_MAX and McuLittleFS_CONFIG_FILESYSTEM_COMPACT_THRESH.
+ * One of 50 files in a directory gets truncated and rewritten, its latency is the modeled flash
+ * time (fsl_iap_host.c). With 'gc' McuLFS_Gc(4) runs between the rewrites, as an idle hook would.
+ *
+ *    gcc -O2 -include host/McuFlashHostConfig.h -Ihost -Isource -DMcuLittleFS_CONFIG_IMAGE_END=0 -DMcuLittleFS_CONFIG_BLOCK_SIZE=4096 \
+ *        -DMcuLittleFS_CONFIG_FILESYSTEM_METADATA_MAX=0 -DMcuLittleFS_CONFIG_FILESYSTEM_COMPACT_THRESH=0 \
+ *        host/fsl_iap_host.c source/McuFlash.c source/McuLittleFSBlockDevice.c \
+ *        source/McuLittleFS.c source/lfs.c source/lfs_util.c host/compact_bench.c -o compact_bench
+ *    ./compact_bench           # rewrites only
+ *    ./compact_bench gc        # McuLFS_Gc(4) after each rewrite
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fsl_iap_host.h"
+#include "McuLib.h"
+#include "McuLittleFS.h"
+#include "McuLittleFSconfig.h"
+#include "McuLittleFSBlockDevice.h"
+
+#define NOF_FILES     (50)
+#define NOF_REWRITES  (2000)
+
+static int CompareLatency(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x < y) ? -1 : (x > y);
+}
+
+int main(int argc, char **argv)
+{
+    static uint64_t latency[NOF_REWRITES];
+    uint64_t sum = 0, gcTime = 0, start;
+    char name[32], line[40];
+    bool gc = (argc > 1 && strcmp(argv[1], "gc") == 0);
+    lfs_t *lfs;
+    lfs_file_t file;
+
+    if (McuLittleFS_block_device_init() != LFS_ERR_OK || McuLFS_Format() != ERR_OK || McuLFS_Mount() != ERR_OK)
+    {
+        printf("mount failed\n");
+        return 1;
+    }
+    lfs = McuLFS_GetFileSystem();
+    lfs_mkdir(lfs, "cfg");
+    for (int i = 0; i < NOF_FILES; i++)
+    {
+        sprintf(name, "cfg/v%02d", i);
+        lfs_file_open(lfs, &file, name, LFS_O_WRONLY | LFS_O_CREAT);
+        lfs_file_write(lfs, &file, "0123456789", 10);
+        lfs_file_close(lfs, &file);
+    }
+
+    srand(2);
+    for (int i = 0; i < NOF_REWRITES; i++)
+    {
+        int size;
+
+        sprintf(name, "cfg/v%02d", rand() % NOF_FILES);
+        size = sprintf(line, "value %d", i);
+        start = FLASH_HOST_GetModeledTimeNs();
+        if (   lfs_file_open(lfs, &file, name, LFS_O_WRONLY | LFS_O_TRUNC) != 0
+            || lfs_file_write(lfs, &file, line, size) != size
+            || lfs_file_close(lfs, &file) != 0)
+        {
+            printf("rewrite %d of %s failed\n", i, name);
+            return 1;
+        }
+        latency[i] = FLASH_HOST_GetModeledTimeNs() - start;
+        sum += latency[i];
+        if (gc)
+        {
+            start = FLASH_HOST_GetModeledTimeNs();
+            if (McuLFS_Gc(4) == ERR_FAILED)
+            {
+                printf("gc failed\n");
+                return 1;
+            }
+            gcTime += FLASH_HOST_GetModeledTimeNs() - start;
+        }
+    }
+
+    qsort(latency, NOF_REWRITES, sizeof(latency[0]), CompareLatency);
+    printf("metadata_max %d, compact_thresh %d%s: rewrite of 1 of %d files x%d: mean %.2f ms, p50 %.2f ms, "
+           "p99 %.2f ms, max %.2f ms, idle gc %.1f ms total, %d blocks in use\n",
+           (int)McuLittleFS_CONFIG_FILESYSTEM_METADATA_MAX, (int)McuLittleFS_CONFIG_FILESYSTEM_COMPACT_THRESH,
+           gc ? ", gc" : "", NOF_FILES, NOF_REWRITES, sum / 1e6 / NOF_REWRITES, latency[NOF_REWRITES / 2] / 1e6,
+           latency[NOF_REWRITES * 99 / 100] / 1e6, latency[NOF_REWRITES - 1] / 1e6, gcTime / 1e6,
+           (int)lfs_fs_size(lfs));
+    if (McuLFS_Unmount() != ERR_OK || McuLFS_Mount() != ERR_OK)
+    {
+        printf("remount failed\n");
+        return 1;
+    }
+    return 0;
+}
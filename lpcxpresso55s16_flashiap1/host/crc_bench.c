@@ -0,0 +1,61 @@
+/*
+ * crc_bench.c
+ *
+ * Throughput of the lfs_crc() backend selected with LFS_CRC_BACKEND, after checking it against
+ * the 16 entry table implementation with lfs_crc_check(). Only lfs_util.c is needed.
+ *
+ *    gcc -O2 -Ihost -Isource -DLFS_CRC_CHECK=1 -DLFS_CRC_BACKEND=LFS_CRC_BACKEND_WORD \
+ *        source/lfs_util.c host/crc_bench.c -o crc_bench
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "lfs_util.h"
+
+#define TOTAL_BYTES  (64L << 20) /* checksummed for each size */
+
+static const char *BackendName(void)
+{
+    switch (LFS_CRC_BACKEND)
+    {
+        case LFS_CRC_BACKEND_NIBBLE:
+            return "NIBBLE";
+        case LFS_CRC_BACKEND_SLICE8:
+            return "SLICE8";
+        case LFS_CRC_BACKEND_WORD:
+            return "WORD";
+        default:
+            return "?";
+    }
+}
+
+int main(void)
+{
+    static uint8_t buf[4096];
+
+    if (!lfs_crc_check())
+    {
+        printf("%s: lfs_crc() does not match the reference implementation!\n", BackendName());
+        return 1;
+    }
+    for (int i = 0; i < (int)sizeof(buf); i++)
+    {
+        buf[i] = (uint8_t)(i * 13);
+    }
+    for (int size = 16; size <= (int)sizeof(buf); size *= 16)
+    {
+        clock_t start = clock();
+        uint32_t crc = 0xffffffff;
+        double seconds;
+
+        for (long n = 0; n < TOTAL_BYTES; n += size)
+        {
+            crc = lfs_crc(crc, buf, size);
+        }
+        seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+        /* the crc is printed so the loop cannot be optimized away */
+        printf("%s, %4d bytes per call: %.0f MB/s (crc %08x)\n", BackendName(), size, TOTAL_BYTES / seconds / 1e6,
+               (unsigned)crc);
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * erase_bench.c
+ *
+ * Modeled flash time of McuFlash_Erase(), to compare McuFlash_CONFIG_ERASED_TRACKING=1 (one FLASH_Erase()
+ * call for the area, erased pages known from the bitmap) with McuFlash_CONFIG_ERASED_TRACKING=0 (a zero
+ * page programmed into every page). Two workloads on 4 KByte blocks of a 128 KByte area of the flash:
+ *  - 'erase': 100 erases of blocks which have data, the time of the erases only
+ *  - 'fill':  100 times an erase followed by 16 appends of 256 bytes, like littlefs writing a block
+ *
+ * Only McuFlash is used: without McuFlash_CONFIG_ERASED_TRACKING the partition table of McuLittleFS
+ * cannot be created on a blank device.
+ *
+ *    gcc -O2 -include host/McuFlashHostConfig.h -Ihost -Isource -DMcuFlash_CONFIG_ERASED_TRACKING=1 \
+ *        host/fsl_iap_host.c source/McuFlash.c source/McuLib.c host/erase_bench.c -o erase_bench
+ *    ./erase_bench erase
+ *    ./erase_bench fill
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "fsl_iap_host.h"
+#include "McuLib.h"
+#include "McuFlash.h"
+
+#define AREA_OFFSET   (64 * 1024)  /* from the start of the flash */
+#define AREA_SIZE     (128 * 1024)
+#define BLOCK_SIZE    (4096)
+#define NOF_ERASES    (100)
+#define APPEND_SIZE   (256)
+
+int main(int argc, char **argv)
+{
+    static uint8_t data[BLOCK_SIZE];
+    McuFlash_Geometry_t geometry;
+    bool fill = (argc > 1 && strcmp(argv[1], "fill") == 0);
+    uint32_t area, nofBlocks = AREA_SIZE / BLOCK_SIZE;
+    uint64_t timeNs = 0, start;
+    flash_host_stats_t stats;
+
+    McuFlash_Init();
+    if (McuFlash_GetGeometry(&geometry) != ERR_OK)
+    {
+        printf("no flash\n");
+        return 1;
+    }
+    area = geometry.base + AREA_OFFSET;
+    memset(data, 0x5a, sizeof(data));
+    /* blocks with data, so each erase has something to erase */
+    for (uint32_t b = 0; b < nofBlocks; b++)
+    {
+        McuFlash_Program((void *)(uintptr_t)(area + b * BLOCK_SIZE), data, BLOCK_SIZE);
+    }
+    McuFlash_Flush();
+
+    FLASH_HOST_ResetStats();
+    for (int i = 0; i < NOF_ERASES; i++)
+    {
+        uint32_t addr = area + (i % nofBlocks) * BLOCK_SIZE;
+
+        start = FLASH_HOST_GetModeledTimeNs();
+        if (McuFlash_Erase((void *)(uintptr_t)addr, BLOCK_SIZE) != ERR_OK)
+        {
+            printf("erase failed\n");
+            return 1;
+        }
+        for (int off = 0; off < BLOCK_SIZE; off += APPEND_SIZE)
+        {
+            /* 'erase' puts the data back outside of the measurement */
+            if (fill)
+            {
+                McuFlash_Program((void *)(uintptr_t)(addr + off), data + off, APPEND_SIZE);
+            }
+        }
+        McuFlash_Flush();
+        timeNs += FLASH_HOST_GetModeledTimeNs() - start;
+        if (!fill)
+        {
+            McuFlash_Program((void *)(uintptr_t)addr, data, BLOCK_SIZE);
+            McuFlash_Flush();
+        }
+    }
+    FLASH_HOST_GetStats(&stats);
+
+    printf("ERASED_TRACKING %d, %s: %d x %d bytes, %.2f ms per block, %.0f ms total, %llu page erases\n",
+           McuFlash_CONFIG_ERASED_TRACKING, fill ? "erase + 16 x 256 byte appends" : "erase", NOF_ERASES, BLOCK_SIZE,
+           timeNs / 1e6 / NOF_ERASES, timeNs / 1e6, (unsigned long long)stats.pageErases);
+    return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * flashops_bench.c
+ *
+ * Flash ROM calls of a logging workload, to compare the McuFlash write buffer (McuFlash_CONFIG_WRITE_BUFFER=1)
+ * with a read-modify-write of the page for each program (McuFlash_CONFIG_WRITE_BUFFER=0), and cache sizes: 400 log
+ * records of 100 bytes get appended to a file, with a lfs_file_sync() after every 4th record, and a 64 byte state file
+ * gets rewritten every 20th record. At the end all files are read back and compared.
+ *
+ *    gcc -O2 -include host/McuFlashHostConfig.h -Ihost -Isource -DMcuLittleFS_CONFIG_IMAGE_END=0 \
+ *        -DMcuFlash_CONFIG_WRITE_BUFFER=1 -DMcuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE=256 \
+ *        host/fsl_iap_host.c source/McuFlash.c source/McuLittleFSBlockDevice.c \
+ *        source/McuLittleFS.c source/lfs.c source/lfs_util.c host/flashops_bench.c -o flashops_bench
+ *    ./flashops_bench
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "fsl_iap_host.h"
+#include "McuLib.h"
+#include "McuFlash.h"
+#include "McuLittleFS.h"
+#include "McuLittleFSBlockDevice.h"
+
+#define NOF_RECORDS   (400)
+#define RECORD_SIZE   (100)
+#define SYNC_EVERY    (4)
+#define STATE_EVERY   (20)
+#define STATE_SIZE    (64)
+
+static void MakeRecord(uint8_t *buf, int n, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        buf[i] = (uint8_t)(n * 31 + i);
+    }
+}
+
+int main(void)
+{
+    static const char *opNames[kFLASH_HOST_OpCount] = {"erase", "program", "read", "verify erase", "verify program", "mapped read"};
+    uint8_t buf[RECORD_SIZE], readBuf[RECORD_SIZE];
+    flash_host_stats_t stats;
+    uint64_t modeledNs;
+    bool ok = true;
+    lfs_t *lfs;
+    lfs_file_t log, state;
+
+    if (McuLittleFS_block_device_init() != LFS_ERR_OK || McuLFS_Format() != ERR_OK || McuLFS_Mount() != ERR_OK)
+    {
+        printf("mount failed\n");
+        return 1;
+    }
+    lfs = McuLFS_GetFileSystem();
+
+    FLASH_HOST_ResetStats();
+    modeledNs = FLASH_HOST_GetModeledTimeNs();
+    lfs_file_open(lfs, &log, "log.bin", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND);
+    for (int n = 0; n < NOF_RECORDS; n++)
+    {
+        MakeRecord(buf, n, RECORD_SIZE);
+        if (lfs_file_write(lfs, &log, buf, RECORD_SIZE) != RECORD_SIZE)
+        {
+            printf("write failed\n");
+            return 1;
+        }
+        if ((n + 1) % SYNC_EVERY == 0 && lfs_file_sync(lfs, &log) != 0)
+        {
+            printf("sync failed\n");
+            return 1;
+        }
+        if ((n + 1) % STATE_EVERY == 0)
+        {
+            MakeRecord(buf, n, STATE_SIZE);
+            lfs_file_open(lfs, &state, "state.bin", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+            lfs_file_write(lfs, &state, buf, STATE_SIZE);
+            if (lfs_file_close(lfs, &state) != 0)
+            {
+                printf("state write failed\n");
+                return 1;
+            }
+        }
+    }
+    lfs_file_close(lfs, &log);
+    FLASH_HOST_GetStats(&stats);
+    modeledNs = FLASH_HOST_GetModeledTimeNs() - modeledNs;
+
+    lfs_file_open(lfs, &log, "log.bin", LFS_O_RDONLY);
+    for (int n = 0; n < NOF_RECORDS; n++)
+    {
+        MakeRecord(buf, n, RECORD_SIZE);
+        if (lfs_file_read(lfs, &log, readBuf, RECORD_SIZE) != RECORD_SIZE || memcmp(readBuf, buf, RECORD_SIZE) != 0)
+        {
+            ok = false;
+        }
+    }
+    lfs_file_close(lfs, &log);
+    lfs_file_open(lfs, &state, "state.bin", LFS_O_RDONLY);
+    MakeRecord(buf, NOF_RECORDS - 1, STATE_SIZE);
+    if (lfs_file_read(lfs, &state, readBuf, STATE_SIZE) != STATE_SIZE || memcmp(readBuf, buf, STATE_SIZE) != 0)
+    {
+        ok = false;
+    }
+    lfs_file_close(lfs, &state);
+
+    printf("WRITE_BUFFER %d, cache %d: %d records of %d bytes\n", McuFlash_CONFIG_WRITE_BUFFER,
+           McuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE, NOF_RECORDS, RECORD_SIZE);
+    for (int op = 0; op < kFLASH_HOST_OpMappedRead; op++)
+    {
+        printf("  %-15s %6llu calls %8llu bytes\n", opNames[op], (unsigned long long)stats.calls[op],
+               (unsigned long long)stats.bytes[op]);
+    }
+    printf("  page erases %llu, modeled %.1f ms, read back %s\n", (unsigned long long)stats.pageErases,
+           modeledNs / 1e6, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
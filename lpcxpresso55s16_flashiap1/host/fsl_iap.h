@@ -0,0 +1,148 @@
+/*
+ * fsl_iap.h (host emulation)
+ *
+ * Drop-in replacement of drivers/fsl_iap.h for building the flash and
+ * LittleFS stack on a Linux host. Put the 'host' folder in front of the
+ * 'drivers' folder on the include path, see doc/readme.txt.
+ *
+ * Only the subset of the IAP API used by McuFlash.c is provided. The
+ * implementation is in fsl_iap_host.c.
+ */
+
+#ifndef __FSL_IAP_H_
+#define __FSL_IAP_H_
+
+#ifndef MCUFLASHHOSTCONFIG_H_
+#error "build for the host with -include host/McuFlashHostConfig.h, see doc/readme.txt"
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h> /* fsl_common.h pulls this in on the target */
+#include <assert.h>
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/*! @brief Constructs a status code value from a group and a code number. */
+#if !defined(MAKE_STATUS)
+#define MAKE_STATUS(group, code) ((((group)*100) + (code)))
+#endif
+
+#define kStatusGroupGeneric     0
+#define kStatusGroupFlashDriver 1
+
+/*! @brief Type used for all status and error return values. */
+typedef int32_t status_t;
+
+/*! @brief Generic status return codes (subset of fsl_common.h). */
+enum
+{
+    kStatus_Success         = MAKE_STATUS(kStatusGroupGeneric, 0), /*!< Generic status for Success. */
+    kStatus_Fail            = MAKE_STATUS(kStatusGroupGeneric, 1), /*!< Generic status for Fail. */
+    kStatus_InvalidArgument = MAKE_STATUS(kStatusGroupGeneric, 4), /*!< Generic status for invalid argument check. */
+};
+
+/*!
+ * @brief Flash driver status codes (subset of drivers/fsl_iap.h).
+ */
+enum _flash_status
+{
+    kStatus_FLASH_Success         = MAKE_STATUS(kStatusGroupGeneric, 0),     /*!< API is executed successfully*/
+    kStatus_FLASH_InvalidArgument = MAKE_STATUS(kStatusGroupGeneric, 4),     /*!< Invalid argument*/
+    kStatus_FLASH_SizeError       = MAKE_STATUS(kStatusGroupFlashDriver, 0), /*!< Error size*/
+    kStatus_FLASH_AlignmentError =
+        MAKE_STATUS(kStatusGroupFlashDriver, 1), /*!< Parameter is not aligned with the specified baseline*/
+    kStatus_FLASH_AddressError = MAKE_STATUS(kStatusGroupFlashDriver, 2), /*!< Address is out of range */
+    kStatus_FLASH_AccessError =
+        MAKE_STATUS(kStatusGroupFlashDriver, 3), /*!< Invalid instruction codes and out-of bound addresses */
+    kStatus_FLASH_CommandFailure =
+        MAKE_STATUS(kStatusGroupFlashDriver, 5), /*!< Run-time error during command execution. */
+    kStatus_FLASH_UnknownProperty = MAKE_STATUS(kStatusGroupFlashDriver, 6), /*!< Unknown property.*/
+    kStatus_FLASH_EraseKeyError   = MAKE_STATUS(kStatusGroupFlashDriver, 7), /*!< API erase key is invalid.*/
+    kStatus_FLASH_EccError        = MAKE_STATUS(kStatusGroupFlashDriver,
+                                         0x10), /*!< A correctable or uncorrectable error during command execution. */
+    kStatus_FLASH_CompareError =
+        MAKE_STATUS(kStatusGroupFlashDriver, 0x11), /*!< Destination and source memory contents do not match. */
+};
+
+/*! @brief Constructs the four character code for the Flash driver API key. */
+#if !defined(FOUR_CHAR_CODE)
+#define FOUR_CHAR_CODE(a, b, c, d) (((d) << 24) | ((c) << 16) | ((b) << 8) | ((a)))
+#endif
+
+/*! @brief Enumeration for Flash driver API keys. */
+enum _flash_driver_api_keys
+{
+    kFLASH_ApiEraseKey = FOUR_CHAR_CODE('l', 'f', 'e', 'k') /*!< Key value used to validate all flash erase APIs.*/
+};
+
+/*!
+ * @brief Enumeration for various flash properties.
+ */
+typedef enum _flash_property_tag
+{
+    kFLASH_PropertyPflashSectorSize    = 0x00U, /*!< Pflash sector size property.*/
+    kFLASH_PropertyPflashTotalSize     = 0x01U, /*!< Pflash total size property.*/
+    kFLASH_PropertyPflashBlockSize     = 0x02U, /*!< Pflash block size property.*/
+    kFLASH_PropertyPflashBlockCount    = 0x03U, /*!< Pflash block count property.*/
+    kFLASH_PropertyPflashBlockBaseAddr = 0x04U, /*!< Pflash block base address property.*/
+
+    kFLASH_PropertyPflashPageSize   = 0x30U, /*!< Pflash page size property.*/
+    kFLASH_PropertyPflashSystemFreq = 0x31U, /*!< System Frequency System Frequency.*/
+} flash_property_tag_t;
+
+/*! @brief Flash driver state information (layout compatible with the fields McuFlash.c uses). */
+typedef struct _flash_config
+{
+    uint32_t PFlashBlockBase;  /*!< A base address of the first PFlash block */
+    uint32_t PFlashTotalSize;  /*!< The size of the combined PFlash block. */
+    uint32_t PFlashBlockCount; /*!< A number of PFlash blocks. */
+    uint32_t PFlashPageSize;   /*!< The size in bytes of a page of PFlash. */
+    uint32_t PFlashSectorSize; /*!< The size in bytes of a sector of PFlash. */
+    struct
+    {
+        uint32_t sysFreqInMHz;
+    } modeConfig;
+} flash_config_t;
+
+/*******************************************************************************
+ * API
+ ******************************************************************************/
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*! @brief Initializes the flash emulation and the driver state, see drivers/fsl_iap.h. */
+status_t FLASH_Init(flash_config_t *config);
+
+/*! @brief Erases the 512-byte aligned range, see drivers/fsl_iap.h. */
+status_t FLASH_Erase(flash_config_t *config, uint32_t start, uint32_t lengthInBytes, uint32_t key);
+
+/*! @brief Programs the 512-byte aligned range, which must be erased, see drivers/fsl_iap.h. */
+status_t FLASH_Program(flash_config_t *config, uint32_t start, uint8_t *src, uint32_t lengthInBytes);
+
+/*! @brief Reads a range, fails with #kStatus_FLASH_EccError if it touches an erased page. */
+status_t FLASH_Read(flash_config_t *config, uint32_t start, uint8_t *dest, uint32_t lengthInBytes);
+
+/*! @brief Returns #kStatus_FLASH_Success if every page touched by the range is erased. */
+status_t FLASH_VerifyErase(flash_config_t *config, uint32_t start, uint32_t lengthInBytes);
+
+/*! @brief Compares the range against the expected data, see drivers/fsl_iap.h. */
+status_t FLASH_VerifyProgram(flash_config_t *config,
+                             uint32_t start,
+                             uint32_t lengthInBytes,
+                             const uint8_t *expectedData,
+                             uint32_t *failedAddress,
+                             uint32_t *failedData);
+
+/*! @brief Returns the desired flash property, see drivers/fsl_iap.h. */
+status_t FLASH_GetProperty(flash_config_t *config, flash_property_tag_t whichProperty, uint32_t *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FSL_IAP_H_ */
@@ -0,0 +1,620 @@
+/*
+ * fsl_iap_host.c
+ *
+ * Host side emulation of the LPC55S16 IAP flash API (drivers/fsl_iap.c), backed
+ * by RAM or by an mmap'ed image file. Build it together with the unmodified
+ * McuFlash.c, McuLittleFSBlockDevice.c and lfs.c, see doc/readme.txt.
+ */
+
+#include "fsl_iap_host.h"
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* page states, stored after the flash data in an image file */
+#define FLASH_HOST_PAGE_ERASED     (0xE5U)
+#define FLASH_HOST_PAGE_PROGRAMMED (0x5AU)
+
+/* Default latency model. Rough LPC55S1x numbers, calibrate against the board if needed. */
+#define FLASH_HOST_DEFAULT_CALL_NS           (3000U)
+#define FLASH_HOST_DEFAULT_ERASE_PAGE_NS     (1500000U)
+#define FLASH_HOST_DEFAULT_PROGRAM_PAGE_NS   (1000000U)
+#define FLASH_HOST_DEFAULT_VERIFY_ERASE_NS   (50000U)
+#define FLASH_HOST_DEFAULT_VERIFY_PROGRAM_NS (60000U)
+#define FLASH_HOST_DEFAULT_READ_BYTE_NS      (20U)
+#define FLASH_HOST_DEFAULT_MAPPED_BYTE_NS    (2U)
+#define FLASH_HOST_DEFAULT_FAULT_NS          (2000U)
+
+typedef struct _flash_host
+{
+    flash_host_config_t config;
+    uint32_t pageCount;
+    uint8_t *data;          /* flash content */
+    uint8_t *pageState;     /* one FLASH_HOST_PAGE_xxx per page */
+    uint32_t *eraseCount;   /* wear per page */
+    size_t mapSize;         /* size of the mapping if an image file is used, 0 otherwise */
+    bool isSetup;
+    uint32_t cutPages;      /* pages which still get erased or programmed before the power cut */
+    void (*cutHandler)(void);
+    bool powerOff;          /* the power has been cut, erase and program fail */
+    flash_host_stats_t stats;
+} flash_host_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static flash_host_t s_host;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER; /* FLASH_HOST_Lock() */
+
+static const char *const s_opNames[kFLASH_HOST_OpCount] = {
+    "Erase", "Program", "Read", "VerifyErase", "VerifyProgram", "MappedRead",
+};
+
+/*******************************************************************************
+ * Code
+ ******************************************************************************/
+static void FLASH_HOST_ReportAtExit(void)
+{
+    FLASH_HOST_PrintReport(stderr);
+}
+
+static status_t FLASH_HOST_Account(flash_host_op_t op, uint32_t nofBytes, uint32_t nofPages, status_t status)
+{
+    const flash_host_timing_t *t = &s_host.config.timing;
+    uint64_t ns                  = t->callNs;
+
+    switch (op)
+    {
+        case kFLASH_HOST_OpErase:
+            ns += (uint64_t)nofPages * t->erasePageNs;
+            break;
+        case kFLASH_HOST_OpProgram:
+            ns += (uint64_t)nofPages * t->programPageNs;
+            break;
+        case kFLASH_HOST_OpRead:
+            ns += (uint64_t)nofBytes * t->readByteNs;
+            break;
+        case kFLASH_HOST_OpVerifyErase:
+            ns += (uint64_t)nofPages * t->verifyErasePageNs;
+            break;
+        case kFLASH_HOST_OpVerifyProgram:
+            ns += (uint64_t)nofPages * t->verifyProgramPageNs;
+            break;
+        case kFLASH_HOST_OpMappedRead:
+            ns = (uint64_t)nofBytes * t->mappedReadByteNs; /* plain bus access, no ROM call */
+            if (status != kStatus_Success)
+            {
+                ns += t->faultNs;
+            }
+            break;
+        default:
+            break;
+    }
+    /* atomic, reads may come from several threads (see readers_stress.c) */
+    __atomic_fetch_add(&s_host.stats.calls[op], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s_host.stats.bytes[op], nofBytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s_host.stats.timeNs[op], ns, __ATOMIC_RELAXED);
+    if (status != kStatus_Success)
+    {
+        __atomic_fetch_add(&s_host.stats.errors, 1, __ATOMIC_RELAXED);
+    }
+    return status;
+}
+
+/* number of pages of an erase or program which get done before the power cut, less than nofPages if it gets cut */
+static uint32_t FLASH_HOST_PagesBeforeCut(uint32_t nofPages)
+{
+    uint32_t done = (nofPages < s_host.cutPages) ? nofPages : s_host.cutPages;
+
+    if (s_host.cutPages != FLASH_HOST_POWER_CUT_OFF)
+    {
+        s_host.cutPages -= done;
+    }
+    return done;
+}
+
+/* the power goes away in the middle of an erase or program */
+static void FLASH_HOST_CutPower(void)
+{
+    s_host.powerOff = true;
+    s_host.cutPages = FLASH_HOST_POWER_CUT_OFF;
+    if (s_host.cutHandler != NULL)
+    {
+        s_host.cutHandler(); /* should not return */
+    }
+}
+
+/* checks the range against the flash size, returns the number of pages touched */
+static status_t FLASH_HOST_CheckRange(uint32_t start, uint32_t lengthInBytes, uint32_t alignment, uint32_t *nofPages)
+{
+    uint32_t first, last;
+
+    *nofPages = 0;
+    if (!s_host.isSetup)
+    {
+        return kStatus_FLASH_CommandFailure;
+    }
+    if ((start % alignment) != 0U || (lengthInBytes % alignment) != 0U)
+    {
+        return kStatus_FLASH_AlignmentError;
+    }
+    if (start >= s_host.config.totalSize || lengthInBytes > s_host.config.totalSize - start)
+    {
+        return kStatus_FLASH_AddressError;
+    }
+    if (lengthInBytes == 0U)
+    {
+        return kStatus_Success;
+    }
+    first     = start / s_host.config.pageSize;
+    last      = (start + lengthInBytes - 1U) / s_host.config.pageSize;
+    *nofPages = last - first + 1U;
+    return kStatus_Success;
+}
+
+static bool FLASH_HOST_AnyPageErased(uint32_t start, uint32_t nofPages)
+{
+    uint32_t page = start / s_host.config.pageSize;
+
+    for (uint32_t i = 0U; i < nofPages; i++)
+    {
+        if (s_host.pageState[page + i] == FLASH_HOST_PAGE_ERASED)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FLASH_HOST_GetDefaultConfig(flash_host_config_t *config)
+{
+    const char *env;
+
+    memset(config, 0, sizeof(*config));
+    config->totalSize                  = 256U * 1024U;
+    config->pageSize                   = 512U;
+    config->sectorSize                 = 32U * 1024U;
+    config->imageFile                  = getenv("FLASH_HOST_IMAGE");
+    env                                = getenv("FLASH_HOST_REPORT");
+    config->reportAtExit               = (env != NULL && env[0] != '\0' && env[0] != '0');
+    config->timing.callNs              = FLASH_HOST_DEFAULT_CALL_NS;
+    config->timing.erasePageNs         = FLASH_HOST_DEFAULT_ERASE_PAGE_NS;
+    config->timing.programPageNs       = FLASH_HOST_DEFAULT_PROGRAM_PAGE_NS;
+    config->timing.verifyErasePageNs   = FLASH_HOST_DEFAULT_VERIFY_ERASE_NS;
+    config->timing.verifyProgramPageNs = FLASH_HOST_DEFAULT_VERIFY_PROGRAM_NS;
+    config->timing.readByteNs          = FLASH_HOST_DEFAULT_READ_BYTE_NS;
+    config->timing.mappedReadByteNs    = FLASH_HOST_DEFAULT_MAPPED_BYTE_NS;
+    config->timing.faultNs             = FLASH_HOST_DEFAULT_FAULT_NS;
+}
+
+status_t FLASH_HOST_Setup(const flash_host_config_t *config)
+{
+    static bool atExitRegistered = false;
+    uint32_t pageCount;
+
+    if (config->pageSize == 0U || config->totalSize == 0U || (config->totalSize % config->pageSize) != 0U)
+    {
+        return kStatus_InvalidArgument;
+    }
+    FLASH_HOST_Teardown();
+    pageCount = config->totalSize / config->pageSize;
+    if (config->imageFile != NULL)
+    {
+        /* image layout: flash content followed by one state byte per page */
+        struct stat st;
+        size_t mapSize = (size_t)config->totalSize + pageCount;
+        bool isNew;
+        void *map;
+        int fd;
+
+        fd = open(config->imageFile, O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            return kStatus_Fail;
+        }
+        if (fstat(fd, &st) != 0 || (st.st_size != 0 && (size_t)st.st_size != mapSize))
+        {
+            close(fd); /* geometry does not match the image */
+            return kStatus_Fail;
+        }
+        isNew = (st.st_size == 0);
+        if (isNew && ftruncate(fd, (off_t)mapSize) != 0)
+        {
+            close(fd);
+            return kStatus_Fail;
+        }
+        map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+            return kStatus_Fail;
+        }
+        s_host.data      = map;
+        s_host.pageState = s_host.data + config->totalSize;
+        s_host.mapSize   = mapSize;
+        if (isNew)
+        {
+            memset(s_host.data, 0xff, config->totalSize);
+            memset(s_host.pageState, FLASH_HOST_PAGE_ERASED, pageCount);
+        }
+    }
+    else
+    {
+        s_host.data      = malloc(config->totalSize);
+        s_host.pageState = malloc(pageCount);
+        if (s_host.data == NULL || s_host.pageState == NULL)
+        {
+            FLASH_HOST_Teardown();
+            return kStatus_Fail;
+        }
+        memset(s_host.data, 0xff, config->totalSize);
+        memset(s_host.pageState, FLASH_HOST_PAGE_ERASED, pageCount);
+    }
+    s_host.eraseCount = calloc(pageCount, sizeof(uint32_t));
+    if (s_host.eraseCount == NULL)
+    {
+        FLASH_HOST_Teardown();
+        return kStatus_Fail;
+    }
+    s_host.config     = *config;
+    s_host.pageCount  = pageCount;
+    s_host.isSetup    = true;
+    s_host.cutPages   = FLASH_HOST_POWER_CUT_OFF;
+    s_host.cutHandler = NULL;
+    s_host.powerOff   = false;
+    memset(&s_host.stats, 0, sizeof(s_host.stats));
+    if (config->reportAtExit && !atExitRegistered)
+    {
+        atExitRegistered = true;
+        atexit(FLASH_HOST_ReportAtExit);
+    }
+    return kStatus_Success;
+}
+
+void FLASH_HOST_Teardown(void)
+{
+    if (s_host.mapSize != 0U)
+    {
+        msync(s_host.data, s_host.mapSize, MS_SYNC);
+        munmap(s_host.data, s_host.mapSize);
+    }
+    else
+    {
+        free(s_host.data);
+        free(s_host.pageState);
+    }
+    free(s_host.eraseCount);
+    s_host.data       = NULL;
+    s_host.pageState  = NULL;
+    s_host.eraseCount = NULL;
+    s_host.mapSize    = 0U;
+    s_host.isSetup    = false;
+}
+
+void FLASH_HOST_SetTiming(const flash_host_timing_t *timing)
+{
+    s_host.config.timing = *timing;
+}
+
+void FLASH_HOST_GetStats(flash_host_stats_t *stats)
+{
+    *stats = s_host.stats;
+}
+
+void FLASH_HOST_ResetStats(void)
+{
+    memset(&s_host.stats, 0, sizeof(s_host.stats));
+}
+
+uint64_t FLASH_HOST_GetModeledTimeNs(void)
+{
+    uint64_t ns = 0U;
+
+    for (int i = 0; i < kFLASH_HOST_OpCount; i++)
+    {
+        ns += s_host.stats.timeNs[i];
+    }
+    return ns;
+}
+
+uint32_t FLASH_HOST_GetCycleCounter(void)
+{
+    return (uint32_t)((FLASH_HOST_GetModeledTimeNs() * 96U) / 1000U);
+}
+
+void FLASH_HOST_SetPowerCut(uint32_t nofPages, void (*handler)(void))
+{
+    s_host.cutPages   = nofPages;
+    s_host.cutHandler = handler;
+    s_host.powerOff   = false;
+}
+
+void FLASH_HOST_Lock(void)
+{
+    (void)pthread_mutex_lock(&s_lock);
+}
+
+void FLASH_HOST_Unlock(void)
+{
+    (void)pthread_mutex_unlock(&s_lock);
+}
+
+void FLASH_HOST_PrintReport(FILE *stream)
+{
+    const flash_host_stats_t *s = &s_host.stats;
+
+    fprintf(stream, "flash emulation: %u bytes, %u byte pages\n", (unsigned)s_host.config.totalSize,
+            (unsigned)s_host.config.pageSize);
+    fprintf(stream, "  %-14s %10s %12s %14s\n", "operation", "calls", "bytes", "time [us]");
+    for (int i = 0; i < kFLASH_HOST_OpCount; i++)
+    {
+        fprintf(stream, "  %-14s %10llu %12llu %14.1f\n", s_opNames[i], (unsigned long long)s->calls[i],
+                (unsigned long long)s->bytes[i], (double)s->timeNs[i] / 1000.0);
+    }
+    fprintf(stream, "  errors: %llu, faults: %llu, page erases: %llu, max erases of a page: %u\n",
+            (unsigned long long)s->errors, (unsigned long long)s->faults, (unsigned long long)s->pageErases,
+            (unsigned)s->maxPageErases);
+    fprintf(stream, "  modeled flash time: %.3f ms\n", (double)FLASH_HOST_GetModeledTimeNs() / 1000000.0);
+}
+
+status_t FLASH_Init(flash_config_t *config)
+{
+    if (!s_host.isSetup)
+    {
+        flash_host_config_t hostConfig;
+
+        FLASH_HOST_GetDefaultConfig(&hostConfig);
+        if (FLASH_HOST_Setup(&hostConfig) != kStatus_Success)
+        {
+            return kStatus_FLASH_CommandFailure;
+        }
+    }
+    config->modeConfig.sysFreqInMHz = 96U;
+    config->PFlashBlockBase         = 0U;
+    config->PFlashTotalSize         = s_host.config.totalSize;
+    config->PFlashBlockCount        = 1U;
+    config->PFlashPageSize          = s_host.config.pageSize;
+    config->PFlashSectorSize        = s_host.config.sectorSize;
+    return kStatus_Success;
+}
+
+status_t FLASH_Erase(flash_config_t *config, uint32_t start, uint32_t lengthInBytes, uint32_t key)
+{
+    status_t status;
+    uint32_t nofPages, page, done;
+
+    (void)config;
+    if (key != (uint32_t)kFLASH_ApiEraseKey)
+    {
+        return FLASH_HOST_Account(kFLASH_HOST_OpErase, 0U, 0U, kStatus_FLASH_EraseKeyError);
+    }
+    status = FLASH_HOST_CheckRange(start, lengthInBytes, s_host.config.pageSize, &nofPages);
+    if (status == kStatus_Success && s_host.powerOff)
+    {
+        status = kStatus_Fail;
+    }
+    if (status != kStatus_Success)
+    {
+        return FLASH_HOST_Account(kFLASH_HOST_OpErase, 0U, 0U, status);
+    }
+    done = FLASH_HOST_PagesBeforeCut(nofPages);
+    memset(s_host.data + start, 0xff, done * s_host.config.pageSize);
+    page = start / s_host.config.pageSize;
+    for (uint32_t i = 0U; i < done; i++)
+    {
+        s_host.pageState[page + i] = FLASH_HOST_PAGE_ERASED;
+        s_host.eraseCount[page + i]++;
+        if (s_host.eraseCount[page + i] > s_host.stats.maxPageErases)
+        {
+            s_host.stats.maxPageErases = s_host.eraseCount[page + i];
+        }
+    }
+    s_host.stats.pageErases += done;
+    if (done < nofPages)
+    {
+        FLASH_HOST_CutPower();
+        return FLASH_HOST_Account(kFLASH_HOST_OpErase, done * s_host.config.pageSize, done, kStatus_Fail);
+    }
+    return FLASH_HOST_Account(kFLASH_HOST_OpErase, lengthInBytes, nofPages, kStatus_Success);
+}
+
+status_t FLASH_Program(flash_config_t *config, uint32_t start, uint8_t *src, uint32_t lengthInBytes)
+{
+    status_t status;
+    uint32_t nofPages, page, done;
+
+    (void)config;
+    status = FLASH_HOST_CheckRange(start, lengthInBytes, s_host.config.pageSize, &nofPages);
+    if (status != kStatus_Success)
+    {
+        return FLASH_HOST_Account(kFLASH_HOST_OpProgram, 0U, 0U, status);
+    }
+    page = start / s_host.config.pageSize;
+    for (uint32_t i = 0U; i < nofPages; i++)
+    {
+        if (s_host.pageState[page + i] != FLASH_HOST_PAGE_ERASED)
+        {
+            /* no re-programming without erase on LPC55 */
+            return FLASH_HOST_Account(kFLASH_HOST_OpProgram, 0U, 0U, kStatus_FLASH_CommandFailure);
+        }
+    }
+    if (s_host.powerOff)
+    {
+        return FLASH_HOST_Account(kFLASH_HOST_OpProgram, 0U, 0U, kStatus_Fail);
+    }
+    done = FLASH_HOST_PagesBeforeCut(nofPages);
+    memcpy(s_host.data + start, src, done * s_host.config.pageSize);
+    memset(s_host.pageState + page, FLASH_HOST_PAGE_PROGRAMMED, done);
+    if (done < nofPages)
+    {
+        FLASH_HOST_CutPower();
+        return FLASH_HOST_Account(kFLASH_HOST_OpProgram, done * s_host.config.pageSize, done, kStatus_Fail);
+    }
+    return FLASH_HOST_Account(kFLASH_HOST_OpProgram, lengthInBytes, nofPages, kStatus_Success);
+}
+
+status_t FLASH_Read(flash_config_t *config, uint32_t start, uint8_t *dest, uint32_t lengthInBytes)
+{
+    status_t status;
+    uint32_t nofPages;
+
+    (void)config;
+    status = FLASH_HOST_CheckRange(start, lengthInBytes, 1U, &nofPages);
+    if (status != kStatus_Success)
+    {
+        return FLASH_HOST_Account(kFLASH_HOST_OpRead, 0U, 0U, status);
+    }
+    if (FLASH_HOST_AnyPageErased(start, nofPages))
+    {
+        /* the target hard faults or reports an ECC error on erased pages */
+        return FLASH_HOST_Account(kFLASH_HOST_OpRead, lengthInBytes, nofPages, kStatus_FLASH_EccError);
+    }
+    memcpy(dest, s_host.data + start, lengthInBytes);
+    return FLASH_HOST_Account(kFLASH_HOST_OpRead, lengthInBytes, nofPages, kStatus_Success);
+}
+
+int FLASH_HOST_MappedRead(void *dest, uint32_t start, size_t lengthInBytes)
+{
+    status_t status;
+    uint32_t nofPages;
+
+    status = FLASH_HOST_CheckRange(start, (uint32_t)lengthInBytes, 1U, &nofPages);
+    if (status == kStatus_Success && FLASH_HOST_AnyPageErased(start, nofPages))
+    {
+        status = kStatus_FLASH_EccError; /* bus fault on the target */
+    }
+    if (status != kStatus_Success)
+    {
+        s_host.stats.faults++;
+        FLASH_HOST_Account(kFLASH_HOST_OpMappedRead, 0U, 0U, status);
+        return -1;
+    }
+    memcpy(dest, s_host.data + start, lengthInBytes);
+    FLASH_HOST_Account(kFLASH_HOST_OpMappedRead, (uint32_t)lengthInBytes, nofPages, kStatus_Success);
+    return 0;
+}
+
+const void *FLASH_HOST_Map(uint32_t start, size_t lengthInBytes)
+{
+    status_t status;
+    uint32_t nofPages;
+
+    status = FLASH_HOST_CheckRange(start, (uint32_t)lengthInBytes, 1U, &nofPages);
+    if (status == kStatus_Success && FLASH_HOST_AnyPageErased(start, nofPages))
+    {
+        status = kStatus_FLASH_EccError; /* the caller would take a bus fault on the target */
+    }
+    if (status != kStatus_Success)
+    {
+        s_host.stats.faults++;
+        FLASH_HOST_Account(kFLASH_HOST_OpMappedRead, 0U, 0U, status);
+        return NULL;
+    }
+    /* the caller reads the range in place: accounted like a mapped read of it */
+    FLASH_HOST_Account(kFLASH_HOST_OpMappedRead, (uint32_t)lengthInBytes, nofPages, kStatus_Success);
+    return s_host.data + start;
+}
+
+status_t FLASH_VerifyErase(flash_config_t *config, uint32_t start, uint32_t lengthInBytes)
+{
+    status_t status;
+    uint32_t nofPages, page;
+
+    (void)config;
+    status = FLASH_HOST_CheckRange(start, lengthInBytes, 4U, &nofPages);
+    if (status != kStatus_Success)
+    {
+        return FLASH_HOST_Account(kFLASH_HOST_OpVerifyErase, 0U, 0U, status);
+    }
+    page = start / s_host.config.pageSize;
+    for (uint32_t i = 0U; i < nofPages; i++)
+    {
+        if (s_host.pageState[page + i] != FLASH_HOST_PAGE_ERASED)
+        {
+            status = kStatus_FLASH_CommandFailure;
+            break;
+        }
+    }
+    /* not being erased is an expected answer, don't count it as error */
+    FLASH_HOST_Account(kFLASH_HOST_OpVerifyErase, lengthInBytes, nofPages, kStatus_Success);
+    return status;
+}
+
+status_t FLASH_VerifyProgram(flash_config_t *config,
+                             uint32_t start,
+                             uint32_t lengthInBytes,
+                             const uint8_t *expectedData,
+                             uint32_t *failedAddress,
+                             uint32_t *failedData)
+{
+    status_t status;
+    uint32_t nofPages;
+
+    (void)config;
+    status = FLASH_HOST_CheckRange(start, lengthInBytes, 4U, &nofPages);
+    if (status != kStatus_Success)
+    {
+        return FLASH_HOST_Account(kFLASH_HOST_OpVerifyProgram, 0U, 0U, status);
+    }
+    if (FLASH_HOST_AnyPageErased(start, nofPages))
+    {
+        return FLASH_HOST_Account(kFLASH_HOST_OpVerifyProgram, lengthInBytes, nofPages, kStatus_FLASH_EccError);
+    }
+    for (uint32_t i = 0U; i < lengthInBytes; i += 4U)
+    {
+        if (memcmp(s_host.data + start + i, expectedData + i, 4U) != 0)
+        {
+            if (failedAddress != NULL)
+            {
+                *failedAddress = start + i;
+            }
+            if (failedData != NULL)
+            {
+                memcpy(failedData, s_host.data + start + i, 4U);
+            }
+            return FLASH_HOST_Account(kFLASH_HOST_OpVerifyProgram, lengthInBytes, nofPages,
+                                      kStatus_FLASH_CompareError);
+        }
+    }
+    return FLASH_HOST_Account(kFLASH_HOST_OpVerifyProgram, lengthInBytes, nofPages, kStatus_Success);
+}
+
+status_t FLASH_GetProperty(flash_config_t *config, flash_property_tag_t whichProperty, uint32_t *value)
+{
+    if (config == NULL || value == NULL)
+    {
+        return kStatus_FLASH_InvalidArgument;
+    }
+    switch (whichProperty)
+    {
+        case kFLASH_PropertyPflashSectorSize:
+            *value = config->PFlashSectorSize;
+            break;
+        case kFLASH_PropertyPflashTotalSize:
+        case kFLASH_PropertyPflashBlockSize:
+            *value = config->PFlashTotalSize;
+            break;
+        case kFLASH_PropertyPflashBlockCount:
+            *value = config->PFlashBlockCount;
+            break;
+        case kFLASH_PropertyPflashBlockBaseAddr:
+            *value = config->PFlashBlockBase;
+            break;
+        case kFLASH_PropertyPflashPageSize:
+            *value = config->PFlashPageSize;
+            break;
+        case kFLASH_PropertyPflashSystemFreq:
+            *value = config->modeConfig.sysFreqInMHz;
+            break;
+        default:
+            return kStatus_FLASH_UnknownProperty;
+    }
+    return kStatus_FLASH_Success;
+}
@@ -0,0 +1,126 @@
+/*
+ * fsl_iap_host.h
+ *
+ * Control interface of the host side LPC55S16 flash emulation (fsl_iap_host.c).
+ *
+ * The emulation follows the LPC55 flash semantics:
+ *  - 512-byte pages, erase and program only on page boundaries
+ *  - a page can only be programmed once after an erase
+ *  - reading an erased page fails (on the target this is a hard fault)
+ *
+ * Every ROM call is charged with a modeled latency, so the flash time of a
+ * workload can be reported without a board.
+ */
+
+#ifndef FSL_IAP_HOST_H_
+#define FSL_IAP_HOST_H_
+
+#include <stdio.h>
+#include "fsl_iap.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*! @brief Latency model, all values in nanoseconds. */
+typedef struct _flash_host_timing
+{
+    uint32_t callNs;              /*!< fixed overhead of every ROM API call */
+    uint32_t erasePageNs;         /*!< erase time per page */
+    uint32_t programPageNs;       /*!< program time per page */
+    uint32_t verifyErasePageNs;   /*!< verify erase time per page */
+    uint32_t verifyProgramPageNs; /*!< verify program time per page */
+    uint32_t readByteNs;          /*!< FLASH_Read() time per byte */
+    uint32_t mappedReadByteNs;    /*!< time per byte read from the memory mapped flash */
+    uint32_t faultNs;             /*!< time of a bus fault and its handler, for a mapped read of an erased page */
+} flash_host_timing_t;
+
+/*! @brief Emulation configuration. */
+typedef struct _flash_host_config
+{
+    uint32_t totalSize;        /*!< size of the program flash in bytes */
+    uint32_t pageSize;         /*!< page size in bytes */
+    uint32_t sectorSize;       /*!< sector size in bytes, reported by FLASH_GetProperty() */
+    const char *imageFile;     /*!< image file to mmap, NULL to keep the flash in RAM */
+    bool reportAtExit;         /*!< print the statistics to stderr when the process exits */
+    flash_host_timing_t timing; /*!< latency model */
+} flash_host_config_t;
+
+/*! @brief Emulated operations. */
+typedef enum _flash_host_op
+{
+    kFLASH_HOST_OpErase = 0,
+    kFLASH_HOST_OpProgram,
+    kFLASH_HOST_OpRead,
+    kFLASH_HOST_OpVerifyErase,
+    kFLASH_HOST_OpVerifyProgram,
+    kFLASH_HOST_OpMappedRead, /*!< read from the memory mapped flash, not a ROM call */
+    kFLASH_HOST_OpCount
+} flash_host_op_t;
+
+/*! @brief Statistics collected since FLASH_Init() or the last FLASH_HOST_ResetStats(). */
+typedef struct _flash_host_stats
+{
+    uint64_t calls[kFLASH_HOST_OpCount];  /*!< number of ROM calls */
+    uint64_t bytes[kFLASH_HOST_OpCount];  /*!< number of bytes covered by the calls */
+    uint64_t timeNs[kFLASH_HOST_OpCount]; /*!< modeled time spent */
+    uint64_t errors;                      /*!< calls which did not return kStatus_Success */
+    uint64_t faults;                      /*!< mapped reads of erased pages, a bus fault on the target */
+    uint64_t pageErases;                  /*!< number of page erase cycles (wear) */
+    uint32_t maxPageErases;               /*!< highest erase count of a single page */
+} flash_host_stats_t;
+
+/*!
+ * @brief Fills the configuration with the LPC55S16 defaults.
+ *
+ * The image file and the exit report can be preset with the environment
+ * variables FLASH_HOST_IMAGE and FLASH_HOST_REPORT.
+ */
+void FLASH_HOST_GetDefaultConfig(flash_host_config_t *config);
+
+/*!
+ * @brief Sets up the emulated flash. Must be called before FLASH_Init(), otherwise
+ * FLASH_Init() uses the default configuration.
+ * @return kStatus_Success, or kStatus_Fail if the image could not be created or mapped
+ */
+status_t FLASH_HOST_Setup(const flash_host_config_t *config);
+
+/*! @brief Releases the emulated flash, an image file gets synced and unmapped. */
+void FLASH_HOST_Teardown(void);
+
+/*! @brief Replaces the latency model, e.g. to compare different flash parts. */
+void FLASH_HOST_SetTiming(const flash_host_timing_t *timing);
+
+/*! @brief Returns a copy of the statistics. */
+void FLASH_HOST_GetStats(flash_host_stats_t *stats);
+
+/*! @brief Clears the statistics, the per page erase counters are kept. */
+void FLASH_HOST_ResetStats(void);
+
+/*! @brief Returns the total modeled flash time in nanoseconds. */
+uint64_t FLASH_HOST_GetModeledTimeNs(void);
+
+/*! @brief Prints the statistics and the modeled flash time. */
+void FLASH_HOST_PrintReport(FILE *stream);
+
+/*! @brief FLASH_HOST_SetPowerCut() without a power cut. */
+#define FLASH_HOST_POWER_CUT_OFF (0xFFFFFFFFU)
+
+/*!
+ * @brief Cuts the power after nofPages more pages got erased or programmed, and powers the flash on again.
+ *
+ * The erase or program call which would touch the next page only does the pages before it, the other pages
+ * keep their content: an interrupted page is either done or untouched, the ECC state of a half programmed
+ * page is not modeled. Then handler gets called, which is not expected to return (longjmp() to a simulated
+ * reset). If it returns or is NULL, the call fails and so does every erase and program after it, until the
+ * next FLASH_HOST_SetPowerCut().
+ * @param nofPages pages which still get erased or programmed, FLASH_HOST_POWER_CUT_OFF for no power cut
+ * @param handler called when the power goes away, may be NULL
+ */
+void FLASH_HOST_SetPowerCut(uint32_t nofPages, void (*handler)(void));
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* FSL_IAP_HOST_H_ */
@@ -0,0 +1,358 @@
+/*
+ * powerloss_stress.c
+ *
+ * Mount cycles with power loss, for the mount checkpoint of LFS_CHECKPOINT. Each cycle boots (McuFlash_Init()
+ * and lfs_mount()), checks the files, and does some work with the power cut after a random number of erased or
+ * programmed pages (FLASH_HOST_SetPowerCut()): configuration files get rewritten, a log gets appended to and
+ * temporary files come and go. A cycle which is not cut ends with lfs_unmount(), which leaves a checkpoint, or
+ * with a reset without it. The checks after each boot: the configuration files hold the last closed version or
+ * the one which was being written, the log holds all records up to the last closed append and maybe the one
+ * being appended, and every file holds valid data. The program fails if a mount or a check fails, or if
+ * LFS_CHECKPOINT is on and no mount used a checkpoint. Build with -DLFS_CHECKPOINT=0 to compare.
+ * The file system has the sizes of McuLittleFSconfig.h. With a prog size below the flash page the checks fail: a
+ * commit to the rest of a page McuFlash has programmed for the commit before erases the page first, a power cut
+ * right after the erase loses the commit before. So the build below uses the page size:
+ *
+ *    gcc -O2 -g -include host/McuFlashHostConfig.h -Ihost -Isource -DMcuLittleFS_CONFIG_IMAGE_END=0 -DMcuLittleFS_CONFIG_POOL=0 \
+ *        -DMcuLittleFS_CONFIG_FILESYSTEM_PROG_BUFFER_SIZE=512 -DMcuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE=512 \
+ *        host/fsl_iap_host.c source/McuFlash.c source/McuLittleFSBlockDevice.c source/McuLittleFS.c \
+ *        source/lfs.c source/lfs_util.c host/powerloss_stress.c -o powerloss_stress
+ *    ./powerloss_stress 200 1     # number of mount cycles, seed
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "fsl_iap_host.h"
+#include "lfs.h"
+#include "McuFlash.h"
+#include "McuLittleFSBlockDevice.h"
+
+#define NOF_CONFIGS  (4)    /* configuration files c<n>, rewritten as a whole */
+#define NOF_TEMPS    (4)    /* temporary files t<n>, created and removed */
+#define NOF_STEPS    (12)   /* operations per cycle */
+#define CUT_RANGE    (400)  /* the power gets cut after 0..CUT_RANGE-1 pages, some cycles get through */
+#define RECORD_SIZE  (16)   /* log record: 4 byte sequence number, then bytes (seq+i) */
+
+static lfs_t lfs;
+static struct lfs_config cfg = {
+    .read = McuLittleFS_block_device_read,
+    .prog = McuLittleFS_block_device_prog,
+    .erase = McuLittleFS_block_device_erase,
+    .sync = McuLittleFS_block_device_sync,
+    .map = McuLittleFS_block_device_map,
+    .read_size = McuLittleFS_CONFIG_FILESYSTEM_READ_BUFFER_SIZE,
+    .prog_size = McuLittleFS_CONFIG_FILESYSTEM_PROG_BUFFER_SIZE,
+    .cache_size = McuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE,
+    .lookahead_size = McuLittleFS_CONFIG_FILESYSTEM_LOOKAHEAD_SIZE,
+    .block_cycles = 100,
+    .block_size = 2048,
+    .block_count = 48,
+};
+
+/* what the application knows, kept over the power cuts */
+static uint32_t configVersion[NOF_CONFIGS];  /* last closed version, 0: never written */
+static uint32_t configPending[NOF_CONFIGS];  /* version being written, or configVersion */
+static uint32_t nofRecords;                  /* records of the log up to the last closed append */
+static uint32_t nofRecordsPending;           /* with the append being done */
+static uint32_t nextVersion = 1;
+static unsigned int seed;
+
+static jmp_buf reset;
+static int errors, cuts, unmounts, ckptMounts;
+static uint64_t mountNs[2]; /* modeled flash time of the mounts without and with a checkpoint */
+static int nofMounts[2];
+
+static void Error(const char *what, const char *path, int value)
+{
+    errors++;
+    printf("%s %s: %d\n", what, path, value);
+}
+
+/* the same sequence on every host */
+static unsigned int Random(void)
+{
+    seed = seed * 1103515245U + 12345U;
+    return (seed >> 16) & 0x7FFFU;
+}
+
+static void PowerCut(void)
+{
+    longjmp(reset, 1);
+}
+
+/* file content: a 4 byte version, then bytes (version+i), 100+version%1500 bytes in total */
+static int MakeContent(uint8_t *buf, uint32_t version)
+{
+    int len = 100 + version % 1500;
+
+    memcpy(buf, &version, 4);
+    for (int i = 4; i < len; i++)
+    {
+        buf[i] = (uint8_t)(version + i);
+    }
+    return len;
+}
+
+/* returns the version of the content, 0 if it is not valid */
+static uint32_t CheckContent(const uint8_t *buf, int len)
+{
+    uint32_t version;
+
+    if (len < 4)
+    {
+        return 0;
+    }
+    memcpy(&version, buf, 4);
+    if (len != (int)(100 + version % 1500))
+    {
+        return 0;
+    }
+    for (int i = 4; i < len; i++)
+    {
+        if (buf[i] != (uint8_t)(version + i))
+        {
+            return 0;
+        }
+    }
+    return version;
+}
+
+/* reads the whole file, returns its size or a negative error code */
+static int ReadFile(const char *path, uint8_t *buf, int size)
+{
+    lfs_file_t file;
+    int res, len;
+
+    res = lfs_file_open(&lfs, &file, path, LFS_O_RDONLY);
+    if (res != 0)
+    {
+        return res;
+    }
+    len = lfs_file_read(&lfs, &file, buf, size);
+    lfs_file_close(&lfs, &file);
+    return len;
+}
+
+static int WriteFile(const char *path, const uint8_t *buf, int len, int flags)
+{
+    lfs_file_t file;
+    int res;
+
+    res = lfs_file_open(&lfs, &file, path, LFS_O_WRONLY | LFS_O_CREAT | flags);
+    if (res != 0)
+    {
+        return res;
+    }
+    res = lfs_file_write(&lfs, &file, buf, len);
+    if (res != len)
+    {
+        lfs_file_close(&lfs, &file);
+        return (res < 0) ? res : LFS_ERR_IO;
+    }
+    return lfs_file_close(&lfs, &file);
+}
+
+static void CheckFiles(void)
+{
+    static uint8_t buf[16 * 1024];
+    uint32_t version, n;
+    char path[16];
+    int len;
+
+    for (int i = 0; i < NOF_CONFIGS; i++)
+    {
+        sprintf(path, "c%d", i);
+        len = ReadFile(path, buf, sizeof(buf));
+        if ((len == LFS_ERR_NOENT || len == 0) && configVersion[i] == 0)
+        {
+            continue; /* not written yet, or the first write got cut after the open created the file */
+        }
+        version = (len < 0) ? 0 : CheckContent(buf, len);
+        if (version == 0 || (version != configVersion[i] && version != configPending[i]))
+        {
+            Error("config", path, (int)version);
+        }
+        configVersion[i] = configPending[i] = version;
+    }
+
+    len = ReadFile("log", buf, sizeof(buf));
+    if (len == LFS_ERR_NOENT)
+    {
+        len = 0;
+    }
+    n = (len < 0) ? 0 : (uint32_t)len / RECORD_SIZE;
+    if (len < 0 || len % RECORD_SIZE != 0 || n < nofRecords || n > nofRecordsPending)
+    {
+        Error("log size", "log", len);
+    }
+    for (uint32_t r = 0; r < n; r++)
+    {
+        const uint8_t *rec = buf + r * RECORD_SIZE;
+
+        memcpy(&version, rec, 4);
+        for (int i = 4; i < RECORD_SIZE && version == r; i++)
+        {
+            version = (rec[i] == (uint8_t)(r + i)) ? version : r + 1;
+        }
+        if (version != r)
+        {
+            Error("log record", "log", (int)r);
+            break;
+        }
+    }
+    nofRecords = nofRecordsPending = n;
+
+    for (int i = 0; i < NOF_TEMPS; i++)
+    {
+        sprintf(path, "t%d", i);
+        len = ReadFile(path, buf, sizeof(buf));
+        if (len != LFS_ERR_NOENT && len != 0 && (len < 0 || CheckContent(buf, len) == 0))
+        {
+            Error("temp", path, len);
+        }
+    }
+    if (lfs_fs_size(&lfs) < 0) /* traverses the file system */
+    {
+        Error("fs", "", 0);
+    }
+}
+
+/* one step of the application, a power cut does not return from it */
+static void Work(void)
+{
+    static uint8_t buf[2048];
+    char path[16];
+    int res, i, len;
+
+    i = Random() % NOF_CONFIGS;
+    switch (Random() % 4)
+    {
+        case 0:
+        case 1:
+            sprintf(path, "c%d", i);
+            configPending[i] = nextVersion++;
+            len = MakeContent(buf, configPending[i]);
+            res = WriteFile(path, buf, len, LFS_O_TRUNC);
+            if (res == 0)
+            {
+                configVersion[i] = configPending[i];
+            }
+            break;
+        case 2:
+            strcpy(path, "log");
+            for (int j = 0; j < RECORD_SIZE; j++)
+            {
+                buf[j] = (uint8_t)(nofRecords + j);
+            }
+            memcpy(buf, &nofRecords, 4);
+            nofRecordsPending = nofRecords + 1;
+            res = WriteFile(path, buf, RECORD_SIZE, LFS_O_APPEND);
+            if (res == 0)
+            {
+                nofRecords = nofRecordsPending;
+            }
+            break;
+        default:
+            sprintf(path, "t%d", i);
+            res = lfs_remove(&lfs, path);
+            if (res == LFS_ERR_NOENT)
+            {
+                len = MakeContent(buf, nextVersion++);
+                res = WriteFile(path, buf, len, LFS_O_TRUNC);
+            }
+            break;
+    }
+    if (res != 0)
+    {
+        Error("work", path, res);
+    }
+}
+
+static int Boot(void)
+{
+    uint64_t start;
+    int res, ckpt = 0;
+
+    McuFlash_Init(); /* the RAM is gone: the write buffer and the page states */
+    memset(&lfs, 0, sizeof(lfs));
+    start = FLASH_HOST_GetModeledTimeNs();
+    res   = lfs_mount(&lfs, &cfg);
+#if LFS_CHECKPOINT
+    ckpt = lfs.ckpt_ondisk;
+#endif
+    mountNs[ckpt] += FLASH_HOST_GetModeledTimeNs() - start;
+    nofMounts[ckpt]++;
+    ckptMounts += ckpt;
+    return res;
+}
+
+int main(int argc, char **argv)
+{
+    int nofCycles = (argc > 1) ? atoi(argv[1]) : 200;
+    int res;
+
+    seed = (argc > 2) ? (unsigned int)atoi(argv[2]) : 1;
+    if (McuLittleFS_block_device_init() != LFS_ERR_OK || lfs_format(&lfs, &cfg) != 0)
+    {
+        printf("format failed\n");
+        return 1;
+    }
+    for (int cycle = 0; cycle < nofCycles; cycle++)
+    {
+        res = Boot();
+        if (res != 0)
+        {
+            printf("cycle %d: mount failed: %d\n", cycle, res);
+            errors++;
+            break;
+        }
+        CheckFiles();
+        FLASH_HOST_SetPowerCut((uint32_t)(Random() % CUT_RANGE), PowerCut);
+        if (setjmp(reset) == 0)
+        {
+            for (int i = 0; i < NOF_STEPS; i++)
+            {
+                Work();
+            }
+            if (Random() % 4 != 0) /* else a reset without unmount */
+            {
+                res = lfs_unmount(&lfs);
+                if (res != 0)
+                {
+                    Error("unmount", "", res);
+                }
+                unmounts++;
+            }
+        }
+        else
+        {
+            cuts++;
+        }
+        FLASH_HOST_SetPowerCut(FLASH_HOST_POWER_CUT_OFF, NULL);
+    }
+    if (errors == 0 && Boot() == 0)
+    {
+        CheckFiles();
+        lfs_unmount(&lfs);
+    }
+
+    printf("LFS_CHECKPOINT %d, %d cycles: %d power cuts, %d unmounts, %d mounts from a checkpoint, %d errors\n",
+           LFS_CHECKPOINT, nofCycles, cuts, unmounts, ckptMounts, errors);
+    for (int i = 0; i < 2; i++)
+    {
+        if (nofMounts[i] > 0)
+        {
+            printf("  mount %s a checkpoint: %6.1f us modeled flash time\n", i ? "with" : "without",
+                   mountNs[i] / 1e3 / nofMounts[i]);
+        }
+    }
+    if (LFS_CHECKPOINT && ckptMounts == 0)
+    {
+        printf("no mount used a checkpoint\n");
+        errors++;
+    }
+    printf("%s\n", errors == 0 ? "ok" : "FAILED");
+    return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+/*
+ * preerase_latency.c
+ *
+ * Latency of small appends to a log file, with and without McuLFS_PreErase() in the idle time
+ * between them. Each append is 64 bytes followed by lfs_file_sync(), its latency is the modeled
+ * flash time (fsl_iap_host.c). An append which has to erase a block first is the slow one: the
+ * pre-erase pool moves these erases into the idle time and shortens the tail (p99, max).
+ * An append copies the last block of the file into a new one and every 8th append compacts the
+ * superblock pair, so it takes 2 erases of idle time per append to keep up. 'appends erased'
+ * counts the appends which still had to erase a block, when the pool ran out or littlefs
+ * relocated a pair.
+ *
+ *    gcc -O2 -include host/McuFlashHostConfig.h -Ihost -Isource -DMcuLittleFS_CONFIG_IMAGE_END=0 \
+ *        host/fsl_iap_host.c source/McuFlash.c source/McuLittleFSBlockDevice.c \
+ *        source/McuLittleFS.c source/lfs.c source/lfs_util.c host/preerase_latency.c -o preerase_latency
+ *    ./preerase_latency           # appends only
+ *    ./preerase_latency idle      # McuLFS_PreErase(2) after each append
+ *    ./preerase_latency idle 1    # McuLFS_PreErase(1) */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fsl_iap_host.h"
+#include "McuLib.h"
+#include "McuLittleFS.h"
+#include "McuLittleFSconfig.h"
+#include "McuLittleFSBlockDevice.h"
+
+#define NOF_APPENDS   (1000)
+#define APPEND_SIZE   (64)
+
+static int CompareLatency(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x < y) ? -1 : (x > y);
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t buf[8192];
+    static uint64_t latency[NOF_APPENDS];
+    uint64_t sum = 0, start;
+    uint32_t nofSkipped, nofErased, erasedBefore, nofErasing = 0;
+    bool idle = (argc > 1 && strcmp(argv[1], "idle") == 0);
+    lfs_t *lfs;
+    lfs_file_t file;
+
+    if (McuLittleFS_block_device_init() != LFS_ERR_OK)
+    {
+        printf("no file system partition\n");
+        return 1;
+    }
+    if (McuLFS_Mount() != ERR_OK && (McuLFS_Format() != ERR_OK || McuLFS_Mount() != ERR_OK))
+    {
+        printf("mount failed\n");
+        return 1;
+    }
+    lfs = McuLFS_GetFileSystem();
+    memset(buf, 0x55, sizeof(buf));
+
+    /* leave freed but programmed blocks behind, as a file system in use has them */
+    lfs_file_open(lfs, &file, "fill.bin", LFS_O_WRONLY | LFS_O_CREAT);
+    for (int i = 0; i < 20; i++)
+    {
+        lfs_file_write(lfs, &file, buf, sizeof(buf));
+    }
+    lfs_file_close(lfs, &file);
+    lfs_remove(lfs, "fill.bin");
+
+    lfs_file_open(lfs, &file, "log.bin", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND);
+    for (int i = 0; i < NOF_APPENDS; i++)
+    {
+        McuLittleFS_block_device_get_erase_stats(&nofSkipped, &erasedBefore);
+        start = FLASH_HOST_GetModeledTimeNs();
+        if (lfs_file_write(lfs, &file, buf, APPEND_SIZE) != APPEND_SIZE || lfs_file_sync(lfs, &file) != 0)
+        {
+            printf("append %d failed\n", i);
+            return 1;
+        }
+        latency[i] = FLASH_HOST_GetModeledTimeNs() - start;
+        sum += latency[i];
+        McuLittleFS_block_device_get_erase_stats(&nofSkipped, &nofErased);
+        nofErasing += (nofErased != erasedBefore); /* a block erase the pool did not take over */
+#if McuLittleFS_CONFIG_PREERASE_POOL_SIZE > 0
+        if (idle)
+        {
+            (void)McuLFS_PreErase((argc > 2) ? (uint32_t)atoi(argv[2]) : 2);
+        }
+#endif
+    }
+    lfs_file_close(lfs, &file);
+
+    qsort(latency, NOF_APPENDS, sizeof(latency[0]), CompareLatency);
+    McuLittleFS_block_device_get_erase_stats(&nofSkipped, &nofErased);
+    printf("%d byte append+sync x%d%s: mean %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms, erases skipped %u, done %u, %u appends erased\n",
+           APPEND_SIZE, NOF_APPENDS, idle ? " with pre-erase" : "", sum / 1e6 / NOF_APPENDS,
+           latency[NOF_APPENDS / 2] / 1e6, latency[NOF_APPENDS * 99 / 100] / 1e6, latency[NOF_APPENDS - 1] / 1e6,
+           (unsigned)nofSkipped, (unsigned)nofErased, (unsigned)nofErasing);
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * prog_bench.c
+ *
+ * McuFlash_Program() calls of large file writes: a 64 KiB file gets rewritten 20 times with
+ * lfs_file_write() calls of the given chunk size, then read back and compared. Aligned chunks of
+ * at least cache_size bytes are programmed straight from the caller's buffer, smaller ones go
+ * through the littlefs program cache one cache_size at a time.
+ *
+ *    gcc -O2 -include host/McuFlashHostConfig.h -Ihost -Isource -DMcuLittleFS_CONFIG_IMAGE_END=0 \
+ *        host/fsl_iap_host.c source/McuFlash.c source/McuLittleFSBlockDevice.c \
+ *        source/McuLittleFS.c source/lfs.c source/lfs_util.c host/prog_bench.c -o prog_bench
+ *    ./prog_bench 4096         # chunk size in bytes, 256..8192
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fsl_iap_host.h"
+#include "McuLib.h"
+#include "McuFlash.h"
+#include "McuLittleFS.h"
+#include "McuLittleFSBlockDevice.h"
+
+#define FILE_SIZE     (64 * 1024)
+#define NOF_REWRITES  (20)
+
+int main(int argc, char **argv)
+{
+    static uint8_t buf[8192], readBuf[8192];
+    int chunk = (argc > 1) ? atoi(argv[1]) : 4096;
+    unsigned long total = 0;
+    uint64_t modeledStart;
+    struct timespec start, end;
+    McuFlash_Stats_t stats;
+    bool ok = true;
+    lfs_t *lfs;
+    lfs_file_t file;
+
+    if (chunk <= 0 || chunk > (int)sizeof(buf) || (FILE_SIZE % chunk) != 0)
+    {
+        printf("chunk size must divide %d and be at most %d\n", FILE_SIZE, (int)sizeof(buf));
+        return 1;
+    }
+    if (McuLittleFS_block_device_init() != LFS_ERR_OK || McuLFS_Format() != ERR_OK || McuLFS_Mount() != ERR_OK)
+    {
+        printf("mount failed\n");
+        return 1;
+    }
+    lfs = McuLFS_GetFileSystem();
+    for (int i = 0; i < (int)sizeof(buf); i++)
+    {
+        buf[i] = (uint8_t)(i * 7 + 3);
+    }
+
+    McuFlash_ResetStats();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    modeledStart = FLASH_HOST_GetModeledTimeNs();
+    for (int r = 0; r < NOF_REWRITES; r++)
+    {
+        lfs_file_open(lfs, &file, "big.bin", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+        for (int n = 0; n < FILE_SIZE / chunk; n++)
+        {
+            if (lfs_file_write(lfs, &file, buf, chunk) != chunk)
+            {
+                printf("write failed\n");
+                return 1;
+            }
+            total += chunk;
+        }
+        if (lfs_file_close(lfs, &file) != 0)
+        {
+            printf("close failed\n");
+            return 1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    McuFlash_GetStats(&stats);
+
+    lfs_file_open(lfs, &file, "big.bin", LFS_O_RDONLY);
+    for (int n = 0; n < FILE_SIZE / chunk; n++)
+    {
+        if (lfs_file_read(lfs, &file, readBuf, chunk) != chunk || memcmp(readBuf, buf, chunk) != 0)
+        {
+            ok = false;
+        }
+    }
+    lfs_file_close(lfs, &file);
+
+    printf("chunk %d: %lu bytes, McuFlash_Program calls %u, program bytes %u, cpu %.1f ms, modeled %.1f ms, read back %s\n",
+           chunk, total, (unsigned)stats.nofPrograms, (unsigned)stats.programBytes,
+           (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6,
+           (FLASH_HOST_GetModeledTimeNs() - modeledStart) / 1e6, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+/*
+ * rcache_bench.c
+ *
+ * Flash reads of an open/stat/read mix over small files in two directories, to compare read
+ * cache configurations (LFS_RCACHE_WAYS). The read cache matters most if the block device has no
+ * map callback, so build it with McuLittleFS_CONFIG_BLOCK_DEVICE_MAP=0. The validated commit and
+ * path lookup caches (LFS_FCACHE_SIZE, LFS_DCACHE_SIZE) save reads as well: turn them off to see
+ * the read cache alone.
+ *
+ *    gcc -O2 -include host/McuFlashHostConfig.h -Ihost -Isource -DMcuLittleFS_CONFIG_IMAGE_END=0 -DMcuLittleFS_CONFIG_BLOCK_DEVICE_MAP=0 \
+ *        -DLFS_RCACHE_WAYS=4 -DLFS_FCACHE_SIZE=0 -DLFS_DCACHE_SIZE=0 \
+ *        host/fsl_iap_host.c source/McuFlash.c source/McuLittleFSBlockDevice.c \
+ *        source/McuLittleFS.c source/lfs.c source/lfs_util.c host/rcache_bench.c -o rcache_bench
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "fsl_iap_host.h"
+#include "McuLib.h"
+#include "McuLittleFS.h"
+#include "McuLittleFSBlockDevice.h"
+
+#define NOF_FILES     (12)
+#define NOF_ACCESSES  (400)
+
+static void FileName(char *name, int i)
+{
+    sprintf(name, (i & 1) ? "cfg/c%d" : "log/l%d", i);
+}
+
+int main(void)
+{
+    uint8_t buf[300];
+    char name[32];
+    struct lfs_info info;
+    flash_host_stats_t stats;
+    lfs_t *lfs;
+    lfs_file_t file;
+
+    if (McuLittleFS_block_device_init() != LFS_ERR_OK || McuLFS_Format() != ERR_OK || McuLFS_Mount() != ERR_OK)
+    {
+        printf("mount failed\n");
+        return 1;
+    }
+    lfs = McuLFS_GetFileSystem();
+    lfs_mkdir(lfs, "cfg");
+    lfs_mkdir(lfs, "log");
+    for (int i = 0; i < NOF_FILES; i++)
+    {
+        FileName(name, i);
+        memset(buf, i, sizeof(buf));
+        lfs_file_open(lfs, &file, name, LFS_O_WRONLY | LFS_O_CREAT);
+        lfs_file_write(lfs, &file, buf, 40 + i * 20);
+        lfs_file_close(lfs, &file);
+    }
+
+    FLASH_HOST_ResetStats();
+    lfs->rcache_hits = 0;
+    lfs->rcache_misses = 0;
+    for (int n = 0; n < NOF_ACCESSES; n++)
+    {
+        int i = (n * 7) % NOF_FILES;
+        int res;
+
+        FileName(name, i);
+        lfs_stat(lfs, name, &info);
+        lfs_file_open(lfs, &file, name, LFS_O_RDONLY);
+        res = lfs_file_read(lfs, &file, buf, sizeof(buf));
+        lfs_file_close(lfs, &file);
+        if (res != 40 + i * 20 || buf[0] != i)
+        {
+            printf("%s: read %d bytes, wrong content\n", name, res);
+            return 1;
+        }
+    }
+
+    FLASH_HOST_GetStats(&stats);
+    printf("LFS_RCACHE_WAYS %d: %llu flash reads, %llu bytes, rcache hits %u misses %u\n", LFS_RCACHE_WAYS,
+           (unsigned long long)stats.calls[kFLASH_HOST_OpRead], (unsigned long long)stats.bytes[kFLASH_HOST_OpRead],
+           (unsigned)lfs->rcache_hits, (unsigned)lfs->rcache_misses);
+    return 0;
+}
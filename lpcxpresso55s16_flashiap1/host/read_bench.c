@@ -0,0 +1,163 @@
+/*
+ * read_bench.c
+ *
+ * McuFlash_Read() with McuFlash_CONFIG_READ_MODE ROM (FLASH_Read()) and MAPPED (memcpy() from the memory mapped
+ * flash, a read of an erased page takes a bus fault). First it checks reads of erased pages: they have to return
+ * 0xFF, with ERR_OK inside of the erased page bitmap (McuFlash_CONFIG_TRACKED_BASE/SIZE) and ERR_FAULT outside of
+ * it or without McuFlash_CONFIG_ERASED_TRACKING, the same in both modes. Then it measures the modeled flash time
+ * of reads of programmed and of erased pages, 'cold' right after McuFlash_Init() when no page state is known, and
+ * 'warm' when it is. The program fails if a check fails. A smaller tracked area checks the reads outside of it:
+ *
+ *    gcc -O2 -include host/McuFlashHostConfig.h -Ihost -Isource -DMcuFlash_CONFIG_READ_MODE=McuFlash_READ_MODE_MAPPED \
+ *        -DMcuFlash_CONFIG_TRACKED_SIZE="(128*1024)" \
+ *        host/fsl_iap_host.c source/McuFlash.c source/McuLib.c host/read_bench.c -o read_bench
+ *    ./read_bench
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "fsl_iap_host.h"
+#include "McuLib.h"
+#include "McuFlash.h"
+
+#define AREA_OFFSET        (64 * 1024)  /* from the start of the flash */
+#define NOF_PROGRAMMED     (16)         /* programmed pages at the start of the area, followed by erased pages */
+#define NOF_ERASED         (16)
+#define NOF_READS          (1000)
+
+static int errors;
+
+static void Check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        errors++;
+        printf("FAILED: %s\n", what);
+    }
+}
+
+static bool IsFilled(const uint8_t *buf, size_t size, uint8_t value)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (buf[i] != value)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* the error code of a read of an erased page at addr */
+static uint8_t ErasedReadResult(uint32_t addr)
+{
+#if McuFlash_CONFIG_ERASED_TRACKING
+    if (addr - McuFlash_CONFIG_TRACKED_BASE < McuFlash_CONFIG_TRACKED_SIZE)
+    {
+        return ERR_OK;
+    }
+#else
+    (void)addr;
+#endif
+    return ERR_FAULT;
+}
+
+/* modeled time and faults of NOF_READS reads of size bytes, going round in the pages of [addr, addr+areaSize) */
+static void Measure(const char *what, bool cold, uint32_t addr, uint32_t areaSize, size_t size)
+{
+    static uint8_t buf[4096];
+    flash_host_stats_t stats;
+    uint64_t timeNs;
+
+    if (cold)
+    {
+        McuFlash_Init(); /* forgets the page states */
+    }
+    FLASH_HOST_ResetStats();
+    timeNs = FLASH_HOST_GetModeledTimeNs();
+    for (int i = 0; i < NOF_READS; i++)
+    {
+        McuFlash_Read((void *)(uintptr_t)(addr + (i * size) % areaSize), buf, size);
+    }
+    timeNs = FLASH_HOST_GetModeledTimeNs() - timeNs;
+    FLASH_HOST_GetStats(&stats);
+    printf("  %-10s %s %5u bytes: %8.2f us per read, %5llu ROM reads, %5llu verify erase, %5llu mapped, %4llu faults\n",
+           what, cold ? "cold" : "warm", (unsigned)size, timeNs / 1e3 / NOF_READS, (unsigned long long)stats.calls[kFLASH_HOST_OpRead],
+           (unsigned long long)stats.calls[kFLASH_HOST_OpVerifyErase],
+           (unsigned long long)stats.calls[kFLASH_HOST_OpMappedRead], (unsigned long long)stats.faults);
+}
+
+int main(void)
+{
+    static const size_t sizes[] = {16, 256, 512, 4096};
+    static uint8_t data[NOF_PROGRAMMED * McuFlash_CONFIG_FLASH_BLOCK_SIZE], buf[2 * McuFlash_CONFIG_FLASH_BLOCK_SIZE];
+    const uint32_t pageSize = McuFlash_CONFIG_FLASH_BLOCK_SIZE;
+    McuFlash_Geometry_t geometry;
+    flash_host_stats_t stats;
+    uint32_t area, erased, outside;
+    uint64_t faults;
+    uint8_t res;
+
+    McuFlash_Init();
+    if (McuFlash_GetGeometry(&geometry) != ERR_OK)
+    {
+        printf("no flash\n");
+        return 1;
+    }
+    area   = geometry.base + AREA_OFFSET;
+    erased = area + NOF_PROGRAMMED * pageSize;
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(i * 7 + 1);
+    }
+    /* the emulated flash starts blank: only the programmed pages get written */
+    if (McuFlash_Program((void *)(uintptr_t)area, data, sizeof(data)) != ERR_OK || McuFlash_Flush() != ERR_OK)
+    {
+        printf("program failed\n");
+        return 1;
+    }
+
+    printf("READ_MODE %s, ERASED_TRACKING %d, tracked 0x%x..0x%x\n",
+           McuFlash_CONFIG_READ_MODE == McuFlash_READ_MODE_MAPPED ? "MAPPED" : "ROM", McuFlash_CONFIG_ERASED_TRACKING,
+           (unsigned)McuFlash_CONFIG_TRACKED_BASE, (unsigned)(McuFlash_CONFIG_TRACKED_BASE + McuFlash_CONFIG_TRACKED_SIZE));
+    McuFlash_Init();
+    for (int pass = 0; pass < 2; pass++) /* cold, then with the page states known */
+    {
+        FLASH_HOST_GetStats(&stats);
+        faults = stats.faults;
+        memset(buf, 0, sizeof(buf));
+        res = McuFlash_Read((void *)(uintptr_t)(erased + 8), buf, 100);
+        Check(res == ErasedReadResult(erased) && IsFilled(buf, 100, 0xff), "read of an erased page");
+        memset(buf, 0, sizeof(buf));
+        res = McuFlash_Read((void *)(uintptr_t)(erased - pageSize), buf, 2 * pageSize);
+        Check(res == ErasedReadResult(erased) && memcmp(buf, data + sizeof(data) - pageSize, pageSize) == 0
+                  && IsFilled(buf + pageSize, pageSize, 0xff),
+              "read of a programmed and an erased page");
+        res = McuFlash_Read((void *)(uintptr_t)erased, buf, pageSize);
+        FLASH_HOST_GetStats(&stats);
+#if McuFlash_CONFIG_READ_MODE == McuFlash_READ_MODE_MAPPED && McuFlash_CONFIG_ERASED_TRACKING
+        /* the first fault makes the page known as erased, the next reads don't touch it */
+        Check(stats.faults - faults == (pass == 0 ? 1U : 0U), "one fault per erased page");
+#else
+        (void)faults;
+#endif
+        Check(res == ErasedReadResult(erased) && IsFilled(buf, pageSize, 0xff), "second read of an erased page");
+        outside = McuFlash_CONFIG_TRACKED_BASE + McuFlash_CONFIG_TRACKED_SIZE;
+        if (outside >= geometry.base && outside + pageSize <= geometry.base + geometry.totalSize)
+        {
+            memset(buf, 0, sizeof(buf));
+            res = McuFlash_Read((void *)(uintptr_t)outside, buf, pageSize);
+            Check(res == ErasedReadResult(outside) && IsFilled(buf, pageSize, 0xff), "read of an erased page outside of the bitmap");
+        }
+    }
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        Measure("programmed", true, area, sizeof(data), sizes[s]);
+        Measure("programmed", false, area, sizeof(data), sizes[s]);
+    }
+    Measure("erased", true, erased, NOF_ERASED * pageSize, pageSize);
+    Measure("erased", false, erased, NOF_ERASED * pageSize, pageSize);
+    printf("%s\n", errors == 0 ? "ok" : "FAILED");
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,308 @@
+/*
+ * readers_stress.c
+ *
+ * Stress test of the concurrent littlefs readers (rdlock/rdunlock with LFS_THREADSAFE): one writer
+ * thread creates, appends to and removes files and updates attributes, while reader threads stat,
+ * list, read and get the attributes of files the writer never rewrites. Every reader checks what it
+ * gets; the run fails if any check fails. With 'exclusive' all threads use the write lock, to
+ * compare. With 'nomap' the readers read everything with McuFlash_Read() instead of in place. To
+ * look for data races, build with -O0 -fno-builtin -fsanitize=thread instead of -O2, so the structure
+ * copies stay memcpy() calls the sanitizer sees. With McuLittleFS_CONFIG_POOL=0 the test has a
+ * file system of its own, littlefs allocates its buffers and the readers with malloc(). With the pool
+ * it uses the one of McuLittleFS.c, with the static buffers of the readers. Every thread can have a
+ * file open, so the pool needs a cache per thread, and 'nomap' needs McuLittleFS_CONFIG_BLOCK_DEVICE_MAP=0:
+ *
+ *    gcc -O2 -g -include host/McuFlashHostConfig.h -Ihost -Isource -DMcuLittleFS_CONFIG_IMAGE_END=0 -DMcuLittleFS_CONFIG_POOL=0 -DLFS_THREADSAFE \
+ *        host/fsl_iap_host.c source/McuFlash.c source/McuLittleFSBlockDevice.c source/McuLittleFS.c \
+ *        source/lfs.c source/lfs_util.c host/readers_stress.c -o readers_stress -lpthread
+ *    ./readers_stress 4 5      # number of readers, seconds
+ *    ./readers_stress 4 5 exclusive
+ *    ./readers_stress 4 5 nomap
+ *
+ *    gcc -O2 -g -include host/McuFlashHostConfig.h -Ihost -Isource -DMcuLittleFS_CONFIG_IMAGE_END=0 -DMcuLittleFS_CONFIG_POOL_NOF_FILES=9 -DLFS_THREADSAFE \
+ *        host/fsl_iap_host.c source/McuFlash.c source/McuLittleFSBlockDevice.c source/McuLittleFS.c \
+ *        source/lfs.c source/lfs_util.c host/readers_stress.c -o readers_stress -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "fsl_iap_host.h"
+#include "lfs.h"
+#include "McuLittleFSBlockDevice.h"
+#include "McuLittleFS.h"
+#include "McuLib.h"
+
+#define NOF_FILES    (8)  /* files the readers check, d/s<n> */
+#define MAX_READERS  (8)
+
+static pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+static lfs_t fs;
+static lfs_t *lfs = &fs; /* the one of McuLittleFS.c with McuLittleFS_CONFIG_POOL */
+static bool stop; /* set by main, accessed with __atomic */
+static int errors;
+static unsigned long nofReads[MAX_READERS];
+
+static int Lock(const struct lfs_config *c)
+{
+    (void)c;
+    return pthread_rwlock_wrlock(&lock);
+}
+
+static int RdLock(const struct lfs_config *c)
+{
+    (void)c;
+    return pthread_rwlock_rdlock(&lock);
+}
+
+static int Unlock(const struct lfs_config *c)
+{
+    (void)c;
+    return pthread_rwlock_unlock(&lock);
+}
+
+static struct lfs_config cfg = {
+    .read = McuLittleFS_block_device_read,
+    .prog = McuLittleFS_block_device_prog,
+    .erase = McuLittleFS_block_device_erase,
+    .sync = McuLittleFS_block_device_sync,
+    .map = McuLittleFS_block_device_map,
+    .lock = Lock,
+    .unlock = Unlock,
+    .rdlock = RdLock,
+    .rdunlock = Unlock,
+    .read_size = 256,
+    .prog_size = 256,
+    .cache_size = 512,
+    .lookahead_size = 256,
+    .block_cycles = 500,
+    .block_size = 2048,
+    .block_count = 127,
+};
+
+static void Error(const char *what, const char *path, int value)
+{
+    __atomic_fetch_add(&errors, 1, __ATOMIC_RELAXED);
+    printf("%s %s: %d\n", what, path, value);
+}
+
+/* file content: a 4 byte version, then bytes (version+i), 100+version%1500 bytes in total */
+static int MakeContent(uint8_t *buf, uint32_t version)
+{
+    int len = 100 + version % 1500;
+
+    memcpy(buf, &version, 4);
+    for (int i = 4; i < len; i++)
+    {
+        buf[i] = (uint8_t)(version + i);
+    }
+    return len;
+}
+
+static bool CheckContent(const uint8_t *buf, int len)
+{
+    uint32_t version;
+
+    if (len < 4)
+    {
+        return false;
+    }
+    memcpy(&version, buf, 4);
+    if (len != (int)(100 + version % 1500))
+    {
+        return false;
+    }
+    for (int i = 4; i < len; i++)
+    {
+        if (buf[i] != (uint8_t)(version + i))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *Writer(void *arg)
+{
+    static uint8_t buf[2048];
+    unsigned int seed = 1;
+    uint32_t version = 1;
+    char path[32];
+    lfs_file_t file;
+
+    (void)arg;
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED))
+    {
+        int len = MakeContent(buf, version);
+
+        /* modify the directory of the checked files and the root */
+        sprintf(path, "%sx%d", (rand_r(&seed) % 2) ? "d/" : "", rand_r(&seed) % 20);
+        if (rand_r(&seed) % 2)
+        {
+            lfs_file_open(lfs, &file, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND);
+            lfs_file_write(lfs, &file, buf, len / 4);
+            lfs_file_close(lfs, &file);
+        }
+        else
+        {
+            lfs_remove(lfs, path);
+        }
+        sprintf(path, "d/s%d", rand_r(&seed) % NOF_FILES);
+        lfs_setattr(lfs, path, 'v', &version, sizeof(version));
+        version++;
+    }
+    return NULL;
+}
+
+static void *Reader(void *arg)
+{
+    static __thread uint8_t buf[2048];
+    int id = (int)(intptr_t)arg;
+    unsigned int seed = 100 + id;
+    char path[32];
+    struct lfs_info info;
+    lfs_file_t file;
+    lfs_dir_t dir;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED))
+    {
+        int n = 0, len = 0, res;
+        uint32_t version;
+
+        sprintf(path, "d/s%d", rand_r(&seed) % NOF_FILES);
+        switch (rand_r(&seed) % 4)
+        {
+            case 0:
+                res = lfs_stat(lfs, path, &info);
+                if (res != 0 || info.size < 100 || strcmp(info.name, path + 2) != 0)
+                {
+                    Error("stat", path, res);
+                }
+                break;
+            case 1:
+                lfs_dir_open(lfs, &dir, "d");
+                while (lfs_dir_read(lfs, &dir, &info) > 0)
+                {
+                    n += (info.name[0] == 's');
+                }
+                lfs_dir_close(lfs, &dir);
+                if (n != NOF_FILES)
+                {
+                    Error("dir read", "d", n);
+                }
+                break;
+            case 2:
+                res = lfs_file_open(lfs, &file, path, LFS_O_RDONLY);
+                if (res != 0)
+                {
+                    Error("open", path, res);
+                    break;
+                }
+                /* odd sized reads, to go through the caches */
+                while ((res = lfs_file_read(lfs, &file, buf + len, 37)) > 0)
+                {
+                    len += res;
+                }
+                lfs_file_close(lfs, &file);
+                if (!CheckContent(buf, len))
+                {
+                    Error("content", path, len);
+                }
+                break;
+            default:
+                res = lfs_getattr(lfs, path, 'v', &version, sizeof(version));
+                if (res != sizeof(version) && res != LFS_ERR_NOATTR)
+                {
+                    Error("getattr", path, res);
+                }
+                break;
+        }
+        nofReads[id]++;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t buf[2048];
+    int nofReaders = (argc > 1) ? atoi(argv[1]) : 4;
+    int seconds = (argc > 2) ? atoi(argv[2]) : 5;
+    unsigned long total = 0;
+    pthread_t threads[MAX_READERS + 1];
+    char path[32];
+    lfs_file_t file;
+
+    if (nofReaders < 1 || nofReaders > MAX_READERS)
+    {
+        printf("1 to %d readers\n", MAX_READERS);
+        return 1;
+    }
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "exclusive") == 0)
+        {
+            cfg.rdlock = NULL;
+            cfg.rdunlock = NULL;
+        }
+        else if (strcmp(argv[i], "nomap") == 0)
+        {
+            cfg.map = NULL; /* all reads go through McuFlash_Read() */
+        }
+    }
+#if McuLittleFS_CONFIG_POOL
+    if (cfg.map == NULL && McuLittleFS_CONFIG_BLOCK_DEVICE_MAP)
+    {
+        printf("nomap needs McuLittleFS_CONFIG_BLOCK_DEVICE_MAP=0\n");
+        return 1;
+    }
+    McuLFS_SetLocks(cfg.lock, cfg.unlock, cfg.rdlock, cfg.rdunlock);
+    if (McuLittleFS_block_device_init() != LFS_ERR_OK || McuLFS_Format() != ERR_OK || McuLFS_Mount() != ERR_OK)
+    {
+        printf("mount failed\n");
+        return 1;
+    }
+    lfs = McuLFS_GetFileSystem();
+#else
+    if (McuLittleFS_block_device_init() != LFS_ERR_OK || lfs_format(lfs, &cfg) != 0 || lfs_mount(lfs, &cfg) != 0)
+    {
+        printf("mount failed\n");
+        return 1;
+    }
+#endif
+    lfs_mkdir(lfs, "d");
+    for (int i = 0; i < NOF_FILES; i++)
+    {
+        int len = MakeContent(buf, i * 7);
+
+        sprintf(path, "d/s%d", i);
+        lfs_file_open(lfs, &file, path, LFS_O_WRONLY | LFS_O_CREAT);
+        lfs_file_write(lfs, &file, buf, len);
+        lfs_file_close(lfs, &file);
+    }
+
+    pthread_create(&threads[0], NULL, Writer, NULL);
+    for (int i = 0; i < nofReaders; i++)
+    {
+        pthread_create(&threads[i + 1], NULL, Reader, (void *)(intptr_t)i);
+    }
+    sleep(seconds);
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+    for (int i = 0; i <= nofReaders; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < nofReaders; i++)
+    {
+        total += nofReads[i];
+    }
+
+    printf("%s, %d readers%s: %lu reads in %d s, %d errors, rcache hits %u misses %u, dcache hits %u misses %u\n",
+           cfg.rdlock ? "shared lock" : "exclusive lock", nofReaders,
+           (cfg.rdlock && lfs->readers == NULL) ? " (no memory for them)" : "", total, seconds, errors,
+           (unsigned)lfs->rcache_hits, (unsigned)lfs->rcache_misses, (unsigned)lfs->dcache_hits,
+           (unsigned)lfs->dcache_misses);
+    lfs_unmount(lfs);
+    return (errors != 0) ? 1 : 0;
+}
@@ -10,107 +10,792 @@
 #include "fsl_iap.h"
 
 static flash_config_t s_flashDriver;
+static McuFlash_Geometry_t McuFlash_geometry;
 
+static McuFlash_VerifyPolicy_e McuFlash_verifyPolicy = McuFlash_CONFIG_VERIFY_POLICY;
+static uint32_t McuFlash_verifySampleRate = McuFlash_CONFIG_VERIFY_SAMPLE_RATE;
+static bool McuFlash_verifySampleRandom = McuFlash_CONFIG_VERIFY_SAMPLE_RANDOM;
+static uint32_t McuFlash_verifySampleCnt; /* pages programmed in sampled mode, or state of the random generator */
+static McuFlash_VerifyStats_t McuFlash_verifyStats[McuFlash_Verify_NofPolicies];
+
+#if McuFlash_CONFIG_STATS
+static McuFlash_Stats_t McuFlash_stats;
+
+/* book keeping of a flash driver call which started at cycle counter value 'start' */
+static void McuFlash_CountOp(McuFlash_Op_e op, uint32_t start, size_t nofBytes, status_t status) {
+	McuFlash_OpStats_t *stats = &McuFlash_stats.ops[op];
+	uint32_t cycles, bucket, val;
+
+	cycles = McuFlash_CONFIG_CYCLE_COUNTER()-start;
+	stats->calls++;
+	stats->bytes += nofBytes;
+	stats->cycles += cycles;
+	if (cycles>stats->maxCycles) {
+		stats->maxCycles = cycles;
+	}
+	if (status!=kStatus_Success) {
+		stats->errors++;
+	}
+	bucket = 0;
+	val = cycles>>(McuFlash_CONFIG_STATS_BUCKET_SHIFT+1);
+	while (val!=0 && bucket<McuFlash_CONFIG_STATS_NOF_BUCKETS-1) {
+		val >>= 1;
+		bucket++;
+	}
+	stats->histogram[bucket]++;
+}
+  #define McuFlash_STATS_START()                             uint32_t statsStart = McuFlash_CONFIG_CYCLE_COUNTER()
+  #define McuFlash_STATS_COUNT(op, nofBytes, status)         McuFlash_CountOp((op), statsStart, (nofBytes), (status))
+  #define McuFlash_STATS_INC(counter, val)                   (McuFlash_stats.counter += (val))
+#else
+  #define McuFlash_STATS_START()                             do { } while (0)
+  #define McuFlash_STATS_COUNT(op, nofBytes, status)         do { } while (0)
+  #define McuFlash_STATS_INC(counter, val)                   do { } while (0)
+#endif
+
+/* flash driver calls, counted with McuFlash_CONFIG_STATS */
+static status_t McuFlash_DrvErase(uint32_t start, uint32_t nofBytes) {
+	status_t status;
+	McuFlash_STATS_START();
+
+	status = FLASH_Erase(&s_flashDriver, start, nofBytes, kFLASH_ApiEraseKey);
+	McuFlash_STATS_COUNT(McuFlash_Op_Erase, nofBytes, status);
+	return status;
+}
+
+static status_t McuFlash_DrvProgram(uint32_t start, const void *src, uint32_t nofBytes) {
+	status_t status;
+	McuFlash_STATS_START();
+
+	status = FLASH_Program(&s_flashDriver, start, (uint8_t*)src, nofBytes);
+	McuFlash_STATS_COUNT(McuFlash_Op_Program, nofBytes, status);
+	return status;
+}
+
+static status_t McuFlash_DrvRead(uint32_t start, void *dest, uint32_t nofBytes) {
+	status_t status;
+	McuFlash_STATS_START();
+
+	status = FLASH_Read(&s_flashDriver, start, dest, nofBytes);
+	McuFlash_STATS_COUNT(McuFlash_Op_Read, nofBytes, status);
+	return status;
+}
+
+static status_t McuFlash_DrvVerifyErase(uint32_t start, uint32_t nofBytes) {
+	status_t status;
+	McuFlash_STATS_START();
+
+	status = FLASH_VerifyErase(&s_flashDriver, start, nofBytes);
+	McuFlash_STATS_COUNT(McuFlash_Op_VerifyErase, nofBytes, status);
+	return status;
+}
+
+static status_t McuFlash_DrvVerifyProgram(uint32_t start, const void *expected, uint32_t nofBytes) {
+	uint32_t failedAddress, failedData;
+	status_t status;
+	McuFlash_STATS_START();
+
+	status = FLASH_VerifyProgram(&s_flashDriver, start, nofBytes, (const uint8_t *)expected, &failedAddress, &failedData);
+	McuFlash_STATS_COUNT(McuFlash_Op_VerifyProgram, nofBytes, status);
+	return status;
+}
+
+#define McuFlash_PAGE_ADDR(addr)   (((uint32_t)(addr)/McuFlash_CONFIG_FLASH_BLOCK_SIZE)*McuFlash_CONFIG_FLASH_BLOCK_SIZE)
+
+#if McuFlash_CONFIG_ERASED_TRACKING
+#define McuFlash_TRACKED_NOF_PAGES (McuFlash_CONFIG_TRACKED_SIZE/McuFlash_CONFIG_FLASH_BLOCK_SIZE)
+
+typedef enum {
+	McuFlash_PageState_Unknown,
+	McuFlash_PageState_Erased,
+	McuFlash_PageState_Programmed,
+} McuFlash_PageState_e;
+
+/* Erased page bitmap: cleared in McuFlash_Init(), the state of a page is learned on the first access
+ * (one FLASH_VerifyErase()) and afterwards maintained by erase and program. */
+static uint32_t McuFlash_pageKnown[(McuFlash_TRACKED_NOF_PAGES+31)/32]; /* bit set: state of the page is known */
+static uint32_t McuFlash_pageErased[(McuFlash_TRACKED_NOF_PAGES+31)/32]; /* bit set: page is erased, only valid if known */
+
+static bool McuFlash_IsTracked(uint32_t addr) {
+	return (addr-McuFlash_CONFIG_TRACKED_BASE)<McuFlash_CONFIG_TRACKED_SIZE; /* wraps around below the base */
+}
+
+static void McuFlash_SetPageState(uint32_t pageAddr, McuFlash_PageState_e state) {
+	uint32_t page, mask;
+
+	if (!McuFlash_IsTracked(pageAddr)) {
+		return;
+	}
+	page = (pageAddr-McuFlash_CONFIG_TRACKED_BASE)/McuFlash_CONFIG_FLASH_BLOCK_SIZE;
+	mask = 1u<<(page%32);
+	if (state==McuFlash_PageState_Unknown) {
+		McuFlash_pageKnown[page/32] &= ~mask;
+		return;
+	}
+	McuFlash_pageKnown[page/32] |= mask;
+	if (state==McuFlash_PageState_Erased) {
+		McuFlash_pageErased[page/32] |= mask;
+	} else {
+		McuFlash_pageErased[page/32] &= ~mask;
+	}
+}
+
+/* returns the state as recorded in the bitmap, without asking the flash controller */
+static McuFlash_PageState_e McuFlash_GetPageState(uint32_t pageAddr) {
+	uint32_t page, mask;
+
+	if (!McuFlash_IsTracked(pageAddr)) {
+		return McuFlash_PageState_Unknown;
+	}
+	page = (pageAddr-McuFlash_CONFIG_TRACKED_BASE)/McuFlash_CONFIG_FLASH_BLOCK_SIZE;
+	mask = 1u<<(page%32);
+	if ((McuFlash_pageKnown[page/32]&mask)==0) {
+		return McuFlash_PageState_Unknown;
+	}
+	return (McuFlash_pageErased[page/32]&mask)!=0 ? McuFlash_PageState_Erased : McuFlash_PageState_Programmed;
+}
+
+static bool McuFlash_PageIsErased(uint32_t pageAddr) {
+	McuFlash_PageState_e state;
+	bool erased;
+
+	state = McuFlash_GetPageState(pageAddr);
+	if (state==McuFlash_PageState_Unknown) { /* first access (or not tracked): ask the flash controller */
+		erased = McuFlash_DrvVerifyErase(pageAddr, McuFlash_CONFIG_FLASH_BLOCK_SIZE)==kStatus_Success;
+		McuFlash_SetPageState(pageAddr, erased?McuFlash_PageState_Erased:McuFlash_PageState_Programmed);
+		return erased;
+	}
+	return state==McuFlash_PageState_Erased;
+}
+#endif /* McuFlash_CONFIG_ERASED_TRACKING */
+
+#if McuFlash_CONFIG_WRITE_BUFFER
+#define McuFlash_WRITE_BUFFER_CHUNK  (McuFlash_CONFIG_FLASH_BLOCK_SIZE/32) /* granularity of the 'written' mask */
+
+/* Write-back buffer for one page: partial programs to the same page get merged here and the page
+ * is programmed once, when it is completely written, when another page gets written, or with McuFlash_Flush(). */
+static struct {
+	uint32_t addr;    /* address of the buffered page */
+	uint32_t written; /* bit set for each McuFlash_WRITE_BUFFER_CHUNK fully written since the page got buffered */
+	bool valid;       /* true if data[] holds a page which has not been programmed yet */
+	bool readBack;    /* McuFlash_Read() has returned data of the page from the buffer and not from the flash */
+	uint8_t data[McuFlash_CONFIG_FLASH_BLOCK_SIZE];
+} McuFlash_writeBuf;
+
+/* Pages of the write buffer which failed to program: reads get their data from here until the page is erased or
+ * programmed, as LittleFS reads the data of a bad block while it relocates it. */
+typedef struct {
+	uint32_t addr;    /* address of the page */
+	uint32_t seqNo;   /* order of the failures */
+	bool valid;       /* true if data[] holds a failed page */
+	bool reported;    /* McuFlash_Flush() has returned the failure. If not, a write to another page made room for
+	                     the page and reads of it fail, so the failure is seen for the data it belongs to */
+	uint8_t data[McuFlash_CONFIG_FLASH_BLOCK_SIZE];
+} McuFlash_FailedPage_t;
+
+static McuFlash_FailedPage_t McuFlash_failedPages[McuFlash_CONFIG_NOF_FAILED_PAGES];
+static uint32_t McuFlash_failedSeqNo;
+
+/* true if the page at pageAddr is in the area */
+static bool McuFlash_PageInArea(uint32_t pageAddr, uint32_t addr, size_t nofBytes) {
+	return pageAddr<addr+nofBytes && pageAddr+McuFlash_CONFIG_FLASH_BLOCK_SIZE>addr;
+}
+
+static McuFlash_FailedPage_t *McuFlash_FindFailedPage(uint32_t pageAddr) {
+	for(int i=0; i<McuFlash_CONFIG_NOF_FAILED_PAGES; i++) {
+		if (McuFlash_failedPages[i].valid && McuFlash_failedPages[i].addr==pageAddr) {
+			return &McuFlash_failedPages[i];
+		}
+	}
+	return NULL;
+}
+
+/* keeps a failed page: replaces the same page, a free entry or the oldest one. The page LittleFS relocates the data of
+ * a bad block from stays while the new block fails McuFlash_CONFIG_NOF_FAILED_PAGES-1 times */
+static McuFlash_FailedPage_t *McuFlash_KeepFailedPage(uint32_t pageAddr, const uint8_t *data) {
+	McuFlash_FailedPage_t *page, *victim = NULL;
+
+	page = McuFlash_FindFailedPage(pageAddr);
+	for(int i=0; page==NULL && i<McuFlash_CONFIG_NOF_FAILED_PAGES; i++) {
+		McuFlash_FailedPage_t *p = &McuFlash_failedPages[i];
+
+		if (!p->valid) {
+			page = p;
+		} else if (victim==NULL || p->seqNo-victim->seqNo>0x80000000u) {
+			victim = p; /* older, seqNo may wrap */
+		}
+	}
+	if (page==NULL) {
+		page = victim;
+	}
+	memcpy(page->data, data, sizeof(page->data));
+	page->addr = pageAddr;
+	page->seqNo = McuFlash_failedSeqNo++;
+	page->reported = true;
+	page->valid = true;
+	return page;
+}
+
+/* drops the failed pages inside the given area, after they have been programmed or erased */
+static void McuFlash_DropFailedPages(uint32_t addr, size_t nofBytes) {
+	for(int i=0; i<McuFlash_CONFIG_NOF_FAILED_PAGES; i++) {
+		if (McuFlash_failedPages[i].valid && McuFlash_PageInArea(McuFlash_failedPages[i].addr, addr, nofBytes)) {
+			McuFlash_failedPages[i].valid = false;
+		}
+	}
+}
+
+/* true if a page of the area is held in RAM, pending in the write buffer or failed */
+static bool McuFlash_InRam(uint32_t addr, size_t nofBytes) {
+	if (McuFlash_writeBuf.valid && McuFlash_PageInArea(McuFlash_writeBuf.addr, addr, nofBytes)) {
+		return true;
+	}
+	for(int i=0; i<McuFlash_CONFIG_NOF_FAILED_PAGES; i++) {
+		if (McuFlash_failedPages[i].valid && McuFlash_PageInArea(McuFlash_failedPages[i].addr, addr, nofBytes)) {
+			return true;
+		}
+	}
+	return false;
+}
+#endif
 
 bool McuFlash_IsAccessible(const void *addr, size_t nofBytes) {
+#if McuFlash_CONFIG_ERASED_TRACKING
+	for(uint32_t pageAddr=McuFlash_PAGE_ADDR(addr); pageAddr<(uint32_t)addr+nofBytes; pageAddr+=McuFlash_CONFIG_FLASH_BLOCK_SIZE) {
+		if (McuFlash_PageIsErased(pageAddr)) {
+			return false; /* if it is an erased FLASH: accessing it will cause a hard fault! */
+		}
+	}
+	return true;
+#else
 	status_t status;
-	status = FLASH_VerifyErase(&s_flashDriver, (uint32_t)addr, nofBytes);
+	status = McuFlash_DrvVerifyErase((uint32_t)addr, nofBytes);
 	if (status==kStatus_Success) {
 		return false; /* if it is an erased FLASH: accessing it will cause a hard fault! */
 	}
 	return true;
+#endif
 }
 
-bool McuFlash_IsErased(const void *addr, size_t nofBytes) {
+/* like McuFlash_IsErased(), for the flash itself without the write buffer */
+static bool McuFlash_FlashIsErased(const void *addr, size_t nofBytes) {
+#if McuFlash_CONFIG_ERASED_TRACKING
+	for(uint32_t pageAddr=McuFlash_PAGE_ADDR(addr); pageAddr<(uint32_t)addr+nofBytes; pageAddr+=McuFlash_CONFIG_FLASH_BLOCK_SIZE) {
+		if (!McuFlash_PageIsErased(pageAddr)) {
+			return false;
+		}
+	}
+	return true;
+#else
 	status_t status;
-	status = FLASH_VerifyErase(&s_flashDriver, (uint32_t)addr, nofBytes);
+	status = McuFlash_DrvVerifyErase((uint32_t)addr, nofBytes);
 	return status==kStatus_Success;  /* true if it is an erased FLASH: accessing it will cause a hard fault! */
+#endif
+}
+
+bool McuFlash_IsErased(const void *addr, size_t nofBytes) {
+	bool erased;
 
+	McuFlash_CONFIG_READ_LOCK();
+#if McuFlash_CONFIG_WRITE_BUFFER
+	if (McuFlash_InRam((uint32_t)addr, nofBytes)) {
+		erased = false; /* a page with pending data */
+	} else
+#endif
+	{
+		erased = McuFlash_FlashIsErased(addr, nofBytes);
+	}
+	McuFlash_CONFIG_READ_UNLOCK();
+	return erased;
 }
 
-uint8_t McuFlash_Read(const void *addr, void *data, size_t dataSize) {
+#if McuFlash_CONFIG_READ_MODE==McuFlash_READ_MODE_MAPPED
+/* memory mapped read, counted with McuFlash_CONFIG_STATS */
+static int McuFlash_MappedRead(void *dst, uint32_t addr, size_t size) {
+	int res;
+	McuFlash_STATS_START();
+
+	res = McuFlash_CONFIG_MAPPED_READ(dst, addr, size);
+	McuFlash_STATS_COUNT(McuFlash_Op_MappedRead, size, res==0?kStatus_Success:kStatus_Fail);
+	return res;
+}
+
+/* Copies straight from the memory mapped flash, page by page. Reading an erased page faults:
+ * the fault hook aborts the copy, the page gets filled with 0xFF and is known as erased from then on. */
+static uint8_t McuFlash_ReadMapped(uint32_t addr, uint8_t *dst, size_t dataSize) {
+	uint8_t res = ERR_OK;
+	size_t size;
+
+	while (dataSize>0) {
+		size = McuFlash_PAGE_ADDR(addr)+McuFlash_CONFIG_FLASH_BLOCK_SIZE-addr; /* up to the end of the page */
+		if (size>dataSize) {
+			size = dataSize;
+		}
+#if McuFlash_CONFIG_ERASED_TRACKING
+		if (McuFlash_GetPageState(McuFlash_PAGE_ADDR(addr))==McuFlash_PageState_Erased) {
+			memset(dst, 0xff, size); /* known to be erased: don't touch it */
+		} else
+#endif
+		if (McuFlash_MappedRead(dst, addr, size)!=0) {
+			memset(dst, 0xff, size);
+#if McuFlash_CONFIG_ERASED_TRACKING
+			McuFlash_SetPageState(McuFlash_PAGE_ADDR(addr), McuFlash_PageState_Erased);
+			if (!McuFlash_IsTracked(addr)) {
+				res = ERR_FAULT;
+			}
+#else
+			res = ERR_FAULT;
+#endif
+		}
+#if McuFlash_CONFIG_ERASED_TRACKING
+		else {
+			McuFlash_SetPageState(McuFlash_PAGE_ADDR(addr), McuFlash_PageState_Programmed);
+		}
+#endif
+		addr += size;
+		dst += size;
+		dataSize -= size;
+	}
+	return res;
+}
+#endif
+
+static uint8_t McuFlash_ReadFlash(const void *addr, void *data, size_t dataSize) {
+#if McuFlash_CONFIG_READ_MODE==McuFlash_READ_MODE_MAPPED
+	return McuFlash_ReadMapped((uint32_t)addr, data, dataSize);
+#elif McuFlash_CONFIG_ERASED_TRACKING
+	/* erased pages are not touched and read as 0xFF, runs of programmed pages are read with one ROM call */
+	uint32_t start = (uint32_t)addr, end = (uint32_t)addr+dataSize, runStart;
+	uint8_t *dst = data;
+	uint8_t res = ERR_OK;
+	bool erased;
+
+	while (start<end) {
+		runStart = start;
+		erased = McuFlash_PageIsErased(McuFlash_PAGE_ADDR(start));
+		do {
+			start = McuFlash_PAGE_ADDR(start)+McuFlash_CONFIG_FLASH_BLOCK_SIZE;
+		} while (start<end && McuFlash_PageIsErased(start)==erased);
+		if (start>end) {
+			start = end;
+		}
+		if (erased) {
+			memset(dst, 0xff, start-runStart);
+			if (!McuFlash_IsTracked(runStart)) {
+				res = ERR_FAULT; /* outside of the bitmap: report it as before */
+			}
+		} else if (McuFlash_DrvRead(runStart, dst, start-runStart)!=kStatus_Success) {
+			return ERR_FAULT;
+		}
+		dst += start-runStart;
+	}
+	return res;
+#else
 	if (!McuFlash_IsAccessible(addr, dataSize)) {
 		memset(data, 0xff, dataSize);
 		return ERR_FAULT;
 	}
 
 	status_t status;
-	status = FLASH_Read(&s_flashDriver, (uint32_t)addr, data, (uint32_t)dataSize);
-	if(status != kStatus_Success){
-		return ERR_FAULT;
+	status = McuFlash_DrvRead((uint32_t)addr, data, (uint32_t)dataSize);
+	if(status == kStatus_Success){
+		return ERR_OK;
+	}
+	/* some pages are erased: read page by page, the erased ones as 0xFF, like McuFlash_ReadMapped() */
+	uint32_t start = (uint32_t)addr, end = (uint32_t)addr+dataSize, pageEnd;
+	uint8_t *dst = data;
+	uint8_t res = ERR_OK;
+
+	while (start<end) {
+		pageEnd = McuFlash_PAGE_ADDR(start)+McuFlash_CONFIG_FLASH_BLOCK_SIZE;
+		if (pageEnd>end) {
+			pageEnd = end;
+		}
+		if (!McuFlash_IsAccessible((void*)McuFlash_PAGE_ADDR(start), McuFlash_CONFIG_FLASH_BLOCK_SIZE)) {
+			memset(dst, 0xff, pageEnd-start);
+			res = ERR_FAULT;
+		} else if (McuFlash_DrvRead(start, dst, pageEnd-start)!=kStatus_Success) {
+			return ERR_FAULT;
+		}
+		dst += pageEnd-start;
+		start = pageEnd;
+	}
+	return res;
+#endif
+}
+
+/* McuFlash_Map(), with McuFlash_CONFIG_READ_LOCK() taken */
+static const void *McuFlash_MapPages(const void *addr, size_t nofBytes) {
+#if McuFlash_CONFIG_ERASED_TRACKING
+	if (nofBytes==0 || !McuFlash_IsTracked((uint32_t)addr) || !McuFlash_IsTracked((uint32_t)addr+nofBytes-1)) {
+		return NULL;
+	}
+#if McuFlash_CONFIG_WRITE_BUFFER
+	if (McuFlash_InRam((uint32_t)addr, nofBytes)) {
+		return NULL; /* newer data is in the buffer */
+	}
+#endif
+	for(uint32_t pageAddr=McuFlash_PAGE_ADDR(addr); pageAddr<(uint32_t)addr+nofBytes; pageAddr+=McuFlash_CONFIG_FLASH_BLOCK_SIZE) {
+		if (McuFlash_PageIsErased(pageAddr)) {
+			return NULL; /* would fault */
+		}
+	}
+	return McuFlash_CONFIG_MAP_ADDRESS(addr, nofBytes);
+#else
+	(void)addr; (void)nofBytes;
+	return NULL; /* without the bitmap every access would need a FLASH_VerifyErase() first */
+#endif
+}
+
+const void *McuFlash_Map(const void *addr, size_t nofBytes) {
+	const void *p;
+
+	McuFlash_CONFIG_READ_LOCK();
+	p = McuFlash_MapPages(addr, nofBytes);
+	McuFlash_CONFIG_READ_UNLOCK();
+	return p;
+}
+
+/* McuFlash_Read(), with McuFlash_CONFIG_READ_LOCK() taken */
+static uint8_t McuFlash_ReadBuffered(const void *addr, void *data, size_t dataSize) {
+	McuFlash_STATS_INC(nofReads, 1);
+	McuFlash_STATS_INC(readBytes, dataSize);
+#if McuFlash_CONFIG_WRITE_BUFFER
+	uint32_t start = (uint32_t)addr, end = (uint32_t)addr+dataSize, runStart, pageEnd;
+	uint8_t *dst = data;
+	uint8_t res = ERR_OK, res2;
+	const uint8_t *page;
+	McuFlash_FailedPage_t *failed;
+
+	if (!McuFlash_InRam(start, dataSize)) {
+		return McuFlash_ReadFlash(addr, data, dataSize);
+	}
+	/* pages in RAM come from there, the runs between them from the flash */
+	runStart = start;
+	while (start<end) {
+		pageEnd = McuFlash_PAGE_ADDR(start)+McuFlash_CONFIG_FLASH_BLOCK_SIZE;
+		if (pageEnd>end) {
+			pageEnd = end;
+		}
+		page = NULL;
+		if (McuFlash_writeBuf.valid && McuFlash_writeBuf.addr==McuFlash_PAGE_ADDR(start)) {
+			page = McuFlash_writeBuf.data;
+			McuFlash_writeBuf.readBack = true;
+		} else if ((failed=McuFlash_FindFailedPage(McuFlash_PAGE_ADDR(start)))!=NULL) {
+			page = failed->data;
+			if (!failed->reported) {
+				res = ERR_FAILED; /* the flash does not hold what has been written */
+			}
+		}
+		if (page!=NULL) {
+			if (runStart<start) {
+				res2 = McuFlash_ReadFlash((void*)runStart, dst+(runStart-(uint32_t)addr), start-runStart);
+				res = res!=ERR_OK ? res : res2;
+			}
+			memcpy(dst+(start-(uint32_t)addr), page+(start-McuFlash_PAGE_ADDR(start)), pageEnd-start);
+			runStart = pageEnd;
+		}
+		start = pageEnd;
+	}
+	if (runStart<end) {
+		res2 = McuFlash_ReadFlash((void*)runStart, dst+(runStart-(uint32_t)addr), end-runStart);
+		res = res!=ERR_OK ? res : res2;
+	}
+	return res;
+#else
+	return McuFlash_ReadFlash(addr, data, dataSize);
+#endif
+}
+
+uint8_t McuFlash_Read(const void *addr, void *data, size_t dataSize) {
+	uint8_t res;
+
+	McuFlash_CONFIG_READ_LOCK();
+	res = McuFlash_ReadBuffered(addr, data, dataSize);
+	McuFlash_CONFIG_READ_UNLOCK();
+	return res;
+}
+
+void McuFlash_SetVerifyPolicy(McuFlash_VerifyPolicy_e policy, uint32_t sampleRate, bool random) {
+	if (policy>=McuFlash_Verify_NofPolicies) {
+		return;
+	}
+	McuFlash_verifyPolicy = policy;
+	McuFlash_verifySampleRate = sampleRate;
+	McuFlash_verifySampleRandom = random;
+	McuFlash_verifySampleCnt = 0;
+}
+
+McuFlash_VerifyPolicy_e McuFlash_GetVerifyPolicy(void) {
+	return McuFlash_verifyPolicy;
+}
+
+void McuFlash_GetVerifyStats(McuFlash_VerifyPolicy_e policy, McuFlash_VerifyStats_t *stats) {
+	if (policy>=McuFlash_Verify_NofPolicies) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	*stats = McuFlash_verifyStats[policy];
+}
+
+void McuFlash_ResetVerifyStats(void) {
+	memset(McuFlash_verifyStats, 0, sizeof(McuFlash_verifyStats));
+}
+
+/* decides with the current policy if the page gets verified. 'readBack' is true if the data of the page
+ * has been read from the write buffer and not from the flash */
+static bool McuFlash_NeedsVerify(bool readBack) {
+	switch(McuFlash_verifyPolicy) {
+		case McuFlash_Verify_LittleFS: /* LittleFS reads back what it has programmed, for a pending page that came from the buffer */
+			return readBack;
+		case McuFlash_Verify_Sampled:
+			if (McuFlash_verifySampleRate<=1) {
+				return true;
+			}
+			if (McuFlash_verifySampleRandom) { /* xorshift32, cheap and good enough for sampling */
+				if (McuFlash_verifySampleCnt==0) {
+					McuFlash_verifySampleCnt = 0x9e3779b9u;
+				}
+				McuFlash_verifySampleCnt ^= McuFlash_verifySampleCnt<<13;
+				McuFlash_verifySampleCnt ^= McuFlash_verifySampleCnt>>17;
+				McuFlash_verifySampleCnt ^= McuFlash_verifySampleCnt<<5;
+				return (McuFlash_verifySampleCnt%McuFlash_verifySampleRate)==0;
+			}
+			return (McuFlash_verifySampleCnt++%McuFlash_verifySampleRate)==0;
+		case McuFlash_Verify_TrustROM:
+			return false;
+		case McuFlash_Verify_Full:
+		default:
+			return true;
+	}
+}
+
+/* book keeping of a verify call which started at cycle counter value 'start' */
+static void McuFlash_CountVerify(uint32_t start, status_t status) {
+	McuFlash_VerifyStats_t *stats = &McuFlash_verifyStats[McuFlash_verifyPolicy];
+
+	stats->cycles += (uint32_t)(McuFlash_CONFIG_CYCLE_COUNTER()-start);
+	stats->nofVerifies++;
+	if (status!=kStatus_Success) {
+		stats->nofFailed++;
 	}
-	return ERR_OK;
 }
 
-static uint8_t McuFlash_ProgramPage(void *addr, const void *data, size_t dataSize) {
+/* erases (if needed), programs and verifies one or more consecutive full pages with a single call for each step.
+ * 'readBack' is true for a page from the write buffer which has been read while it was pending */
+static uint8_t McuFlash_ProgramPages(void *addr, const void *data, size_t dataSize, bool readBack) {
 	status_t status;
-	uint32_t failedAddress, failedData;
+	uint32_t start;
+	bool verify;
 	if (((uint32_t)addr%s_flashDriver.PFlashPageSize) != 0) {
 		return ERR_FAILED;
 	}
-	if (dataSize!=s_flashDriver.PFlashPageSize) { /* must match flash page size! */
+	if (dataSize==0 || (dataSize%s_flashDriver.PFlashPageSize)!=0) { /* must be a multiple of the flash page size! */
 		return ERR_FAILED;
 	}
-	/* erase first */
-	status = FLASH_Erase(&s_flashDriver, (uint32_t)addr, dataSize, kFLASH_ApiEraseKey);
-	if (status!=kStatus_Success ) {
-		return ERR_FAILED;
+	verify = McuFlash_NeedsVerify(readBack);
+	if (!verify) {
+		McuFlash_verifyStats[McuFlash_verifyPolicy].nofSkipped++;
 	}
-	/* check if it is erased */
-	status = FLASH_VerifyErase(&s_flashDriver, (uint32_t)addr, dataSize);
-	if (status!=kStatus_Success) {
-		return ERR_FAILED;
+#if McuFlash_CONFIG_ERASED_TRACKING
+	if (!McuFlash_FlashIsErased(addr, dataSize)) /* pages known to be erased can be programmed right away, the buffered page is one of them */
+#endif
+	{
+		/* erase first */
+#if McuFlash_CONFIG_ERASED_TRACKING
+		for(uint32_t pageAddr=(uint32_t)addr; pageAddr<(uint32_t)addr+dataSize; pageAddr+=McuFlash_CONFIG_FLASH_BLOCK_SIZE) {
+			McuFlash_SetPageState(pageAddr, McuFlash_PageState_Unknown);
+		}
+#endif
+		status = McuFlash_DrvErase((uint32_t)addr, dataSize);
+		if (status!=kStatus_Success ) {
+			return ERR_FAILED;
+		}
+		if (verify) {
+			/* check if it is erased */
+			start = McuFlash_CONFIG_CYCLE_COUNTER();
+			status = McuFlash_DrvVerifyErase((uint32_t)addr, dataSize);
+			McuFlash_CountVerify(start, status);
+			if (status!=kStatus_Success) {
+				return ERR_FAILED;
+			}
+		}
+	}
+#if McuFlash_CONFIG_ERASED_TRACKING
+	for(uint32_t pageAddr=(uint32_t)addr; pageAddr<(uint32_t)addr+dataSize; pageAddr+=McuFlash_CONFIG_FLASH_BLOCK_SIZE) {
+		McuFlash_SetPageState(pageAddr, McuFlash_PageState_Unknown); /* until the program is verified */
 	}
-	status = FLASH_Program(&s_flashDriver, (uint32_t)addr, (uint8_t*)data, dataSize);
+#endif
+	status = McuFlash_DrvProgram((uint32_t)addr, data, dataSize);
 	if (status!=kStatus_Success) {
 		return ERR_FAILED;
 	}
-	status = FLASH_VerifyProgram(&s_flashDriver, (uint32_t)addr, dataSize, (const uint8_t *)data, &failedAddress, &failedData);
-	if (status!=kStatus_Success) {
+	if (verify) {
+		start = McuFlash_CONFIG_CYCLE_COUNTER();
+		status = McuFlash_DrvVerifyProgram((uint32_t)addr, data, dataSize);
+		McuFlash_CountVerify(start, status);
+		if (status!=kStatus_Success) {
+			return ERR_FAILED;
+		}
+	}
+#if McuFlash_CONFIG_ERASED_TRACKING
+	for(uint32_t pageAddr=(uint32_t)addr; pageAddr<(uint32_t)addr+dataSize; pageAddr+=McuFlash_CONFIG_FLASH_BLOCK_SIZE) {
+		McuFlash_SetPageState(pageAddr, McuFlash_PageState_Programmed);
+	}
+#endif
+#if McuFlash_CONFIG_WRITE_BUFFER
+	McuFlash_DropFailedPages((uint32_t)addr, dataSize); /* programmed now */
+#endif
+	return ERR_OK;
+}
+
+uint8_t McuFlash_Flush(void) {
+#if McuFlash_CONFIG_WRITE_BUFFER
+	if (!McuFlash_writeBuf.valid) {
+		return ERR_OK; /* nothing pending */
+	}
+	if (McuFlash_ProgramPages((void*)McuFlash_writeBuf.addr, McuFlash_writeBuf.data, sizeof(McuFlash_writeBuf.data), McuFlash_writeBuf.readBack)!=ERR_OK) {
+		/* keep the data for reads, the caller moves on (LittleFS relocates the data of a bad block) */
+		(void)McuFlash_KeepFailedPage(McuFlash_writeBuf.addr, McuFlash_writeBuf.data);
+		McuFlash_writeBuf.valid = false;
 		return ERR_FAILED;
 	}
+	McuFlash_writeBuf.valid = false;
+	return ERR_OK;
+#else
+	return ERR_OK; /* nothing buffered */
+#endif
+}
+
+#if McuFlash_CONFIG_WRITE_BUFFER
+/* drops the buffered and the failed pages inside the given area, used if the area gets erased or overwritten anyway */
+static void McuFlash_DiscardBuffer(uint32_t addr, size_t nofBytes) {
+	if (McuFlash_writeBuf.valid && McuFlash_writeBuf.addr>=addr && McuFlash_writeBuf.addr<addr+nofBytes) {
+		McuFlash_writeBuf.valid = false;
+	}
+	McuFlash_DropFailedPages(addr, nofBytes);
+}
+
+static uint8_t McuFlash_BufferWrite(uint32_t pageAddr, size_t offset, const void *data, size_t size) {
+	McuFlash_FailedPage_t *failed;
+	uint32_t first, last, prevAddr;
+	uint8_t res;
+
+	if (!McuFlash_writeBuf.valid || McuFlash_writeBuf.addr!=pageAddr) {
+		/* another page: program the pending one, then start with the current content of the new page. A failure of the
+		 * pending page is not one of this write: reads of that page report it, so it is seen for the data it belongs to */
+		prevAddr = McuFlash_writeBuf.addr;
+		if (McuFlash_Flush()!=ERR_OK) {
+			McuFlash_FindFailedPage(prevAddr)->reported = false;
+		}
+		failed = McuFlash_FindFailedPage(pageAddr);
+		if (failed!=NULL) {
+			memcpy(McuFlash_writeBuf.data, failed->data, sizeof(McuFlash_writeBuf.data)); /* written again */
+		} else {
+			res = McuFlash_ReadFlash((void*)pageAddr, McuFlash_writeBuf.data, sizeof(McuFlash_writeBuf.data));
+			if (res!=ERR_OK) {
+				return ERR_FAILED;
+			}
+		}
+		McuFlash_STATS_INC(nofReadModifyWrites, 1);
+		McuFlash_writeBuf.addr = pageAddr;
+		McuFlash_writeBuf.written = 0;
+		McuFlash_writeBuf.readBack = false;
+		McuFlash_writeBuf.valid = true;
+	}
+	memcpy(McuFlash_writeBuf.data+offset, data, size);
+	/* mark the chunks which are completely covered by this write */
+	first = (offset+McuFlash_WRITE_BUFFER_CHUNK-1)/McuFlash_WRITE_BUFFER_CHUNK;
+	last = (offset+size)/McuFlash_WRITE_BUFFER_CHUNK;
+	for(uint32_t i=first; i<last; i++) {
+		McuFlash_writeBuf.written |= 1u<<i;
+	}
+	if (McuFlash_writeBuf.written==0xffffffffu) { /* page is full: program it */
+		return McuFlash_Flush();
+	}
 	return ERR_OK;
 }
+#endif
 
 uint8_t McuFlash_Program(void *addr, const void *data, size_t dataSize) {
-	if (((uint32_t)addr%McuFlash_CONFIG_FLASH_BLOCK_SIZE) != 0 || (dataSize!=McuFlash_CONFIG_FLASH_BLOCK_SIZE)) {
-		/* address and size not aligned to page boundaries: make backup into buffer */
-		uint8_t buffer[McuFlash_CONFIG_FLASH_BLOCK_SIZE];
-		uint8_t res;
-		size_t offset, remaining, size;
-		uint32_t pageAddr; /* address of page */
-
-		pageAddr = ((uint32_t)addr/McuFlash_CONFIG_FLASH_BLOCK_SIZE)*McuFlash_CONFIG_FLASH_BLOCK_SIZE;
-		offset = (uint32_t)addr%McuFlash_CONFIG_FLASH_BLOCK_SIZE; /* offset inside page */
-		remaining = dataSize;
-
-		while (remaining>0) {
+#if McuFlash_CONFIG_WRITE_BUFFER
+	uint32_t pageAddr = McuFlash_PAGE_ADDR(addr);
+	size_t offset = (uint32_t)addr-pageAddr, size;
+	uint8_t res;
+
+	McuFlash_STATS_INC(nofPrograms, 1);
+	McuFlash_STATS_INC(programBytes, dataSize);
+
+	while (dataSize>0) {
+		size = McuFlash_CONFIG_FLASH_BLOCK_SIZE-offset; /* how much we can write into this page */
+		if (size>dataSize) {
+			size = dataSize;
+		}
+		if (size==McuFlash_CONFIG_FLASH_BLOCK_SIZE) { /* full pages: no need to buffer them, program them in one burst */
+			size = (dataSize/McuFlash_CONFIG_FLASH_BLOCK_SIZE)*McuFlash_CONFIG_FLASH_BLOCK_SIZE;
+			if (size>McuFlash_CONFIG_PROGRAM_BURST_PAGES*McuFlash_CONFIG_FLASH_BLOCK_SIZE) {
+				size = McuFlash_CONFIG_PROGRAM_BURST_PAGES*McuFlash_CONFIG_FLASH_BLOCK_SIZE;
+			}
+			McuFlash_DiscardBuffer(pageAddr, size);
+			res = McuFlash_ProgramPages((void*)pageAddr, data, size, false);
+		} else {
+			res = McuFlash_BufferWrite(pageAddr, offset, data, size);
+		}
+		if (res!=ERR_OK) {
+			return ERR_FAILED;
+		}
+		pageAddr += offset+size;
+		offset = 0;
+		data += size;
+		dataSize -= size;
+	}
+	return ERR_OK;
+#else
+	uint8_t buffer[McuFlash_CONFIG_FLASH_BLOCK_SIZE];
+	uint8_t res;
+	size_t offset, size;
+	uint32_t pageAddr; /* address of page */
+
+	McuFlash_STATS_INC(nofPrograms, 1);
+	McuFlash_STATS_INC(programBytes, dataSize);
+	pageAddr = ((uint32_t)addr/McuFlash_CONFIG_FLASH_BLOCK_SIZE)*McuFlash_CONFIG_FLASH_BLOCK_SIZE;
+	offset = (uint32_t)addr%McuFlash_CONFIG_FLASH_BLOCK_SIZE; /* offset inside page */
+	res = ERR_OK;
+	while (dataSize>0) {
+		if (offset==0 && dataSize>=McuFlash_CONFIG_FLASH_BLOCK_SIZE) {
+			/* full pages: program them in one burst */
+			size = (dataSize/McuFlash_CONFIG_FLASH_BLOCK_SIZE)*McuFlash_CONFIG_FLASH_BLOCK_SIZE;
+			if (size>McuFlash_CONFIG_PROGRAM_BURST_PAGES*McuFlash_CONFIG_FLASH_BLOCK_SIZE) {
+				size = McuFlash_CONFIG_PROGRAM_BURST_PAGES*McuFlash_CONFIG_FLASH_BLOCK_SIZE;
+			}
+			res = McuFlash_ProgramPages((void*)pageAddr, data, size, false);
+		} else {
+			/* address and size not aligned to page boundaries: make backup into buffer */
 			res = McuFlash_Read((void*)pageAddr, buffer, sizeof(buffer)); /* read current flash content */
 			if (res!=ERR_OK) {
 				return ERR_FAILED;
 			}
-			if (offset+remaining>McuFlash_CONFIG_FLASH_BLOCK_SIZE) {
+			McuFlash_STATS_INC(nofReadModifyWrites, 1);
+			if (offset+dataSize>McuFlash_CONFIG_FLASH_BLOCK_SIZE) {
 				size = McuFlash_CONFIG_FLASH_BLOCK_SIZE-offset; /* how much we can copy in this step */
 			}
 			else {
-				size = remaining;
+				size = dataSize;
 			}
 			memcpy(buffer+offset, data, size); /*  merge original page with new data */
 			/* program new data/page */
-			res = McuFlash_ProgramPage((void*)pageAddr, buffer, sizeof(buffer));
-			if (res!=ERR_OK) {
-				return ERR_FAILED;
-			}
-			pageAddr += McuFlash_CONFIG_FLASH_BLOCK_SIZE;
-			offset = 0;
-			data += size;
-			remaining -= size;
+			res = McuFlash_ProgramPages((void*)pageAddr, buffer, sizeof(buffer), false);
 		}
-		return res;
-	}
-	else { /* a full page to program */
-		return McuFlash_ProgramPage(addr, data, dataSize);
+		if (res!=ERR_OK) {
+			return ERR_FAILED;
+		}
+		pageAddr += offset+size;
+		offset = 0;
+		data += size;
+		dataSize -= size;
 	}
+	return res;
+#endif
 }
 
 uint8_t McuFlash_InitErase(void *addr, size_t nofBytes) {
@@ -119,12 +804,21 @@ uint8_t McuFlash_InitErase(void *addr, size_t nofBytes) {
 	if ((nofBytes%McuFlash_CONFIG_FLASH_BLOCK_SIZE)!=0) { /* check if size is multiple of page size */
 		return ERR_FAILED;
 	}
+#if McuFlash_CONFIG_WRITE_BUFFER
+	McuFlash_DiscardBuffer((uint32_t)addr, nofBytes);
+#endif
 	for(int i=0; i<nofBytes/McuFlash_CONFIG_FLASH_BLOCK_SIZE; i++) { /* erase and program each page */
 		/* erase each page */
-		status = FLASH_Erase(&s_flashDriver, (uint32_t)addr+i*McuFlash_CONFIG_FLASH_BLOCK_SIZE, McuFlash_CONFIG_FLASH_BLOCK_SIZE, kFLASH_ApiEraseKey);
+		status = McuFlash_DrvErase((uint32_t)addr+i*McuFlash_CONFIG_FLASH_BLOCK_SIZE, McuFlash_CONFIG_FLASH_BLOCK_SIZE);
 		if (status!=kStatus_Success ) {
+#if McuFlash_CONFIG_ERASED_TRACKING
+			McuFlash_SetPageState((uint32_t)addr+i*McuFlash_CONFIG_FLASH_BLOCK_SIZE, McuFlash_PageState_Unknown);
+#endif
 			return ERR_FAILED;
 		}
+#if McuFlash_CONFIG_ERASED_TRACKING
+		McuFlash_SetPageState((uint32_t)addr+i*McuFlash_CONFIG_FLASH_BLOCK_SIZE, McuFlash_PageState_Erased);
+#endif
 	}
 	return ERR_OK;
 }
@@ -135,6 +829,25 @@ uint8_t McuFlash_Erase(void *addr, size_t nofBytes) {
 	if ((nofBytes%McuFlash_CONFIG_FLASH_BLOCK_SIZE)!=0) { /* check if size is multiple of page size */
 		return ERR_FAILED;
 	}
+#if McuFlash_CONFIG_ERASED_TRACKING
+	if (nofBytes>0 && McuFlash_IsTracked((uint32_t)addr) && McuFlash_IsTracked((uint32_t)addr+nofBytes-1)) {
+		/* the bitmap knows which pages are erased, so reads won't touch them: erase the whole area with one call */
+		status_t status;
+
+		if (((uint32_t)addr%McuFlash_CONFIG_FLASH_BLOCK_SIZE) != 0) {
+			return ERR_FAILED;
+		}
+#if McuFlash_CONFIG_WRITE_BUFFER
+		McuFlash_DiscardBuffer((uint32_t)addr, nofBytes);
+#endif
+		status = McuFlash_DrvErase((uint32_t)addr, nofBytes);
+		for(uint32_t pageAddr=(uint32_t)addr; pageAddr<(uint32_t)addr+nofBytes; pageAddr+=McuFlash_CONFIG_FLASH_BLOCK_SIZE) {
+			McuFlash_SetPageState(pageAddr, status==kStatus_Success?McuFlash_PageState_Erased:McuFlash_PageState_Unknown);
+		}
+		return status==kStatus_Success?ERR_OK:ERR_FAILED;
+	}
+#endif
+	res = ERR_OK;
 	for(int i=0; i<nofBytes/McuFlash_CONFIG_FLASH_BLOCK_SIZE; i++) { /* erase and program each page */
 		res = McuFlash_Program(addr+i*McuFlash_CONFIG_FLASH_BLOCK_SIZE, zeroBuffer, sizeof(zeroBuffer));
 		if (res!=ERR_OK) {
@@ -155,13 +868,117 @@ static uint8_t ReadData(void *hndl, uint32_t addr, uint8_t *buf, size_t bufSize)
 }
 
 void McuFlash_Deinit(void) {
+#if McuFlash_CONFIG_WRITE_BUFFER
+	(void)McuFlash_Flush();
+#endif
+}
+
+void McuFlash_GetStats(McuFlash_Stats_t *stats) {
+#if McuFlash_CONFIG_STATS
+	*stats = McuFlash_stats;
+#else
+	memset(stats, 0, sizeof(*stats));
+#endif
+}
+
+void McuFlash_ResetStats(void) {
+#if McuFlash_CONFIG_STATS
+	memset(&McuFlash_stats, 0, sizeof(McuFlash_stats));
+#endif
+}
+
+/* appends a LEB128 encoded value, returns the new position or NULL if it does not fit */
+static uint8_t *McuFlash_PutVarint(uint8_t *p, const uint8_t *end, uint64_t val) {
+	do {
+		if (p==NULL || p>=end) {
+			return NULL;
+		}
+		*p = val&0x7f;
+		val >>= 7;
+		if (val!=0) {
+			*p |= 0x80;
+		}
+		p++;
+	} while (val!=0);
+	return p;
+}
+
+size_t McuFlash_DumpStats(uint8_t *buf, size_t bufSize) {
+	McuFlash_Stats_t stats;
+	const uint8_t *end = buf+bufSize;
+	uint8_t *p = buf;
+
+	if (bufSize<8) {
+		return 0;
+	}
+	McuFlash_GetStats(&stats);
+	*p++ = McuFlash_STATS_DUMP_MAGIC&0xff;
+	*p++ = (McuFlash_STATS_DUMP_MAGIC>>8)&0xff;
+	*p++ = (McuFlash_STATS_DUMP_MAGIC>>16)&0xff;
+	*p++ = (McuFlash_STATS_DUMP_MAGIC>>24)&0xff;
+	*p++ = McuFlash_STATS_DUMP_VERSION;
+	*p++ = McuFlash_Op_NofOps;
+	*p++ = McuFlash_CONFIG_STATS_NOF_BUCKETS;
+	*p++ = McuFlash_CONFIG_STATS_BUCKET_SHIFT;
+	p = McuFlash_PutVarint(p, end, stats.nofPrograms);
+	p = McuFlash_PutVarint(p, end, stats.programBytes);
+	p = McuFlash_PutVarint(p, end, stats.nofReads);
+	p = McuFlash_PutVarint(p, end, stats.readBytes);
+	p = McuFlash_PutVarint(p, end, stats.nofReadModifyWrites);
+	for(int i=0; i<McuFlash_Op_NofOps; i++) {
+		p = McuFlash_PutVarint(p, end, stats.ops[i].calls);
+		p = McuFlash_PutVarint(p, end, stats.ops[i].errors);
+		p = McuFlash_PutVarint(p, end, stats.ops[i].bytes);
+		p = McuFlash_PutVarint(p, end, stats.ops[i].maxCycles);
+		p = McuFlash_PutVarint(p, end, stats.ops[i].cycles);
+		for(int j=0; j<McuFlash_CONFIG_STATS_NOF_BUCKETS; j++) {
+			p = McuFlash_PutVarint(p, end, stats.ops[i].histogram[j]);
+		}
+	}
+	return p!=NULL ? (size_t)(p-buf) : 0;
+}
+
+uint8_t McuFlash_GetGeometry(McuFlash_Geometry_t *geometry) {
+	*geometry = McuFlash_geometry;
+	if (McuFlash_geometry.pageSize!=McuFlash_CONFIG_FLASH_BLOCK_SIZE || McuFlash_geometry.totalSize==0) {
+		return ERR_FAILED; /* not initialized, or the driver reports a different device */
+	}
+	return ERR_OK;
+}
+
+uint32_t McuFlash_MeasureErase(void *addr, size_t nofBytes) {
+	uint32_t start, cycles;
+
+	start = McuFlash_CONFIG_CYCLE_COUNTER();
+	if (McuFlash_Erase(addr, nofBytes)!=ERR_OK) {
+		return 0;
+	}
+	cycles = McuFlash_CONFIG_CYCLE_COUNTER()-start;
+	return cycles!=0 ? cycles : 1;
 }
 
 void McuFlash_Init(void) {
 	status_t result;    /* Return code from each flash driver function */
 	memset(&s_flashDriver, 0, sizeof(flash_config_t));
+#if McuFlash_CONFIG_WRITE_BUFFER
+	McuFlash_writeBuf.valid = false;
+	memset(McuFlash_failedPages, 0, sizeof(McuFlash_failedPages));
+#endif
+#if McuFlash_CONFIG_ERASED_TRACKING
+	memset(McuFlash_pageKnown, 0, sizeof(McuFlash_pageKnown)); /* page states get learned again on first access */
+#endif
+	McuFlash_CONFIG_CYCLE_COUNTER_INIT();
+	McuFlash_ResetStats();
 	result = FLASH_Init(&s_flashDriver);
 	if (result!=kStatus_Success) {
 		for(;;) { /* error */ }
 	}
+	memset(&McuFlash_geometry, 0, sizeof(McuFlash_geometry));
+	if (   FLASH_GetProperty(&s_flashDriver, kFLASH_PropertyPflashBlockBaseAddr, &McuFlash_geometry.base)!=kStatus_Success
+	    || FLASH_GetProperty(&s_flashDriver, kFLASH_PropertyPflashTotalSize, &McuFlash_geometry.totalSize)!=kStatus_Success
+	    || FLASH_GetProperty(&s_flashDriver, kFLASH_PropertyPflashPageSize, &McuFlash_geometry.pageSize)!=kStatus_Success
+	    || FLASH_GetProperty(&s_flashDriver, kFLASH_PropertyPflashSectorSize, &McuFlash_geometry.sectorSize)!=kStatus_Success)
+	{
+		memset(&McuFlash_geometry, 0, sizeof(McuFlash_geometry)); /* McuFlash_GetGeometry() will report the error */
+	}
 }
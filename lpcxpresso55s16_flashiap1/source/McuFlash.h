@@ -18,6 +18,226 @@ extern "C" {
 
 #define McuFlash_CONFIG_FLASH_BLOCK_SIZE         (0x200)
 
+#ifndef McuFlash_CONFIG_ERASED_TRACKING
+  #define McuFlash_CONFIG_ERASED_TRACKING          (1)
+    /*!< 1: McuFlash_Erase() really erases and the erased pages are tracked in a RAM bitmap, reads of them return 0xFF.
+         0: McuFlash_Erase() programs zero pages so the memory stays readable (legacy) */
+#endif
+
+#ifndef McuFlash_CONFIG_PROGRAM_BURST_PAGES
+  #define McuFlash_CONFIG_PROGRAM_BURST_PAGES      (16)
+    /*!< Maximum number of aligned full pages McuFlash_Program() erases, programs and verifies with one flash API call each.
+         Bounds the time the flash is busy, must not exceed kFLASH_MaxPagesToErase. 1: program page by page */
+#endif
+
+#ifndef McuFlash_CONFIG_WRITE_BUFFER
+  #define McuFlash_CONFIG_WRITE_BUFFER             (1)
+    /*!< 1: McuFlash_Program() merges partial writes to the same page in a RAM page buffer and programs the page once,
+         pending data is written with McuFlash_Flush(). 0: every partial write is a read-modify-write of the page */
+#endif
+
+#ifndef McuFlash_CONFIG_NOF_FAILED_PAGES
+  #define McuFlash_CONFIG_NOF_FAILED_PAGES         (2)
+    /*!< with McuFlash_CONFIG_WRITE_BUFFER: number of buffered pages which failed to program kept in RAM, so reads still return
+         their data, LittleFS reads it when it relocates a bad block. 2 for a relocation whose new block fails as well */
+#endif
+
+#define McuFlash_READ_MODE_ROM                   (0) /*!< read with FLASH_Read(), erased pages are detected with FLASH_VerifyErase() */
+#define McuFlash_READ_MODE_MAPPED                (1) /*!< memcpy from the memory mapped flash, a read of an erased page is trapped by the fault handler */
+
+#ifndef McuFlash_CONFIG_READ_MODE
+  #define McuFlash_CONFIG_READ_MODE                (McuFlash_READ_MODE_ROM)
+    /*!< how McuFlash_Read() accesses the flash, McuFlash_READ_MODE_MAPPED needs the fault hook in semihost_hardfault.c */
+#endif
+
+#ifndef McuFlash_CONFIG_MAPPED_READ
+  #define McuFlash_CONFIG_MAPPED_READ(dst, addr, nofBytes)   McuFlash_GuardedCopy((dst), (const void*)(addr), (nofBytes))
+    /*!< copies from memory mapped flash, returns 0 for success and non-zero if the read faulted */
+#endif
+
+#ifndef McuFlash_CONFIG_MAP_ADDRESS
+  #define McuFlash_CONFIG_MAP_ADDRESS(addr, nofBytes)   ((const void*)(addr))
+    /*!< returns the CPU address of memory mapped flash, used by McuFlash_Map() */
+#endif
+
+#ifndef McuFlash_CONFIG_READ_LOCK
+  #define McuFlash_CONFIG_READ_LOCK()              do { } while (0)
+    /*!< taken by McuFlash_Read(), McuFlash_Map() and McuFlash_IsErased(), e.g. a mutex. Needed if they get called by more than one task
+         at the same time, as by the concurrent LittleFS readers (LFS_READERS): the flash driver, the erased page bitmap and the statistics
+         are not reentrant. Program, erase and flush are kept apart from them by the caller, as by the LittleFS write lock */
+  #define McuFlash_CONFIG_READ_UNLOCK()            do { } while (0)
+    /*!< releases McuFlash_CONFIG_READ_LOCK() */
+#endif
+
+#ifndef McuFlash_CONFIG_STATS
+  #define McuFlash_CONFIG_STATS                    (1)
+    /*!< 1: count the flash driver calls and record their latency with McuFlash_CONFIG_CYCLE_COUNTER() in histograms */
+#endif
+
+#ifndef McuFlash_CONFIG_STATS_NOF_BUCKETS
+  #define McuFlash_CONFIG_STATS_NOF_BUCKETS        (16)
+    /*!< number of latency histogram buckets per operation, each bucket covers twice the range of the previous one */
+#endif
+
+#ifndef McuFlash_CONFIG_STATS_BUCKET_SHIFT
+  #define McuFlash_CONFIG_STATS_BUCKET_SHIFT       (8)
+    /*!< the first bucket holds latencies below 2^(shift+1) cycles, bucket i up to 2^(shift+i+1), the last one everything above */
+#endif
+
+#ifndef McuFlash_CONFIG_VERIFY_POLICY
+  #define McuFlash_CONFIG_VERIFY_POLICY            (McuFlash_Verify_Full)
+    /*!< verification policy after boot, see McuFlash_VerifyPolicy_e */
+#endif
+
+#ifndef McuFlash_CONFIG_VERIFY_SAMPLE_RATE
+  #define McuFlash_CONFIG_VERIFY_SAMPLE_RATE       (8)
+    /*!< McuFlash_Verify_Sampled: verify one out of N programmed pages */
+#endif
+
+#ifndef McuFlash_CONFIG_VERIFY_SAMPLE_RANDOM
+  #define McuFlash_CONFIG_VERIFY_SAMPLE_RANDOM     (0)
+    /*!< McuFlash_Verify_Sampled: 1: pick the pages randomly with a probability of 1/N; 0: every Nth page */
+#endif
+
+#ifndef McuFlash_CONFIG_CYCLE_COUNTER
+  #define McuFlash_CONFIG_CYCLE_COUNTER()          (DWT->CYCCNT)
+    /*!< free running 32bit cycle counter used to measure the time of flash operations */
+  #define McuFlash_CONFIG_CYCLE_COUNTER_INIT()     do { CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk; } while(0)
+    /*!< enables the cycle counter */
+#endif
+
+#ifndef McuFlash_CONFIG_TRACKED_BASE
+  #define McuFlash_CONFIG_TRACKED_BASE             (0x0)
+    /*!< start address of the flash area covered by the erased page bitmap */
+#endif
+
+#ifndef McuFlash_CONFIG_TRACKED_SIZE
+  #define McuFlash_CONFIG_TRACKED_SIZE             (256*1024)
+    /*!< size of the flash area covered by the erased page bitmap, 2 bits of RAM per page */
+#endif
+
+/*! How programmed pages get verified */
+typedef enum {
+  McuFlash_Verify_Full,     /*!< FLASH_VerifyErase() after the erase and FLASH_VerifyProgram() after the program of every page */
+  McuFlash_Verify_LittleFS, /*!< rely on the LittleFS read-back: only pages of the write buffer which LittleFS has read back from the buffer
+                                 and not from the flash get verified. Only for a flash used by LittleFS alone */
+  McuFlash_Verify_Sampled,  /*!< full verification for a sample of the pages, see McuFlash_SetVerifyPolicy() */
+  McuFlash_Verify_TrustROM, /*!< no verification, only the status of the ROM erase and program calls counts */
+  McuFlash_Verify_NofPolicies /*!< sentinel, number of policies */
+} McuFlash_VerifyPolicy_e;
+
+/*! Verification counters, kept per policy */
+typedef struct {
+  uint32_t nofVerifies; /*!< number of FLASH_VerifyErase() and FLASH_VerifyProgram() calls */
+  uint32_t nofFailed;   /*!< number of failed verifications */
+  uint32_t nofSkipped;  /*!< number of pages programmed without verification */
+  uint64_t cycles;      /*!< cycles spent in the verify calls */
+} McuFlash_VerifyStats_t;
+
+/*! Flash driver operations counted with McuFlash_CONFIG_STATS */
+typedef enum {
+  McuFlash_Op_Erase,         /*!< FLASH_Erase() */
+  McuFlash_Op_Program,       /*!< FLASH_Program() */
+  McuFlash_Op_Read,          /*!< FLASH_Read() */
+  McuFlash_Op_VerifyErase,   /*!< FLASH_VerifyErase() */
+  McuFlash_Op_VerifyProgram, /*!< FLASH_VerifyProgram() */
+  McuFlash_Op_MappedRead,    /*!< McuFlash_CONFIG_MAPPED_READ() */
+  McuFlash_Op_NofOps
+} McuFlash_Op_e;
+
+typedef struct {
+  uint32_t calls;     /*!< number of calls */
+  uint32_t errors;    /*!< calls which did not return success */
+  uint32_t bytes;     /*!< bytes erased, programmed, read or verified */
+  uint32_t maxCycles; /*!< longest call */
+  uint64_t cycles;    /*!< cycles spent in the calls */
+  uint32_t histogram[McuFlash_CONFIG_STATS_NOF_BUCKETS]; /*!< number of calls per latency bucket, see McuFlash_CONFIG_STATS_BUCKET_SHIFT */
+} McuFlash_OpStats_t;
+
+typedef struct {
+  McuFlash_OpStats_t ops[McuFlash_Op_NofOps]; /*!< flash driver calls made by McuFlash */
+  uint32_t nofPrograms;         /*!< McuFlash_Program() calls */
+  uint32_t programBytes;        /*!< bytes passed to McuFlash_Program() */
+  uint32_t nofReads;            /*!< McuFlash_Read() calls */
+  uint32_t readBytes;           /*!< bytes passed to McuFlash_Read() */
+  uint32_t nofReadModifyWrites; /*!< partial page programs which had to load the current page content */
+} McuFlash_Stats_t;
+
+#define McuFlash_STATS_DUMP_MAGIC     (0x5453464D) /* "MFST" */
+#define McuFlash_STATS_DUMP_VERSION   (1)
+#define McuFlash_STATS_DUMP_MAX_SIZE  (8+5*5+McuFlash_Op_NofOps*(4*5+10+McuFlash_CONFIG_STATS_NOF_BUCKETS*5))
+  /*!< buffer size which holds any McuFlash_DumpStats() output */
+
+/*!
+ * \brief Returns a snapshot of the flash statistics (McuFlash_CONFIG_STATS)
+ * \param stats Where to store the statistics
+ */
+void McuFlash_GetStats(McuFlash_Stats_t *stats);
+
+/*!
+ * \brief Clears the flash statistics
+ */
+void McuFlash_ResetStats(void);
+
+/*!
+ * \brief Writes the flash statistics in a compact binary format: magic (uint32_t, little endian), version, number of
+ * operations, number of buckets and bucket shift (one byte each), the counters nofPrograms, programBytes, nofReads,
+ * readBytes and nofReadModifyWrites, then for each operation calls, errors, bytes, maxCycles, cycles and the histogram buckets. All counters are LEB128
+ * encoded (7 bits per byte, least significant first, bit 7 set if more bytes follow).
+ * \param buf Buffer for the dump, McuFlash_STATS_DUMP_MAX_SIZE is always large enough
+ * \param bufSize Size of the buffer in bytes
+ * \return Number of bytes written, 0 if the buffer is too small
+ */
+size_t McuFlash_DumpStats(uint8_t *buf, size_t bufSize);
+
+/*! Program flash geometry as reported by the flash driver */
+typedef struct {
+  uint32_t base;       /*!< start address of the program flash */
+  uint32_t totalSize;  /*!< usable program flash in bytes, without the protected flash region at the end */
+  uint32_t pageSize;   /*!< program (and smallest erase) unit in bytes */
+  uint32_t sectorSize; /*!< sector size in bytes */
+} McuFlash_Geometry_t;
+
+/*!
+ * \brief Returns the program flash geometry, queried with FLASH_GetProperty() in McuFlash_Init()
+ * \param geometry Where to store the geometry
+ * \return Error code, ERR_OK if everything is fine, ERR_FAILED if the page size does not match McuFlash_CONFIG_FLASH_BLOCK_SIZE
+ */
+uint8_t McuFlash_GetGeometry(McuFlash_Geometry_t *geometry);
+
+/*!
+ * \brief Erases a memory area and measures how long it takes
+ * \param addr Memory area to erase
+ * \param nofBytes Number of bytes to erase
+ * \return Cycles (McuFlash_CONFIG_CYCLE_COUNTER()) spent for the erase, 0 if the erase failed
+ */
+uint32_t McuFlash_MeasureErase(void *addr, size_t nofBytes);
+
+/*!
+ * \brief Sets the verification policy for programmed pages
+ * \param policy Policy to use
+ * \param sampleRate For McuFlash_Verify_Sampled: verify one out of sampleRate pages, 0 or 1 verifies every page
+ * \param random For McuFlash_Verify_Sampled: true to pick the pages randomly, false for every Nth page
+ */
+void McuFlash_SetVerifyPolicy(McuFlash_VerifyPolicy_e policy, uint32_t sampleRate, bool random);
+
+/*!
+ * \brief Returns the current verification policy
+ */
+McuFlash_VerifyPolicy_e McuFlash_GetVerifyPolicy(void);
+
+/*!
+ * \brief Returns the verification counters of a policy
+ * \param policy Policy
+ * \param stats Where to store the counters
+ */
+void McuFlash_GetVerifyStats(McuFlash_VerifyPolicy_e policy, McuFlash_VerifyStats_t *stats);
+
+/*!
+ * \brief Clears the verification counters of all policies
+ */
+void McuFlash_ResetVerifyStats(void);
+
 /*!
  * \brief Decides if memory is accessible. On some architectures it needs to be prepared first.
  * \param addr Memory area to check
@@ -26,6 +246,23 @@ extern "C" {
  */
 bool McuFlash_IsAccessible(const void *addr, size_t nofBytes);
 
+/*!
+ * \brief Returns a pointer to read a memory area in place, without copying it. Only possible with
+ * McuFlash_CONFIG_ERASED_TRACKING, for areas where all pages are programmed and nothing is pending in the write buffer.
+ * \param addr Memory area to map
+ * \param nofBytes Number of bytes to map
+ * \return Pointer to the data, NULL if the area has to be read with McuFlash_Read()
+ */
+const void *McuFlash_Map(const void *addr, size_t nofBytes);
+
+/*!
+ * \brief Decides if a memory area is erased. With McuFlash_CONFIG_ERASED_TRACKING this is answered from the page bitmap.
+ * \param addr Memory area to check
+ * \param nofBytes Number of bytes to check
+ * \return true if all pages of the area are erased and nothing is pending for them in the write buffer, false otherwise
+ */
+bool McuFlash_IsErased(const void *addr, size_t nofBytes);
+
 /*!
  * \brief Erases a memory area
  * \param addr Memory area to erase
@@ -52,16 +289,49 @@ uint8_t McuFlash_InitErase(void *addr, size_t nofBytes);
  */
 uint8_t McuFlash_Program(void *addr, const void *data, size_t dataSize);
 
+/*!
+ * \brief Programs the page pending in the write buffer (McuFlash_CONFIG_WRITE_BUFFER), if any. If that fails, the failure
+ * is returned once, and reads of the page still return its data until it gets erased or programmed again. If the page fails
+ * when a write to another page makes room for it, that write does not fail: reads of the failed page return ERR_FAILED instead.
+ * \return Error code, ERR_OK if everything is fine
+ */
+uint8_t McuFlash_Flush(void);
+
 /*!
  * \brief Read the flash memory
  * \param addr Address where to store the data
  * \param data Pointer where to store the data
  * \param dataSize Number of data bytes
- * \return Error code, ERR_OK if everything is fine
+ * \return Error code, ERR_OK if everything is fine, ERR_FAILED if the range has a page which could not be programmed, see McuFlash_Flush(),
+ *         ERR_FAULT if it has an erased page outside of the erased page bitmap (any erased page without McuFlash_CONFIG_ERASED_TRACKING).
+ *         Erased pages read as 0xFF, the other pages of the range get read.
  */
 uint8_t McuFlash_Read(const void *addr, void *data, size_t dataSize);
 
 
+/*!
+ * \brief Copies from memory mapped flash. A bus fault or hard fault inside the copy (read of an erased page)
+ * is caught by McuFlash_HardFaultHook() and aborts the copy.
+ * \param dst Destination buffer
+ * \param src Source address in flash
+ * \param nofBytes Number of bytes to copy
+ * \return 0 if successful, non-zero if the read faulted
+ */
+int McuFlash_GuardedCopy(void *dst, const void *src, size_t nofBytes);
+
+/*!
+ * \brief Called by the fault handlers with the stacked exception frame. If the fault happened
+ * inside McuFlash_GuardedCopy() the frame gets redirected so the copy returns with an error.
+ * \param frame Stacked exception frame (R0-R3, R12, LR, PC, xPSR)
+ * \return non-zero if the fault has been handled and the handler shall return
+ */
+int McuFlash_HardFaultHook(uint32_t *frame);
+
+/*!
+ * \brief Returns the number of faulting flash reads caught by McuFlash_HardFaultHook()
+ */
+uint32_t McuFlash_GetNofReadFaults(void);
+
 /*!
  * \brief Module de-initialization
  */
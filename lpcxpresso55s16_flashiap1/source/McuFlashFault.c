@@ -0,0 +1,93 @@
+/*
+ * McuFlashFault.c
+ *
+ * Fault trapping for reads of memory mapped flash. On the LPC55Sxx a read of an
+ * erased page raises a bus fault (escalated to a hard fault if the bus fault
+ * handler is not enabled). McuFlash_GuardedCopy() is the only code allowed to
+ * fault this way: the handlers pass the exception frame to McuFlash_HardFaultHook()
+ * which resumes execution at the error exit of the copy.
+ * Target only, the host emulation models the fault in FLASH_HOST_MappedRead().
+ */
+#include "McuFlash.h"
+#include "fsl_device_registers.h"
+
+static volatile uint32_t McuFlash_nofReadFaults;
+
+/* Leaf function without stack usage: when a load faults, the handler sets the PC to
+ * McuFlash_GuardedCopyFault and LR still holds the return address of the caller. */
+__attribute__((naked)) int McuFlash_GuardedCopy(void *dst, const void *src, size_t nofBytes) {
+  __asm(".syntax unified\n"
+        "    CMP     R2, #0 \n"
+        "    BEQ     _gc_done \n"
+        "    ORR     R3, R0, R1 \n"     /* everything word aligned? */
+        "    ORR     R3, R3, R2 \n"
+        "    LSLS    R3, R3, #30 \n"
+        "    BNE     _gc_bytes \n"
+        "_gc_words: \n"
+        "    LDR     R3, [R1], #4 \n"
+        "    STR     R3, [R0], #4 \n"
+        "    SUBS    R2, R2, #4 \n"
+        "    BNE     _gc_words \n"
+        "    B       _gc_done \n"
+        "_gc_bytes: \n"
+        "    LDRB    R3, [R1], #1 \n"
+        "    STRB    R3, [R0], #1 \n"
+        "    SUBS    R2, R2, #1 \n"
+        "    BNE     _gc_bytes \n"
+        "_gc_done: \n"
+        "    MOVS    R0, #0 \n"
+        "    BX      LR \n"
+        "    .global McuFlash_GuardedCopyFault \n"
+        "    .thumb_func \n"
+        "McuFlash_GuardedCopyFault: \n"
+        "    MOVS    R0, #1 \n"
+        "    BX      LR \n"
+        "    .global McuFlash_GuardedCopyEnd \n"
+        "McuFlash_GuardedCopyEnd: \n"
+        ".syntax divided\n");
+}
+
+extern void McuFlash_GuardedCopyFault(void);
+extern void McuFlash_GuardedCopyEnd(void);
+
+int McuFlash_HardFaultHook(uint32_t *frame) {
+  uint32_t pc = frame[6]; /* stacked PC */
+
+  if (pc>=((uint32_t)McuFlash_GuardedCopy&~1u) && pc<((uint32_t)McuFlash_GuardedCopyEnd&~1u)) {
+    frame[6] = (uint32_t)McuFlash_GuardedCopyFault&~1u; /* return into the error exit of the copy */
+    SCB->CFSR = SCB->CFSR; /* clear the sticky fault status bits (write 1 to clear) */
+    SCB->HFSR = SCB->HFSR;
+    McuFlash_nofReadFaults++;
+    return 1;
+  }
+  return 0; /* not ours */
+}
+
+uint32_t McuFlash_GetNofReadFaults(void) {
+  return McuFlash_nofReadFaults;
+}
+
+#if McuFlash_CONFIG_READ_MODE==McuFlash_READ_MODE_MAPPED
+/* Used if bus faults are enabled in SCB->SHCSR, otherwise the fault escalates to HardFault_Handler()
+ * in semihost_hardfault.c which calls the hook too. */
+__attribute__((naked)) void BusFault_Handler(void) {
+  __asm(".syntax unified\n"
+        "    MOVS    R0, #4 \n"
+        "    MOV     R1, LR \n"
+        "    TST     R0, R1 \n"
+        "    BEQ     _bf_msp \n"
+        "    MRS     R0, PSP \n"
+        "    B       _bf_hook \n"
+        "_bf_msp: \n"
+        "    MRS     R0, MSP \n"
+        "_bf_hook: \n"
+        "    PUSH    {R0, LR} \n"
+        "    BL      McuFlash_HardFaultHook \n"
+        "    POP     {R1, R2} \n"
+        "    MOV     LR, R2 \n"
+        "    CMP     R0, #0 \n"
+        "    BEQ     . \n"               /* not a guarded flash read: stop here */
+        "    BX      LR \n"
+        ".syntax divided\n");
+}
+#endif
@@ -19,29 +19,247 @@
 /* variables used by the file system */
 static bool McuLFS_isMounted = FALSE;
 static lfs_t McuLFS_lfs;
+static bool McuLFS_mountFormat; /* format if the mount of McuLFS_MountLazy() fails */
+static McuLFS_MountStats_t McuLFS_mountStats;
+
+static uint8_t McuLFS_MountPending(bool byAccess);
 
 bool McuLFS_IsMounted(void) {
   return McuLFS_isMounted;
 }
 
+#if McuLittleFS_CONFIG_POOL
+/* core buffers of littlefs, so lfs_init() does not allocate them */
+static uint32_t McuLFS_readBuffer[McuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE/sizeof(uint32_t)];
+static uint32_t McuLFS_progBuffer[McuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE/sizeof(uint32_t)];
+#if !LFS_FREEMAP
+static uint32_t McuLFS_lookaheadBuffer[McuLittleFS_CONFIG_FILESYSTEM_LOOKAHEAD_SIZE/sizeof(uint32_t)];
+#endif
+#if LFS_RCACHE_WAYS>1
+static uint32_t McuLFS_rcacheWaysBuffer[(LFS_RCACHE_WAYS-1)*McuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE/sizeof(uint32_t)];
+#endif
+#if LFS_FREEMAP
+/* the partition is only known at runtime: sized for the smallest blocks over the whole tracked flash */
+#define McuLFS_POOL_MAX_BLOCKS  (McuFlash_CONFIG_TRACKED_SIZE/McuFlash_CONFIG_FLASH_BLOCK_SIZE)
+static uint32_t McuLFS_freemapBuffer[LFS_FREEMAP_SIZE(McuLFS_POOL_MAX_BLOCKS)/sizeof(uint32_t)];
+#endif
+#if defined(LFS_THREADSAFE) && LFS_READERS>0
+/* state and read caches of the concurrent readers of the rdlock callback */
+static uint64_t McuLFS_readersBuffer[(LFS_READERS_SIZE(McuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE)+7)/sizeof(uint64_t)];
+#endif
+#endif
+
 /* configuration of the file system is provided by this struct */
-static const struct lfs_config McuLFS_cfg = {
+static struct lfs_config McuLFS_cfg = { /* block_size and block_count are set from the partition table */
   .context = NULL,
   /* block device operations */
   .read = McuLittleFS_block_device_read,
   .prog = McuLittleFS_block_device_prog,
   .erase = McuLittleFS_block_device_erase,
   .sync = McuLittleFS_block_device_sync,
+#if McuLittleFS_CONFIG_BLOCK_DEVICE_MAP
+  .map = McuLittleFS_block_device_map,
+#endif
   /* block device configuration */
   .read_size = McuLittleFS_CONFIG_FILESYSTEM_READ_BUFFER_SIZE,
   .prog_size = McuLittleFS_CONFIG_FILESYSTEM_PROG_BUFFER_SIZE,
-  .block_size = McuLittleFS_CONFIG_BLOCK_SIZE,
-  .block_count = McuLittleFS_CONFIG_BLOCK_COUNT,
   .cache_size = McuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE,
   .lookahead_size = McuLittleFS_CONFIG_FILESYSTEM_LOOKAHEAD_SIZE,
   .block_cycles = 500,
+  .compact_thresh = (lfs_size_t)McuLittleFS_CONFIG_FILESYSTEM_COMPACT_THRESH,
+#if McuLittleFS_CONFIG_POOL
+  .read_buffer = McuLFS_readBuffer,
+  .prog_buffer = McuLFS_progBuffer,
+#if !LFS_FREEMAP
+  .lookahead_buffer = McuLFS_lookaheadBuffer,
+#endif
+#if LFS_RCACHE_WAYS>1
+  .rcache_ways_buffer = McuLFS_rcacheWaysBuffer,
+#endif
+#if LFS_FREEMAP
+  .freemap_buffer = McuLFS_freemapBuffer,
+#endif
+#if defined(LFS_THREADSAFE) && LFS_READERS>0
+  .readers_buffer = McuLFS_readersBuffer,
+#endif
+#endif
 };
 
+#if McuLittleFS_CONFIG_PREERASE_POOL_SIZE>0
+/* erases the blocks which are not erased yet, as long as maxErases allows */
+static uint8_t McuLFS_PreEraseBlocks(const lfs_block_t *blocks, lfs_ssize_t nofBlocks, uint32_t *maxErases) {
+	if (nofBlocks<0) {
+		return ERR_FAILED;
+	}
+	for(lfs_ssize_t i=0; i<nofBlocks && *maxErases>0; i++) {
+		if (!McuLittleFS_block_device_is_erased(&McuLFS_cfg, blocks[i])) {
+			if (lfs_fs_erase(&McuLFS_lfs, blocks[i])!=LFS_ERR_OK) { /* through littlefs, so its caches drop the block */
+				return ERR_FAILED;
+			}
+			(*maxErases)--;
+		}
+	}
+	return ERR_OK;
+}
+
+uint8_t McuLFS_PreErase(uint32_t maxErases) {
+	lfs_block_t blocks[McuLittleFS_CONFIG_PREERASE_POOL_SIZE];
+	uint8_t res;
+
+	if (McuLFS_mountStats.pending) {
+		/* the deferred mount is the idle work of this call */
+		return McuLFS_MountPending(FALSE);
+	}
+	if (!McuLFS_isMounted) {
+		return ERR_FAILED;
+	}
+	/* the blocks the allocator hands out next, with LFS_FREEMAP the ones reserved for growing files first */
+	res = McuLFS_PreEraseBlocks(blocks, lfs_fs_nextfree(&McuLFS_lfs, blocks, McuLittleFS_CONFIG_PREERASE_POOL_SIZE), &maxErases);
+	if (res!=ERR_OK || maxErases==0) {
+		return res;
+	}
+	/* then the blocks the next compactions of the metadata pairs erase, the superblock pair first */
+	return McuLFS_PreEraseBlocks(blocks, lfs_fs_nextstale(&McuLFS_lfs, blocks, McuLittleFS_CONFIG_PREERASE_POOL_SIZE), &maxErases);
+}
+#endif
+
+uint8_t McuLFS_Gc(uint32_t budget) {
+	lfs_ssize_t res;
+
+	if (McuLFS_mountStats.pending) {
+		/* the deferred mount is the idle work of this call */
+		return (McuLFS_MountPending(FALSE)==ERR_OK) ? ERR_BUSY : ERR_FAILED;
+	}
+	if (!McuLFS_isMounted) {
+		return ERR_FAILED;
+	}
+	res = lfs_fs_gc(&McuLFS_lfs, budget);
+	if (res<0) {
+		return ERR_FAILED;
+	}
+	return (res>0) ? ERR_BUSY : ERR_OK;
+}
+
+#if McuLittleFS_CONFIG_POOL
+/* A pool hands out blocks of one size: freed blocks from a list linked through their first word, and blocks never used
+ * before from the end of the used part of the memory, so neither allocation nor free has to walk anything. */
+typedef struct McuLFS_PoolBlock_t {
+	struct McuLFS_PoolBlock_t *next;
+} McuLFS_PoolBlock_t;
+
+typedef struct {
+	uint8_t *mem;             /* memory of the blocks */
+	size_t blockSize;         /* multiple of 8, lfs_malloc() memory is 64-bit aligned */
+	uint16_t nofTouched;      /* blocks at the start of mem which have been used */
+	McuLFS_PoolBlock_t *free; /* freed blocks */
+	McuLFS_PoolStats_t stats;
+} McuLFS_Pool_t;
+
+#define McuLFS_POOL_BLOCK_SIZE(size)  (((size)+7)&~(size_t)7)
+
+static uint64_t McuLFS_cachePoolMem[McuLittleFS_CONFIG_POOL_NOF_FILES*McuLFS_POOL_BLOCK_SIZE(McuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE)/sizeof(uint64_t)];
+static uint64_t McuLFS_filePoolMem[McuLittleFS_CONFIG_POOL_NOF_FILES*McuLFS_POOL_BLOCK_SIZE(sizeof(lfs_file_t))/sizeof(uint64_t)];
+static uint64_t McuLFS_dirPoolMem[McuLittleFS_CONFIG_POOL_NOF_DIRS*McuLFS_POOL_BLOCK_SIZE(sizeof(lfs_dir_t))/sizeof(uint64_t)];
+
+static McuLFS_Pool_t McuLFS_pools[McuLFS_Pool_NofPools] = {
+	[McuLFS_Pool_Cache] = {
+		.mem = (uint8_t*)McuLFS_cachePoolMem,
+		.blockSize = McuLFS_POOL_BLOCK_SIZE(McuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE),
+		.stats.nofBlocks = McuLittleFS_CONFIG_POOL_NOF_FILES,
+	},
+	[McuLFS_Pool_File] = {
+		.mem = (uint8_t*)McuLFS_filePoolMem,
+		.blockSize = McuLFS_POOL_BLOCK_SIZE(sizeof(lfs_file_t)),
+		.stats.nofBlocks = McuLittleFS_CONFIG_POOL_NOF_FILES,
+	},
+	[McuLFS_Pool_Dir] = {
+		.mem = (uint8_t*)McuLFS_dirPoolMem,
+		.blockSize = McuLFS_POOL_BLOCK_SIZE(sizeof(lfs_dir_t)),
+		.stats.nofBlocks = McuLittleFS_CONFIG_POOL_NOF_DIRS,
+	},
+};
+
+static void *McuLFS_PoolGet(McuLFS_Pool_t *pool) {
+	void *p;
+
+	if (pool->free!=NULL) {
+		p = pool->free;
+		pool->free = pool->free->next;
+	} else if (pool->nofTouched<pool->stats.nofBlocks) {
+		p = pool->mem+pool->nofTouched*pool->blockSize;
+		pool->nofTouched++;
+	} else {
+		pool->stats.nofFails++;
+		return NULL;
+	}
+	pool->stats.nofUsed++;
+	if (pool->stats.nofUsed>pool->stats.maxUsed) {
+		pool->stats.maxUsed = pool->stats.nofUsed;
+	}
+	return p;
+}
+
+static void McuLFS_PoolPut(McuLFS_Pool_t *pool, void *p) {
+	McuLFS_PoolBlock_t *block = p;
+
+	LFS_ASSERT((uint8_t*)p>=pool->mem && (uint8_t*)p<pool->mem+pool->nofTouched*pool->blockSize);
+	LFS_ASSERT(((uint8_t*)p-pool->mem)%pool->blockSize==0);
+	block->next = pool->free;
+	pool->free = block;
+	pool->stats.nofUsed--;
+}
+
+void *McuLFS_PoolAlloc(size_t size) {
+	McuLFS_Pool_t *pool = &McuLFS_pools[McuLFS_Pool_Cache];
+
+	if (size>pool->blockSize) { /* littlefs only allocates caches once the core buffers are static */
+		pool->stats.nofFails++;
+		return NULL;
+	}
+	return McuLFS_PoolGet(pool);
+}
+
+void McuLFS_PoolFree(void *p) {
+	if (p!=NULL) {
+		McuLFS_PoolPut(&McuLFS_pools[McuLFS_Pool_Cache], p);
+	}
+}
+
+lfs_file_t *McuLFS_FileAlloc(void) {
+	return McuLFS_PoolGet(&McuLFS_pools[McuLFS_Pool_File]);
+}
+
+void McuLFS_FileFree(lfs_file_t *file) {
+	if (file!=NULL) {
+		McuLFS_PoolPut(&McuLFS_pools[McuLFS_Pool_File], file);
+	}
+}
+
+lfs_dir_t *McuLFS_DirAlloc(void) {
+	return McuLFS_PoolGet(&McuLFS_pools[McuLFS_Pool_Dir]);
+}
+
+void McuLFS_DirFree(lfs_dir_t *dir) {
+	if (dir!=NULL) {
+		McuLFS_PoolPut(&McuLFS_pools[McuLFS_Pool_Dir], dir);
+	}
+}
+
+void McuLFS_GetPoolStats(McuLFS_Pool_e pool, McuLFS_PoolStats_t *stats) {
+	*stats = McuLFS_pools[pool].stats;
+}
+
+void McuLFS_PrintPoolStats(void) {
+	static const char *const names[McuLFS_Pool_NofPools] = {"cache", "file", "dir"};
+
+	for(int i=0; i<McuLFS_Pool_NofPools; i++) {
+		printf("%-6s %u bytes: %u of %u used, max %u, %u failed\r\n", names[i], (unsigned)McuLFS_pools[i].blockSize,
+			(unsigned)McuLFS_pools[i].stats.nofUsed, (unsigned)McuLFS_pools[i].stats.nofBlocks,
+			(unsigned)McuLFS_pools[i].stats.maxUsed, (unsigned)McuLFS_pools[i].stats.nofFails);
+	}
+}
+#endif
+
 /*-----------------------------------------------------------------------
  * Get a string from the file
  * (ported from FatFS function: f_gets())
@@ -134,12 +352,57 @@ int McuLFS_puts (
   return -1;
 }
 
+/* initializes the block device on the first use, which loads the partition table or creates it on a blank device */
+static int McuLFS_LoadPartition(void) {
+	int res;
+
+	if (McuLittleFS_block_device_get_partition()!=NULL) {
+		return LFS_ERR_OK;
+	}
+	res = McuLittleFS_block_device_init();
+	if (res!=LFS_ERR_OK) {
+		printf("No file system partition (%d), the flash is left as it is.\r\n", res);
+	}
+	return res;
+}
+
+/* takes the geometry of the file system from its partition */
+static uint8_t McuLFS_SetGeometry(void) {
+	const McuLittleFS_PartitionEntry_t *partition;
+
+	if (McuLFS_LoadPartition()!=LFS_ERR_OK) {
+		return ERR_FAILED;
+	}
+	partition = McuLittleFS_block_device_get_partition();
+	McuLFS_cfg.block_size = partition->blockSize;
+	McuLFS_cfg.block_count = partition->size/partition->blockSize;
+	if (McuLittleFS_CONFIG_BLOCK_COUNT!=0) {
+		if (McuLittleFS_CONFIG_BLOCK_COUNT>McuLFS_cfg.block_count) {
+			printf("McuLittleFS_CONFIG_BLOCK_COUNT exceeds the partition (%u blocks).\r\n", (unsigned)McuLFS_cfg.block_count);
+			return ERR_FAILED;
+		}
+		McuLFS_cfg.block_count = McuLittleFS_CONFIG_BLOCK_COUNT;
+	}
+#if McuLittleFS_CONFIG_POOL && LFS_FREEMAP
+	if (McuLFS_cfg.block_count>McuLFS_POOL_MAX_BLOCKS) {
+		printf("Partition has more blocks than the static free block map (%u).\r\n", (unsigned)McuLFS_POOL_MAX_BLOCKS);
+		return ERR_FAILED;
+	}
+#endif
+	/* the block size is only known now, metadata_max must not exceed it */
+	McuLFS_cfg.metadata_max = lfs_min(McuLittleFS_CONFIG_FILESYSTEM_METADATA_MAX, McuLFS_cfg.block_size);
+	return ERR_OK;
+}
+
 uint8_t McuLFS_Format() {
 	int res;
 	if (McuLFS_isMounted) {
 		printf("File system is mounted, unmount it first.\r\n");
 		return ERR_FAILED;
 	}
+	if (McuLFS_SetGeometry()!=ERR_OK) {
+		return ERR_FAILED;
+	}
 	res = lfs_format(&McuLFS_lfs, &McuLFS_cfg);
 	if (res == LFS_ERR_OK) {
 		printf("Formatting ...Done.\r\n");
@@ -158,6 +421,10 @@ uint8_t McuLFS_Mount(){
 		printf("File system is already mounted.\r\n");
 		return ERR_FAILED;
 	}
+	McuLFS_mountStats.pending = FALSE; /* an explicit mount replaces a deferred one */
+	if (McuLFS_SetGeometry()!=ERR_OK) {
+		return ERR_FAILED;
+	}
 	res = lfs_mount(&McuLFS_lfs, &McuLFS_cfg);
 	if (res == LFS_ERR_OK) {
 		printf("Mounting ...Done.\r\n");
@@ -173,6 +440,10 @@ uint8_t McuLFS_Mount(){
 uint8_t McuLFS_Unmount() {
 	int res;
 
+	if (McuLFS_mountStats.pending) {
+		McuLFS_mountStats.pending = FALSE;
+		return ERR_OK;
+	}
 	if (!McuLFS_isMounted) {
 		printf("File system is already unmounted.\r\n");
 		return ERR_FAILED;
@@ -189,12 +460,100 @@ uint8_t McuLFS_Unmount() {
 	}
 }
 
+/* true if all blocks of the file system are erased */
+static bool McuLFS_IsBlank(void) {
+	for(lfs_block_t block=0; block<McuLFS_cfg.block_count; block++) {
+		if (!McuLittleFS_block_device_is_erased(&McuLFS_cfg, block)) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* does the mount McuLFS_MountLazy() deferred, with the block device initialization */
+static uint8_t McuLFS_MountPending(bool byAccess) {
+	uint32_t start = McuFlash_CONFIG_CYCLE_COUNTER();
+	uint8_t res;
+
+	McuLFS_mountStats.error = McuLFS_LoadPartition();
+	if (McuLFS_mountStats.error!=LFS_ERR_OK) {
+		McuLFS_mountStats.pending = FALSE; /* not tried again with each access */
+		res = ERR_FAILED;
+	} else {
+		res = McuLFS_Mount();
+		if (res!=ERR_OK && McuLFS_mountFormat) {
+			/* only a blank partition gets formatted, this should only happen on the first boot */
+			if (McuLFS_IsBlank()) {
+				res = McuLFS_Format();
+				if (res==ERR_OK) {
+					McuLFS_mountStats.formatted = TRUE;
+					res = McuLFS_Mount();
+				}
+			} else {
+				printf("No file system on a partition which is not blank, it is left as it is.\r\n");
+			}
+		}
+		if (res!=ERR_OK) {
+			McuLFS_mountStats.error = LFS_ERR_CORRUPT;
+		}
+	}
+	McuLFS_mountStats.mountCycles = McuFlash_CONFIG_CYCLE_COUNTER()-start;
+	McuLFS_mountStats.byAccess = byAccess;
+	return res;
+}
+
+/* true if the file system is mounted, after doing a deferred mount */
+static bool McuLFS_IsReady(void) {
+	if (McuLFS_mountStats.pending) {
+		(void)McuLFS_MountPending(TRUE);
+	}
+	return McuLFS_isMounted;
+}
+
+uint8_t McuLFS_MountLazy(bool formatOnFailure) {
+	uint32_t start = McuFlash_CONFIG_CYCLE_COUNTER();
+	uint8_t res = ERR_OK;
+
+	if (McuLFS_isMounted || McuLFS_mountStats.pending) {
+		printf("File system is already mounted.\r\n");
+		return ERR_FAILED;
+	}
+	memset(&McuLFS_mountStats, 0, sizeof(McuLFS_mountStats));
+	McuLFS_mountFormat = formatOnFailure;
+	McuLFS_mountStats.pending = TRUE;
+#if !McuLittleFS_CONFIG_LAZY_MOUNT
+	res = McuLFS_MountPending(FALSE);
+#endif
+	McuLFS_mountStats.bootCycles = McuFlash_CONFIG_CYCLE_COUNTER()-start;
+	return res;
+}
+
+void McuLFS_GetMountStats(McuLFS_MountStats_t *stats) {
+	*stats = McuLFS_mountStats;
+}
+
+void McuLFS_PrintMountStats(void) {
+	printf("mount: %u cycles at boot", (unsigned)McuLFS_mountStats.bootCycles);
+#if McuLittleFS_CONFIG_LAZY_MOUNT
+	if (McuLFS_mountStats.pending) {
+		printf(", deferred");
+	} else if (McuLFS_mountStats.mountCycles!=0) {
+		printf(", %u cycles %s", (unsigned)McuLFS_mountStats.mountCycles,
+			McuLFS_mountStats.byAccess ? "on first access" : "when idle");
+	}
+#endif
+	if (McuLFS_mountStats.error!=LFS_ERR_OK) {
+		printf(", failed (%d)", McuLFS_mountStats.error);
+	}
+	printf("%s\r\n", McuLFS_mountStats.formatted ? ", formatted" : "");
+}
+
 uint8_t McuLFS_Dir(const char *path) {
   int res;
   lfs_dir_t dir;
   struct lfs_info info;
 
-  if (!McuLFS_isMounted) {
+  if (!McuLFS_IsReady()) {
 	  printf("File system is not mounted, mount it first.\r\n");
 	  return ERR_FAILED;
   }
@@ -260,7 +619,7 @@ uint8_t McuLFS_FileList(const char *path) {
   int res;
   lfs_dir_t dir;
   struct lfs_info info;
-  if (!McuLFS_isMounted) {
+  if (!McuLFS_IsReady()) {
 	  printf("File system is not mounted, mount it first.\r\n");
 	  return ERR_FAILED;
   }
@@ -310,7 +669,7 @@ uint8_t McuLFS_CopyFile(const char *srcPath, const char *dstPath) {
 	int result, nofBytesRead;
 	uint8_t buffer[32]; /* copy buffer */
 	uint8_t res = ERR_OK;
-	if (!McuLFS_isMounted) {
+	if (!McuLFS_IsReady()) {
 		printf("File system is not mounted, mount it first.\r\n");
 		return ERR_FAILED;
 	}
@@ -361,7 +720,7 @@ uint8_t McuLFS_CopyFile(const char *srcPath, const char *dstPath) {
 
 uint8_t McuLFS_MoveFile(const char *srcPath, const char *dstPath) {
 
-	if (!McuLFS_isMounted) {
+	if (!McuLFS_IsReady()) {
 		printf("File system is not mounted, mount it first.\r\n");
 		return ERR_FAILED;
 	}
@@ -417,6 +776,9 @@ uint8_t McuLFS_ReadFile(lfs_file_t* file, bool readFromBeginning, size_t nofByte
 
 uint8_t McuLFS_openFile(lfs_file_t* file, uint8_t* filename) {
 
+	if (!McuLFS_IsReady()) {
+		return ERR_FAILED;
+	}
 	if (lfs_file_open(&McuLFS_lfs, file, (const char*)filename, LFS_O_RDWR | LFS_O_CREAT| LFS_O_APPEND) < 0)
 	{
 		return ERR_FAILED;
@@ -479,7 +841,7 @@ uint8_t McuLFS_RemoveFile(const char *filePath) {
 
 	int result;
 
-	if (!McuLFS_isMounted) {
+	if (!McuLFS_IsReady()) {
 		printf("ERROR: File system is not mounted.\r\n");
 		return ERR_FAILED;
 	}
@@ -493,7 +855,18 @@ uint8_t McuLFS_RemoveFile(const char *filePath) {
     return ERR_OK;
 }
 
+#ifdef LFS_THREADSAFE
+void McuLFS_SetLocks(int (*lock)(const struct lfs_config *c), int (*unlock)(const struct lfs_config *c),
+                     int (*rdlock)(const struct lfs_config *c), int (*rdunlock)(const struct lfs_config *c)) {
+	McuLFS_cfg.lock = lock;
+	McuLFS_cfg.unlock = unlock;
+	McuLFS_cfg.rdlock = rdlock;
+	McuLFS_cfg.rdunlock = rdunlock;
+}
+#endif
+
 lfs_t* McuLFS_GetFileSystem(void) {
+	(void)McuLFS_IsReady(); /* the caller is going to use it */
 	return &McuLFS_lfs;
 }
 
@@ -9,8 +9,11 @@
 #define MCULITTLEFS_H_
 
 #include "lfs.h"
+#include "McuLittleFSconfig.h"
 
 
+/* True if the file system is mounted. False while the mount of McuLFS_MountLazy() is pending: the McuLFS_* calls
+ * which need the file system, McuLFS_GetFileSystem() and the idle hooks do the mount first, see McuLFS_GetMountStats(). */
 bool McuLFS_IsMounted(void);
 lfs_t* McuLFS_GetFileSystem(void);
 
@@ -21,12 +24,77 @@ uint8_t McuLFS_MoveFile(const char *srcPath, const char *dstPath);
 
 uint8_t McuLFS_Mount();
 uint8_t McuLFS_Unmount();
+uint8_t McuLFS_Format();
+
+#ifdef LFS_THREADSAFE
+/* Sets the lock callbacks of the file system, see struct lfs_config. Needed with LFS_THREADSAFE, before the mount.
+ * rdlock and rdunlock may be NULL, then every operation takes the exclusive lock. With McuLittleFS_CONFIG_POOL the
+ * concurrent readers of rdlock have a static buffer of LFS_READERS_SIZE(), LFS_READERS 0 saves it if there is no rdlock. */
+void McuLFS_SetLocks(int (*lock)(const struct lfs_config *c), int (*unlock)(const struct lfs_config *c),
+                     int (*rdlock)(const struct lfs_config *c), int (*rdunlock)(const struct lfs_config *c));
+#endif
+
+/*! Startup timing of McuLFS_MountLazy(), in cycles of McuFlash_CONFIG_CYCLE_COUNTER() */
+typedef struct {
+  uint32_t bootCycles;  /*!< time McuLFS_MountLazy() took, which is what the file system adds to the boot path */
+  uint32_t mountCycles; /*!< time of the mount, with the format if there was one. 0: not mounted yet */
+  bool pending;         /*!< the mount is deferred and has not been done yet */
+  bool byAccess;        /*!< mounted by the first McuLFS_* call which needed it, not by an idle hook */
+  bool formatted;       /*!< the mount failed on a blank partition and the file system got formatted */
+  int error;            /*!< LFS_ERR_OK, the error of McuLittleFS_block_device_init(), or LFS_ERR_CORRUPT if the mount failed */
+} McuLFS_MountStats_t;
+
+/* Mounts the file system with McuLittleFS_CONFIG_LAZY_MOUNT on first use instead of now, together with the block device
+ * initialization (partition table, block size selection on the first boot). If formatOnFailure and the mount fails,
+ * the file system gets formatted if all its blocks are erased, which should only happen on the first boot. Otherwise
+ * the flash is left as it is and the error is in the mount statistics. McuLFS_Unmount() cancels a deferred mount. */
+uint8_t McuLFS_MountLazy(bool formatOnFailure);
+void McuLFS_GetMountStats(McuLFS_MountStats_t *stats);
+/* prints the startup timing of McuLFS_MountLazy() */
+void McuLFS_PrintMountStats(void);
+/* Idle hook: erases up to maxErases blocks, so the erase callback returns without erasing when littlefs gets to them:
+ * first the next McuLittleFS_CONFIG_PREERASE_POOL_SIZE blocks the allocator hands out (lfs_fs_nextfree(), with
+ * LFS_FREEMAP the blocks reserved for growing files first), then the blocks the next compactions of the metadata pairs
+ * erase (lfs_fs_nextstale(), the superblock pair first). A pair with a pre-erased block has no copy of its previous
+ * revision until it gets compacted. Relocations of bad blocks and of worn metadata pairs (block_cycles) still erase
+ * when they happen. Not thread safe. */
+uint8_t McuLFS_PreErase(uint32_t maxErases);
+/* Idle hook: does up to budget units of littlefs maintenance with lfs_fs_gc(), see there. ERR_OK if there was
+ * nothing to do, ERR_BUSY if some work was done and there might be more. */
+uint8_t McuLFS_Gc(uint32_t budget);
 
 uint8_t McuLFS_openFile(lfs_file_t* file,uint8_t* filename);
 uint8_t McuLFS_closeFile(lfs_file_t* file);
 uint8_t McuLFS_writeLine(lfs_file_t* file,uint8_t* line);
 uint8_t McuLFS_readLine(lfs_file_t* file,uint8_t* lineBuf,size_t bufSize,uint8_t* nofReadChars);
 
+#if McuLittleFS_CONFIG_POOL
+/*! Fixed-size pools of McuLittleFS_CONFIG_POOL */
+typedef enum {
+  McuLFS_Pool_Cache, /*!< file caches, allocated by lfs_file_open() through lfs_malloc() */
+  McuLFS_Pool_File,  /*!< lfs_file_t handles, McuLFS_FileAlloc() */
+  McuLFS_Pool_Dir,   /*!< lfs_dir_t handles, McuLFS_DirAlloc() */
+  McuLFS_Pool_NofPools
+} McuLFS_Pool_e;
+
+typedef struct {
+  uint16_t nofBlocks; /*!< number of blocks of the pool */
+  uint16_t nofUsed;   /*!< blocks allocated now */
+  uint16_t maxUsed;   /*!< high-water mark of nofUsed */
+  uint32_t nofFails;  /*!< allocations which failed because the pool was empty, or the block too small */
+} McuLFS_PoolStats_t;
+
+/* Handles from the pools, NULL if all are in use. Not thread safe, like the rest of McuLittleFS. */
+lfs_file_t *McuLFS_FileAlloc(void);
+void McuLFS_FileFree(lfs_file_t *file);
+lfs_dir_t *McuLFS_DirAlloc(void);
+void McuLFS_DirFree(lfs_dir_t *dir);
+
+void McuLFS_GetPoolStats(McuLFS_Pool_e pool, McuLFS_PoolStats_t *stats);
+/* prints usage and high-water mark of the pools */
+void McuLFS_PrintPoolStats(void);
+#endif
+
 /* Functions ported from FatFS (Used by MiniIni) */
 char* McuLFS_gets (char* buff,int len, lfs_file_t* fp);
 int McuLFS_puts (const char* str, lfs_file_t* fp);
@@ -9,10 +9,25 @@
 #include "McuFlash.h"
 #include "McuLittleFSconfig.h"
 #include "McuLittleFSBlockDevice.h"
+#include <stddef.h>
+#include <string.h>
+
+extern const uint8_t _image_end[]; /* end of the application image, from the linker script */
+
+static const McuLittleFS_PartitionEntry_t *McuLittleFS_partition; /* file system partition, NULL if none */
+static McuLittleFS_PartitionTable_t McuLittleFS_partitionTable;
+
+/* flash address of a block offset */
+static uint32_t McuLittleFS_BlockAddr(const struct lfs_config *c, lfs_block_t block, lfs_off_t off) {
+  return McuLittleFS_partition->start + block*c->block_size + off;
+}
 
 int McuLittleFS_block_device_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size) {
   uint8_t res;
-  res = McuFlash_Read((void*)((block+McuLittleFS_CONFIG_BLOCK_OFFSET) * c->block_size + off), buffer, size);
+  res = McuFlash_Read((void*)McuLittleFS_BlockAddr(c, block, off), buffer, size);
+  if (res == ERR_FAILED) {
+    return LFS_ERR_CORRUPT; /* a buffered page of the block failed to program after LittleFS had moved on */
+  }
   if (res != ERR_OK) {
 	  return LFS_ERR_IO;
   }
@@ -21,33 +36,223 @@ int McuLittleFS_block_device_read(const struct lfs_config *c, lfs_block_t block,
 
 int McuLittleFS_block_device_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size) {
   uint8_t res;
-  res = McuFlash_Program((void*)((block+McuLittleFS_CONFIG_BLOCK_OFFSET) * c->block_size + off), buffer, size);
+  res = McuFlash_Program((void*)McuLittleFS_BlockAddr(c, block, off), buffer, size);
   if (res != ERR_OK) {
-    return LFS_ERR_IO;
+    return LFS_ERR_CORRUPT; /* erase, program or verify failed: LittleFS relocates the data */
   }
   return LFS_ERR_OK;
 }
 
+static uint32_t McuLittleFS_nofEraseSkipped, McuLittleFS_nofErased; /* erase callback statistics */
+
+bool McuLittleFS_block_device_is_erased(const struct lfs_config *c, lfs_block_t block) {
+  return McuFlash_IsErased((void*)McuLittleFS_BlockAddr(c, block, 0), c->block_size);
+}
+
+void McuLittleFS_block_device_get_erase_stats(uint32_t *nofSkipped, uint32_t *nofErased) {
+  *nofSkipped = McuLittleFS_nofEraseSkipped;
+  *nofErased = McuLittleFS_nofErased;
+}
+
 int McuLittleFS_block_device_erase(const struct lfs_config *c, lfs_block_t block) {
   uint8_t res;
-  res = McuFlash_Erase((void*)((block+McuLittleFS_CONFIG_BLOCK_OFFSET) * c->block_size), c->block_size);
+  if (McuLittleFS_block_device_is_erased(c, block)) { /* pre-erased (McuLFS_PreErase()) or never used */
+    McuLittleFS_nofEraseSkipped++;
+    return LFS_ERR_OK;
+  }
+  McuLittleFS_nofErased++;
+  res = McuFlash_Erase((void*)McuLittleFS_BlockAddr(c, block, 0), c->block_size);
   if (res != ERR_OK) {
     return LFS_ERR_IO;
   }
   return LFS_ERR_OK;
 }
 
-int McuLittleFS_block_device_sync(const struct lfs_config *c) {
+int McuLittleFS_block_device_map(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, lfs_size_t size, const void **buffer) {
+  const void *p;
+  p = McuFlash_Map((void*)McuLittleFS_BlockAddr(c, block, off), size);
+  if (p == NULL) { /* erased or pending in the write buffer: needs to be read */
+    return LFS_ERR_INVAL;
+  }
+  *buffer = p;
+  return LFS_ERR_OK;
+}
 
-	return LFS_ERR_OK;
+int McuLittleFS_block_device_sync(const struct lfs_config *c) {
+  uint8_t res;
+  res = McuFlash_Flush(); /* program the page pending in the write buffer */
+  if (res != ERR_OK) {
+    return LFS_ERR_CORRUPT; /* like a failed prog */
+  }
+  return LFS_ERR_OK;
 }
 
 int McuLittleFS_block_device_deinit(void) {
+	McuFlash_Deinit();
 	return LFS_ERR_OK;
 }
 
+/* erases caused by one file written with the workload, in 1/1000 erases. 0 if the block size is not usable */
+static uint32_t McuLittleFS_EstimateErases(const McuLittleFS_Workload_t *workload, uint32_t blockSize) {
+  uint32_t erases = 0, commitBytes, inlineMax, pos, end;
+
+  if (blockSize<=2*workload->metadataSize) {
+    return 0; /* a metadata block would not hold the live metadata plus commits */
+  }
+  inlineMax = lfs_min(0x3fe, lfs_min(McuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE, blockSize/8));
+  commitBytes = 0;
+  for(pos=0; pos<workload->fileSize; pos=end) {
+    end = lfs_min(pos+workload->writeSize, workload->fileSize);
+    if (workload->fileSize<=inlineMax) {
+      commitBytes += end-pos; /* inlined into the metadata */
+    } else {
+      /* the blocks written get allocated, a partially filled tail block gets copied to a new one */
+      erases += 1000*((end-1)/blockSize-pos/blockSize+1);
+    }
+    commitBytes += workload->commitSize;
+  }
+  /* a compaction erases a metadata block and keeps the live metadata, the rest is space for commits */
+  erases += (uint32_t)(((uint64_t)commitBytes*1000)/(blockSize-workload->metadataSize));
+  return erases!=0 ? erases : 1;
+}
+
+lfs_size_t McuLittleFS_SelectBlockSize(const McuLittleFS_Workload_t *workload, uint32_t scratchAddr, uint32_t scratchSize) {
+  McuFlash_Geometry_t geometry;
+  uint32_t blockSize, erases, cycles, best = 0;
+  uint64_t cost, bestCost = 0;
+
+  if (McuFlash_GetGeometry(&geometry)!=ERR_OK || workload->writeSize==0) {
+    return 0;
+  }
+  for(blockSize=geometry.pageSize; blockSize<=geometry.sectorSize; blockSize*=2) {
+    if (blockSize*McuLittleFS_CONFIG_MIN_BLOCK_COUNT>scratchSize) {
+      break; /* not enough blocks */
+    }
+    if ((blockSize%McuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE)!=0) {
+      continue; /* littlefs needs a multiple of the cache size */
+    }
+    erases = McuLittleFS_EstimateErases(workload, blockSize);
+    if (erases==0) {
+      continue;
+    }
+    cycles = McuFlash_MeasureErase((void*)scratchAddr, blockSize);
+    if (cycles==0) {
+      return 0;
+    }
+    cost = (uint64_t)erases*cycles;
+    if (best==0 || cost<bestCost) {
+      best = blockSize;
+      bestCost = cost;
+    }
+  }
+  return best;
+}
+
+static uint32_t McuLittleFS_PartitionTableCrc(const McuLittleFS_PartitionTable_t *table) {
+  return lfs_crc(0xffffffff, table, offsetof(McuLittleFS_PartitionTable_t, crc));
+}
+
+/* creates the partition table for a new file system partition and writes it to tableAddr */
+static int McuLittleFS_CreatePartitionTable(const McuFlash_Geometry_t *geometry, uint32_t tableAddr, uint32_t imageEnd) {
+  McuLittleFS_PartitionTable_t *table = &McuLittleFS_partitionTable, check;
+  McuLittleFS_Workload_t workload;
+  uint32_t start, end, blockSize;
+
+  start = McuLittleFS_CONFIG_PARTITION_START;
+  if (start==0) { /* first sector after the application */
+    start = ((imageEnd+geometry->sectorSize-1)/geometry->sectorSize)*geometry->sectorSize;
+  }
+  end = tableAddr;
+  if (McuLittleFS_CONFIG_PARTITION_SIZE!=0) {
+    end = start+McuLittleFS_CONFIG_PARTITION_SIZE;
+  }
+  if (start<imageEnd || end>tableAddr || start>=end || (start%geometry->pageSize)!=0) {
+    return LFS_ERR_INVAL; /* overlaps the application or the partition table */
+  }
+  blockSize = McuLittleFS_CONFIG_BLOCK_SIZE;
+  if (blockSize==0) {
+    workload.fileSize = McuLittleFS_CONFIG_WORKLOAD_FILE_SIZE;
+    workload.writeSize = McuLittleFS_CONFIG_WORKLOAD_WRITE_SIZE;
+    workload.commitSize = McuLittleFS_CONFIG_WORKLOAD_COMMIT_SIZE;
+    workload.metadataSize = McuLittleFS_CONFIG_WORKLOAD_METADATA_SIZE;
+    if (!McuFlash_IsErased((void*)start, lfs_min(geometry->sectorSize, end-start))) {
+      return LFS_ERR_CORRUPT; /* the measurement erases the scratch area: it must not hold data */
+    }
+    blockSize = McuLittleFS_SelectBlockSize(&workload, start, end-start);
+  }
+  if (blockSize==0 || (blockSize%geometry->pageSize)!=0 || (end-start)<blockSize) {
+    return LFS_ERR_INVAL;
+  }
+  memset(table, 0, sizeof(*table));
+  table->magic = McuLittleFS_PARTITION_MAGIC;
+  table->version = McuLittleFS_PARTITION_VERSION;
+  table->entries[0].type = McuLittleFS_PartitionType_Application;
+  table->entries[0].start = geometry->base;
+  table->entries[0].size = imageEnd-geometry->base;
+  table->entries[1].type = McuLittleFS_PartitionType_LittleFS;
+  table->entries[1].start = start;
+  table->entries[1].size = ((end-start)/blockSize)*blockSize;
+  table->entries[1].blockSize = blockSize;
+  table->crc = McuLittleFS_PartitionTableCrc(table);
+  if (   McuFlash_Program((void*)tableAddr, table, sizeof(*table))!=ERR_OK || McuFlash_Flush()!=ERR_OK
+      || McuFlash_Read((void*)tableAddr, &check, sizeof(check))!=ERR_OK /* not verified by McuFlash_Verify_LittleFS */
+      || memcmp(&check, table, sizeof(check))!=0)
+  {
+    return LFS_ERR_IO;
+  }
+  return LFS_ERR_OK;
+}
+
+/* loads the partition table, or creates it on the first boot, and checks the file system partition. A table
+ * which cannot be read or is not valid is an error: creating a new one could erase an existing file system. */
+static int McuLittleFS_LoadPartition(void) {
+  McuLittleFS_PartitionTable_t *table = &McuLittleFS_partitionTable;
+  const McuLittleFS_PartitionEntry_t *entry = NULL;
+  McuFlash_Geometry_t geometry;
+  uint32_t tableAddr, imageEnd;
+  int res;
+
+  if (McuFlash_GetGeometry(&geometry)!=ERR_OK) {
+    return LFS_ERR_IO;
+  }
+  tableAddr = geometry.base+geometry.totalSize-geometry.pageSize; /* last page of the program flash */
+  imageEnd = McuLittleFS_CONFIG_IMAGE_END;
+  if (McuFlash_IsErased((void*)tableAddr, geometry.pageSize)) { /* blank device, the first boot */
+    res = McuLittleFS_CreatePartitionTable(&geometry, tableAddr, imageEnd);
+    if (res!=LFS_ERR_OK) {
+      return res;
+    }
+  } else if (   McuFlash_Read((void*)tableAddr, table, sizeof(*table))!=ERR_OK
+             || table->magic!=McuLittleFS_PARTITION_MAGIC
+             || table->version!=McuLittleFS_PARTITION_VERSION
+             || table->crc!=McuLittleFS_PartitionTableCrc(table))
+  {
+    return LFS_ERR_CORRUPT;
+  }
+  for(int i=0; i<McuLittleFS_PARTITION_NOF_ENTRIES; i++) {
+    if (table->entries[i].type==McuLittleFS_PartitionType_LittleFS) {
+      entry = &table->entries[i];
+      break;
+    }
+  }
+  if (   entry==NULL
+      || entry->start<imageEnd /* application has grown into the file system */
+      || entry->start+entry->size>tableAddr
+      || entry->blockSize==0 || (entry->blockSize%geometry.pageSize)!=0 || (entry->size%entry->blockSize)!=0)
+  {
+    return LFS_ERR_CORRUPT;
+  }
+  McuLittleFS_partition = entry;
+  return LFS_ERR_OK;
+}
+
+const McuLittleFS_PartitionEntry_t *McuLittleFS_block_device_get_partition(void) {
+  return McuLittleFS_partition;
+}
+
 int McuLittleFS_block_device_init(void) {
 
 	McuFlash_Init();
-	return LFS_ERR_OK;
+	McuLittleFS_partition = NULL;
+	return McuLittleFS_LoadPartition();
 }
@@ -10,20 +10,74 @@
 
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "lfs.h"
 
 
 
+#define McuLittleFS_PARTITION_MAGIC          (0x5450464C) /* "LFPT" */
+#define McuLittleFS_PARTITION_VERSION        (1)
+
+typedef enum {
+  McuLittleFS_PartitionType_Unused,
+  McuLittleFS_PartitionType_Application, /* application image, the file system must not overlap it */
+  McuLittleFS_PartitionType_LittleFS,    /* file system blocks */
+} McuLittleFS_PartitionType_e;
+
+typedef struct {
+  uint32_t type;       /* McuLittleFS_PartitionType_e */
+  uint32_t start;      /* flash address */
+  uint32_t size;       /* size in bytes */
+  uint32_t blockSize;  /* block size of the file system, 0 for the other types */
+} McuLittleFS_PartitionEntry_t;
+
+#define McuLittleFS_PARTITION_NOF_ENTRIES    (2)
+
+/* partition table, stored in the last page of the program flash */
+typedef struct {
+  uint32_t magic;      /* McuLittleFS_PARTITION_MAGIC */
+  uint32_t version;    /* McuLittleFS_PARTITION_VERSION */
+  McuLittleFS_PartitionEntry_t entries[McuLittleFS_PARTITION_NOF_ENTRIES];
+  uint32_t crc;        /* lfs_crc() over the fields above */
+} McuLittleFS_PartitionTable_t;
+
+/* workload profile for McuLittleFS_SelectBlockSize() */
+typedef struct {
+  uint32_t fileSize;     /* typical size of a file */
+  uint32_t writeSize;    /* bytes appended to a file before it gets synced or closed */
+  uint32_t commitSize;   /* metadata bytes committed for each sync or close */
+  uint32_t metadataSize; /* live metadata of a directory, copied with each compaction */
+} McuLittleFS_Workload_t;
+
+/* Selects the block size (a multiple of the page size) with the least erase time for the workload: the erase
+ * amplification of each candidate is estimated with a model of littlefs appends and metadata compactions and
+ * weighted with the erase time measured on the scratch area. Erases the scratch area! Returns 0 on error. */
+lfs_size_t McuLittleFS_SelectBlockSize(const McuLittleFS_Workload_t *workload, uint32_t scratchAddr, uint32_t scratchSize);
+
+/* returns the file system partition, NULL if there is none */
+const McuLittleFS_PartitionEntry_t *McuLittleFS_block_device_get_partition(void);
+
 int McuLittleFS_block_device_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size);
 
 int McuLittleFS_block_device_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size);
 
 int McuLittleFS_block_device_erase(const struct lfs_config *c, lfs_block_t block);
 
+int McuLittleFS_block_device_map(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, lfs_size_t size, const void **buffer);
+
+/* true if the block is erased, then the erase callback returns right away */
+bool McuLittleFS_block_device_is_erased(const struct lfs_config *c, lfs_block_t block);
+
+/* number of erase callbacks which found the block already erased, and the ones which had to erase it */
+void McuLittleFS_block_device_get_erase_stats(uint32_t *nofSkipped, uint32_t *nofErased);
+
 int McuLittleFS_block_device_sync(const struct lfs_config *c);
 
 int McuLittleFS_block_device_deinit(void);
 
+/* Loads the partition table. A blank device gets a new table, with McuLittleFS_CONFIG_BLOCK_SIZE 0 the block size gets
+ * selected on the still erased partition. Returns LFS_ERR_CORRUPT for a damaged table or if the partition area is not
+ * erased on the first boot: the flash is left as it is then. */
 int McuLittleFS_block_device_init(void);
 
 #endif /* MCULITTLEFSBLOCKDEVICE_H_ */
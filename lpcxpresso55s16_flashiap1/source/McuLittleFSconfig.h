@@ -9,18 +9,59 @@
 #define MCULITTLEFSCONFIG_H_
 
 #ifndef McuLittleFS_CONFIG_BLOCK_SIZE
-  #define McuLittleFS_CONFIG_BLOCK_SIZE    (4096)
-    /*!< standard block size. Needs to match flash device block size*/
+  #define McuLittleFS_CONFIG_BLOCK_SIZE    (0)
+    /*!< block size, multiple of the flash page size. 0: selected with McuLittleFS_SelectBlockSize() for the workload below
+         when the partition gets created. An existing partition keeps the block size stored in its partition table */
 #endif
 
 #ifndef McuLittleFS_CONFIG_BLOCK_COUNT
-  #define McuLittleFS_CONFIG_BLOCK_COUNT    (16384) /* 16384 * 4K = 64 MByte */
-    /*!< number of blocks used for the file system */
+  #define McuLittleFS_CONFIG_BLOCK_COUNT    (0)
+    /*!< number of blocks used for the file system. 0: all blocks which fit into the partition, more than that is rejected */
 #endif
 
-#ifndef McuLittleFS_CONFIG_BLOCK_OFFSET
-  #define McuLittleFS_CONFIG_BLOCK_OFFSET    (0)
-    /*!< block offset number for the block device */
+#ifndef McuLittleFS_CONFIG_PARTITION_START
+  #define McuLittleFS_CONFIG_PARTITION_START    (0)
+    /*!< flash address of the file system partition. 0: first sector after the application image */
+#endif
+
+#ifndef McuLittleFS_CONFIG_PARTITION_SIZE
+  #define McuLittleFS_CONFIG_PARTITION_SIZE    (0)
+    /*!< size of the file system partition in bytes. 0: up to the partition table in the last page of the program flash */
+#endif
+
+#ifndef McuLittleFS_CONFIG_IMAGE_END
+  #define McuLittleFS_CONFIG_IMAGE_END    ((uint32_t)_image_end)
+    /*!< end address of the application image, _image_end is provided by the MCUXpresso managed linker script */
+#endif
+
+#ifndef McuLittleFS_CONFIG_PREERASE_POOL_SIZE
+  #define McuLittleFS_CONFIG_PREERASE_POOL_SIZE    (4)
+    /*!< number of free blocks ahead of the allocator McuLFS_PreErase() keeps erased. 0: no pre-erase pool */
+#endif
+
+#ifndef McuLittleFS_CONFIG_MIN_BLOCK_COUNT
+  #define McuLittleFS_CONFIG_MIN_BLOCK_COUNT    (16)
+    /*!< McuLittleFS_SelectBlockSize() only considers block sizes which give at least that many blocks */
+#endif
+
+#ifndef McuLittleFS_CONFIG_WORKLOAD_FILE_SIZE
+  #define McuLittleFS_CONFIG_WORKLOAD_FILE_SIZE    (4096)
+    /*!< workload profile for the block size selection: typical size of a file */
+#endif
+
+#ifndef McuLittleFS_CONFIG_WORKLOAD_WRITE_SIZE
+  #define McuLittleFS_CONFIG_WORKLOAD_WRITE_SIZE    (128)
+    /*!< workload profile: bytes appended to a file before it gets synced or closed */
+#endif
+
+#ifndef McuLittleFS_CONFIG_WORKLOAD_COMMIT_SIZE
+  #define McuLittleFS_CONFIG_WORKLOAD_COMMIT_SIZE    (48)
+    /*!< workload profile: metadata bytes committed for each sync or close */
+#endif
+
+#ifndef McuLittleFS_CONFIG_WORKLOAD_METADATA_SIZE
+  #define McuLittleFS_CONFIG_WORKLOAD_METADATA_SIZE    (512)
+    /*!< workload profile: live metadata of a directory, copied with each compaction */
 #endif
 
 #ifndef McuLittleFS_CONFIG_FILE_NAME_SIZE
@@ -34,6 +75,8 @@
 
 #ifndef McuLittleFS_CONFIG_FILESYSTEM_PROG_BUFFER_SIZE
   #define McuLittleFS_CONFIG_FILESYSTEM_PROG_BUFFER_SIZE    (256)
+    /*!< below the flash page size (512) McuFlash erases a page again to program its second part: a power loss
+         right after that erase loses the commit in the first part. Use the page size where this matters */
 #endif
 
 #ifndef McuLittleFS_CONFIG_FILESYSTEM_LOOKAHEAD_SIZE
@@ -44,4 +87,47 @@
   #define McuLittleFS_CONFIG_FILESYSTEM_CACHE_SIZE          (256)
 #endif
 
+#ifndef McuLittleFS_CONFIG_FILESYSTEM_METADATA_MAX
+  #define McuLittleFS_CONFIG_FILESYSTEM_METADATA_MAX        (0)
+    /*!< space in bytes a metadata pair uses of each of its blocks, bounds the time of a compaction. 0: block size */
+#endif
+
+#ifndef McuLittleFS_CONFIG_FILESYSTEM_COMPACT_THRESH
+  #define McuLittleFS_CONFIG_FILESYSTEM_COMPACT_THRESH      (0)
+    /*!< metadata logs above this size in bytes get compacted by the next commit instead of when full, and by lfs_fs_gc(). 0: only full logs get compacted by commits, -1: lfs_fs_gc() does not compact */
+#endif
+
+#ifndef McuLittleFS_CONFIG_BLOCK_DEVICE_MAP
+  #define McuLittleFS_CONFIG_BLOCK_DEVICE_MAP               (1)
+    /*!< 1: programmed flash gets read in place through the block device map operation instead of copying it through the caches */
+#endif
+
+#ifndef McuLittleFS_CONFIG_POOL
+  #define McuLittleFS_CONFIG_POOL                           (1)
+    /*!< 1: the littlefs buffers are static, file caches come from a fixed-size pool through lfs_malloc(), and McuLFS_FileAlloc()/McuLFS_DirAlloc()
+         provide the handles. 0: lfs_malloc() uses the heap */
+#endif
+
+#ifndef McuLittleFS_CONFIG_POOL_NOF_FILES
+  #define McuLittleFS_CONFIG_POOL_NOF_FILES                 (4)
+    /*!< McuLittleFS_CONFIG_POOL: number of files which can be open at the same time, at least 1 */
+#endif
+
+#ifndef McuLittleFS_CONFIG_POOL_NOF_DIRS
+  #define McuLittleFS_CONFIG_POOL_NOF_DIRS                  (2)
+    /*!< McuLittleFS_CONFIG_POOL: number of lfs_dir_t handles McuLFS_DirAlloc() provides, at least 1 */
+#endif
+
+#ifndef McuLittleFS_CONFIG_CHECKPOINT
+  #define McuLittleFS_CONFIG_CHECKPOINT                     (1)
+    /*!< 1: the file system of this firmware uses the mount checkpoint of LFS_CHECKPOINT, which sets LFS_CHECKPOINT unless it is defined.
+         Only for a volume which is never written by a littlefs without it */
+#endif
+
+#ifndef McuLittleFS_CONFIG_LAZY_MOUNT
+  #define McuLittleFS_CONFIG_LAZY_MOUNT                     (1)
+    /*!< 1: McuLFS_MountLazy() only notes the mount, it is done by the first McuLFS_* call which needs the file system, or by the
+         McuLFS_Gc() and McuLFS_PreErase() idle hooks, whatever comes first. 0: McuLFS_MountLazy() mounts right away */
+#endif
+
 #endif /* MCULITTLEFSCONFIG_H_ */
@@ -7,6 +7,7 @@
  */
 #include "lfs.h"
 #include "lfs_util.h"
+#include <stddef.h> // offsetof << EST
 
 #include "lfs_config.h" /* << EST */
 #if LITTLEFS_CONFIG_ENABLED /* << EST */
@@ -35,19 +36,90 @@ static inline void lfs_cache_drop(lfs_t *lfs, lfs_cache_t *rcache) {
     // written with identical data (during relocates)
     (void)lfs;
     rcache->block = LFS_BLOCK_NULL;
+#if LFS_RCACHE_WAYS > 1 /* << EST */
+    // the other read cache entries could hold the same data
+    if (rcache == &lfs->rcache) {
+        for (int i = 0; i < LFS_RCACHE_WAYS-1; i++) {
+            lfs->rcache_ways[i].block = LFS_BLOCK_NULL;
+        }
+    }
+#endif
 }
 
+#if LFS_RCACHE_WAYS > 1 /* << EST */
+// find a read cache entry besides rcache which holds off
+static lfs_cache_t *lfs_rcache_find(lfs_t *lfs,
+        lfs_block_t block, lfs_off_t off) {
+    for (int i = 0; i < LFS_RCACHE_WAYS-1; i++) {
+        lfs_cache_t *way = &lfs->rcache_ways[i];
+        if (block == way->block &&
+                off >= way->off && off < way->off + way->size) {
+            lfs->rcache_used[i+1] = ++lfs->rcache_tick;
+            return way;
+        }
+    }
+
+    return NULL;
+}
+
+// read cache entry to load next: an unused one, else the least recently
+// used one
+static lfs_cache_t *lfs_rcache_victim(lfs_t *lfs) {
+    int victim = 0;
+    for (int i = 0; i < LFS_RCACHE_WAYS; i++) {
+        lfs_cache_t *way = (i == 0) ? &lfs->rcache : &lfs->rcache_ways[i-1];
+        if (way->block == LFS_BLOCK_NULL) {
+            victim = i;
+            break;
+        }
+
+        if (lfs->rcache_tick - lfs->rcache_used[i] >
+                lfs->rcache_tick - lfs->rcache_used[victim]) {
+            victim = i;
+        }
+    }
+
+    lfs->rcache_used[victim] = ++lfs->rcache_tick;
+    return (victim == 0) ? &lfs->rcache : &lfs->rcache_ways[victim-1];
+}
+#endif
+
 static inline void lfs_cache_zero(lfs_t *lfs, lfs_cache_t *pcache) {
     // zero to avoid information leak
     memset(pcache->buffer, 0xff, lfs->cfg->cache_size);
     pcache->block = LFS_BLOCK_NULL;
 }
 
+// read in place, returns NULL if the region is not mapped or the pcache
+// holds newer data for it << EST
+static const uint8_t *lfs_bd_map(lfs_t *lfs,
+        const lfs_cache_t *pcache, lfs_block_t block, lfs_off_t off,
+        lfs_size_t size) {
+    const void *buffer;
+    if (!lfs->cfg->map || block >= lfs->cfg->block_count ||
+            off+size > lfs->cfg->block_size) {
+        return NULL;
+    }
+
+    if (pcache && block == pcache->block &&
+            off < pcache->off + pcache->size &&
+            off + size > pcache->off) {
+        return NULL;
+    }
+
+    if (lfs->cfg->map(lfs->cfg, block, off, size, &buffer)) {
+        return NULL;
+    }
+
+    return buffer;
+}
+
 static int lfs_bd_read(lfs_t *lfs,
         const lfs_cache_t *pcache, lfs_cache_t *rcache, lfs_size_t hint,
         lfs_block_t block, lfs_off_t off,
         void *buffer, lfs_size_t size) {
     uint8_t *data = buffer;
+    bool cached = false, loaded = false; /* << EST */
     if (block >= lfs->cfg->block_count ||
             off+size > lfs->cfg->block_size) {
         return LFS_ERR_CORRUPT;
@@ -80,6 +152,13 @@ static int lfs_bd_read(lfs_t *lfs,
                 diff = lfs_min(diff, rcache->size - (off-rcache->off));
                 memcpy(data, &rcache->buffer[off-rcache->off], diff);
 
+#if LFS_RCACHE_WAYS > 1 /* << EST */
+                if (rcache == &lfs->rcache) {
+                    lfs->rcache_used[0] = ++lfs->rcache_tick;
+                }
+#endif
+                cached = true; /* << EST */
+
                 data += diff;
                 off += diff;
                 size -= diff;
@@ -90,6 +169,34 @@ static int lfs_bd_read(lfs_t *lfs,
             diff = lfs_min(diff, rcache->off-off);
         }
 
+#if LFS_RCACHE_WAYS > 1 /* << EST */
+        if (rcache == &lfs->rcache) {
+            // in one of the other read cache entries?
+            const lfs_cache_t *way = lfs_rcache_find(lfs, block, off);
+            if (way) {
+                diff = lfs_min(diff, way->size - (off-way->off));
+                memcpy(data, &way->buffer[off-way->off], diff);
+                cached = true;
+
+                data += diff;
+                off += diff;
+                size -= diff;
+                continue;
+            }
+        }
+#endif
+
+        // mapped? read in place, the rcache is not needed << EST
+        const uint8_t *mapped = lfs_bd_map(lfs, NULL, block, off, diff);
+        if (mapped) {
+            memcpy(data, mapped, diff);
+
+            data += diff;
+            off += diff;
+            size -= diff;
+            continue;
+        }
+
         if (size >= hint && off % lfs->cfg->read_size == 0 &&
                 size >= lfs->cfg->read_size) {
             // bypass cache?
@@ -107,22 +214,37 @@ static int lfs_bd_read(lfs_t *lfs,
 
         // load to cache, first condition can no longer fail
         LFS_ASSERT(block < lfs->cfg->block_count);
-        rcache->block = block;
-        rcache->off = lfs_aligndown(off, lfs->cfg->read_size);
-        rcache->size = lfs_min(
+        lfs_cache_t *load = rcache; /* << EST */
+        loaded = true;
+        if (rcache == &lfs->rcache) {
+            lfs->rcache_misses += 1;
+#if LFS_RCACHE_WAYS > 1
+            load = lfs_rcache_victim(lfs);
+#endif
+        }
+        load->block = block;
+        load->off = lfs_aligndown(off, lfs->cfg->read_size);
+        load->size = lfs_min(
                 lfs_min(
                     lfs_alignup(off+hint, lfs->cfg->read_size),
                     lfs->cfg->block_size)
-                - rcache->off,
+                - load->off,
                 lfs->cfg->cache_size);
-        int err = lfs->cfg->read(lfs->cfg, rcache->block,
-                rcache->off, rcache->buffer, rcache->size);
+        int err = lfs->cfg->read(lfs->cfg, load->block,
+                load->off, load->buffer, load->size);
         LFS_ASSERT(err <= 0);
         if (err) {
+            // don't keep a partial load << EST
+            load->block = LFS_BLOCK_NULL;
             return err;
         }
     }
 
+    // count reads served by the read cache without loading it << EST
+    if (rcache == &lfs->rcache && cached && !loaded) {
+        lfs->rcache_hits += 1;
+    }
+
     return 0;
 }
 
@@ -133,6 +255,17 @@ static int lfs_bd_cmp(lfs_t *lfs,
     const uint8_t *data = buffer;
     lfs_size_t diff = 0;
 
+    // mapped? compare in place << EST
+    const uint8_t *mapped = lfs_bd_map(lfs, pcache, block, off, size);
+    if (mapped) {
+        int res = memcmp(mapped, data, size);
+        if (res) {
+            return res < 0 ? LFS_CMP_LT : LFS_CMP_GT;
+        }
+
+        return LFS_CMP_EQ;
+    }
+
     for (lfs_off_t i = 0; i < size; i += diff) {
         uint8_t dat[8];
 
@@ -153,34 +286,55 @@ static int lfs_bd_cmp(lfs_t *lfs,
     return LFS_CMP_EQ;
 }
 
+#ifndef LFS_READONLY
+// program prog_size aligned data and check it on disk if asked to, for the
+// pcache and for data programmed without it << EST
+static int lfs_bd_progvalid(lfs_t *lfs, lfs_cache_t *rcache, bool validate,
+        lfs_block_t block, lfs_off_t off,
+        const void *buffer, lfs_size_t size) {
+#if defined(LFS_THREADSAFE) && LFS_READERS > 0
+    // read caches of the readers become stale
+    lfs->wgen += 1;
+#endif
+    int err = lfs->cfg->prog(lfs->cfg, block, off, buffer, size);
+    LFS_ASSERT(err <= 0);
+    if (err) {
+        return err;
+    }
+
+    if (validate) {
+        // check data on disk, a block device which buffers it returns the
+        // buffered data and checks it when it programs it, see
+        // lfs_file_flush << EST
+        lfs_cache_drop(lfs, rcache);
+        int res = lfs_bd_cmp(lfs,
+                NULL, rcache, size,
+                block, off, buffer, size);
+        if (res < 0) {
+            return res;
+        }
+
+        if (res != LFS_CMP_EQ) {
+            return LFS_ERR_CORRUPT;
+        }
+    }
+
+    return 0;
+}
+#endif
+
 #ifndef LFS_READONLY
 static int lfs_bd_flush(lfs_t *lfs,
         lfs_cache_t *pcache, lfs_cache_t *rcache, bool validate) {
     if (pcache->block != LFS_BLOCK_NULL && pcache->block != LFS_BLOCK_INLINE) {
         LFS_ASSERT(pcache->block < lfs->cfg->block_count);
         lfs_size_t diff = lfs_alignup(pcache->size, lfs->cfg->prog_size);
-        int err = lfs->cfg->prog(lfs->cfg, pcache->block,
-                pcache->off, pcache->buffer, diff);
-        LFS_ASSERT(err <= 0);
+        int err = lfs_bd_progvalid(lfs, rcache, validate, /* << EST */
+                pcache->block, pcache->off, pcache->buffer, diff);
         if (err) {
             return err;
         }
 
-        if (validate) {
-            // check data on disk
-            lfs_cache_drop(lfs, rcache);
-            int res = lfs_bd_cmp(lfs,
-                    NULL, rcache, diff,
-                    pcache->block, pcache->off, pcache->buffer, diff);
-            if (res < 0) {
-                return res;
-            }
-
-            if (res != LFS_CMP_EQ) {
-                return LFS_ERR_CORRUPT;
-            }
-        }
-
         lfs_cache_zero(lfs, pcache);
     }
 
@@ -242,6 +396,24 @@ static int lfs_bd_prog(lfs_t *lfs,
         // entire block or manually flushing the pcache
         LFS_ASSERT(pcache->block == LFS_BLOCK_NULL);
 
+        // at least a full cache of aligned data? program it directly from
+        // the buffer, without copying it through the pcache << EST
+        if (block != LFS_BLOCK_INLINE &&
+                off % lfs->cfg->prog_size == 0 &&
+                size >= lfs->cfg->cache_size) {
+            lfs_size_t diff = lfs_aligndown(size, lfs->cfg->prog_size);
+            int err = lfs_bd_progvalid(lfs, rcache, validate,
+                    block, off, data, diff);
+            if (err) {
+                return err;
+            }
+
+            data += diff;
+            off += diff;
+            size -= diff;
+            continue;
+        }
+
         // prepare pcache, first condition can no longer fail
         pcache->block = block;
         pcache->off = lfs_aligndown(off, lfs->cfg->prog_size);
@@ -255,6 +427,26 @@ static int lfs_bd_prog(lfs_t *lfs,
 #ifndef LFS_READONLY
 static int lfs_bd_erase(lfs_t *lfs, lfs_block_t block) {
     LFS_ASSERT(block < lfs->cfg->block_count);
+#if LFS_RCACHE_WAYS > 1 /* << EST */
+    // read cache entries of the block become stale
+    for (int i = 0; i < LFS_RCACHE_WAYS-1; i++) {
+        if (lfs->rcache_ways[i].block == block) {
+            lfs_cache_drop(lfs, &lfs->rcache_ways[i]);
+        }
+    }
+#endif
+#if LFS_FCACHE_SIZE > 0 /* << EST */
+    // validated commits of the block are gone
+    for (int i = 0; i < LFS_FCACHE_SIZE; i++) {
+        if (lfs->fcache[i].pair[0] == block ||
+                lfs->fcache[i].pair[1] == block) {
+            lfs->fcache[i].pair[0] = LFS_BLOCK_NULL;
+        }
+    }
+#endif
+#if defined(LFS_THREADSAFE) && LFS_READERS > 0 /* << EST */
+    lfs->wgen += 1;
+#endif
     int err = lfs->cfg->erase(lfs->cfg, block);
     LFS_ASSERT(err <= 0);
     return err;
@@ -500,6 +692,9 @@ static int lfs_fs_pred(lfs_t *lfs, const lfs_block_t dir[2],
 static lfs_stag_t lfs_fs_parent(lfs_t *lfs, const lfs_block_t dir[2],
         lfs_mdir_t *parent);
 static int lfs_fs_forceconsistency(lfs_t *lfs);
+#if LFS_CHECKPOINT /* << EST */
+static int lfs_fs_dropcheckpoint(lfs_t *lfs);
+#endif
 #endif
 
 #ifdef LFS_MIGRATE
@@ -517,6 +712,9 @@ static int lfs_file_rawclose(lfs_t *lfs, lfs_file_t *file);
 static lfs_soff_t lfs_file_rawsize(lfs_t *lfs, lfs_file_t *file);
 
 static lfs_ssize_t lfs_fs_rawsize(lfs_t *lfs);
+#if !LFS_USEDCOUNT || !defined(LFS_READONLY) /* << EST */
+static lfs_ssize_t lfs_fs_traversesize(lfs_t *lfs);
+#endif
 static int lfs_fs_rawtraverse(lfs_t *lfs,
         int (*cb)(void *data, lfs_block_t block), void *data,
         bool includeorphans);
@@ -526,7 +724,7 @@ static int lfs_rawunmount(lfs_t *lfs);
 
 
 /// Block allocator ///
-#ifndef LFS_READONLY
+#if !defined(LFS_READONLY) && !LFS_FREEMAP /* << EST */
 static int lfs_alloc_lookahead(void *p, lfs_block_t block) {
     lfs_t *lfs = (lfs_t*)p;
     lfs_block_t off = ((block - lfs->free.off)
@@ -545,6 +743,14 @@ static int lfs_alloc_lookahead(void *p, lfs_block_t block) {
 // commit operation
 static void lfs_alloc_ack(lfs_t *lfs) {
     lfs->free.ack = lfs->cfg->block_count;
+#if LFS_FREEMAP /* << EST */
+    if (lfs->free.nflight > 0) {
+        memset(lfs->free.inflight, 0,
+                4*((lfs->cfg->block_count+31)/32));
+        lfs->free.nflight = 0;
+    }
+    lfs->free.built = false;
+#endif
 }
 
 // drop the lookahead buffer, this is done during mounting and failed
@@ -552,32 +758,207 @@ static void lfs_alloc_ack(lfs_t *lfs) {
 static void lfs_alloc_drop(lfs_t *lfs) {
     lfs->free.size = 0;
     lfs->free.i = 0;
+#if LFS_FREEMAP /* << EST */
+    lfs->free.valid = false;
+#endif
     lfs_alloc_ack(lfs);
 }
 
+#if !defined(LFS_READONLY) && LFS_FREEMAP /* << EST */
+static int lfs_alloc_mapused(void *p, lfs_block_t block) {
+    lfs_t *lfs = (lfs_t*)p;
+    if (block < lfs->cfg->block_count) {
+        lfs->free.map[block / 32] |= 1U << (block % 32);
+    }
+
+    return 0;
+}
+
+// build the map of used blocks with a traversal, blocks allocated since the
+// last ack are not referenced by the tree yet and stay in use
+static int lfs_alloc_mapbuild(lfs_t *lfs) {
+    memcpy(lfs->free.map, lfs->free.inflight,
+            4*((lfs->cfg->block_count+31)/32));
+    int err = lfs_fs_rawtraverse(lfs, lfs_alloc_mapused, lfs, true);
+    if (err) {
+        lfs_alloc_drop(lfs);
+        return err;
+    }
+
+    lfs->free.valid = true;
+    lfs->free.built = true;
+    return 0;
+}
+
+// a block is no longer referenced after a committed change, so it can be
+// allocated again without a traversal
+static int lfs_alloc_release(void *p, lfs_block_t block) {
+    lfs_t *lfs = (lfs_t*)p;
+    if (lfs->free.valid && block < lfs->cfg->block_count) {
+        lfs->free.map[block / 32] &= ~(1U << (block % 32));
+    }
+
+    return 0;
+}
+
+#if LFS_ALLOC_RESERVE > 0
+// entry of a reserved block, -1 if the block is not reserved
+static int lfs_alloc_findreserved(lfs_t *lfs, lfs_block_t block) {
+    for (int i = 0; i < LFS_ALLOC_RESERVE; i++) {
+        if (lfs->free.reserved[i] == block) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// keep block free for a file which ended in the block before, replacing
+// the reservation of old if there is one
+static void lfs_alloc_reserve(lfs_t *lfs, lfs_block_t old,
+        lfs_block_t block) {
+    int i = lfs_alloc_findreserved(lfs, old);
+    if (i < 0) {
+        i = lfs->free.nextreserved;
+        lfs->free.nextreserved = (i + 1) % LFS_ALLOC_RESERVE;
+    }
+
+    lfs->free.reserved[i] = block;
+}
+
+// drop all reservations, returns true if there were any
+static bool lfs_alloc_unreserve(lfs_t *lfs) {
+    bool reserved = false;
+    for (int i = 0; i < LFS_ALLOC_RESERVE; i++) {
+        reserved = reserved || lfs->free.reserved[i] != LFS_BLOCK_NULL;
+        lfs->free.reserved[i] = LFS_BLOCK_NULL;
+    }
+
+    return reserved;
+}
+#endif
+#endif
+
+#if !defined(LFS_READONLY) && !LFS_FREEMAP /* << EST */
+// move the lookahead window to the next blocks and find the free ones
+static int lfs_alloc_scan(lfs_t *lfs) {
+    lfs->free.off = (lfs->free.off + lfs->free.size)
+            % lfs->cfg->block_count;
+    lfs->free.size = lfs_min(8*lfs->cfg->lookahead_size, lfs->free.ack);
+    lfs->free.i = 0;
+
+    // find mask of free blocks from tree
+    memset(lfs->free.buffer, 0, lfs->cfg->lookahead_size);
+    int err = lfs_fs_rawtraverse(lfs, lfs_alloc_lookahead, lfs, true);
+    if (err) {
+        lfs_alloc_drop(lfs);
+        return err;
+    }
+
+    return 0;
+}
+#endif
+
 #ifndef LFS_READONLY
+// first clear bit of bits in [i, end), end if there is none, looks at a
+// word at a time << EST
+static lfs_block_t lfs_alloc_findfree(const uint32_t *bits,
+        lfs_block_t i, lfs_block_t end) {
+    while (i < end) {
+        uint32_t free = ~bits[i / 32] & (0xffffffff << (i % 32));
+        if (free) {
+            return lfs_min(i - i % 32 + lfs_ctz(free), end);
+        }
+
+        i = i - i % 32 + 32;
+    }
+
+    return end;
+}
+
 static int lfs_alloc(lfs_t *lfs, lfs_block_t *block) {
+#if LFS_FREEMAP /* << EST */
+    while (true) {
+        if (!lfs->free.valid) {
+            int err = lfs_alloc_mapbuild(lfs);
+            if (err) {
+                return err;
+            }
+        }
+
+        // continue where the last allocation stopped, this distributes
+        // allocations across the device as the lookahead does
+        while (lfs->free.ack > 0) {
+            lfs_block_t off = lfs->free.off;
+            lfs_block_t end = lfs_min(lfs->cfg->block_count,
+                    off + lfs->free.ack);
+            lfs_block_t found = lfs_alloc_findfree(lfs->free.map, off, end);
+            lfs_block_t n = (found < end) ? found+1 - off : end - off;
+            lfs->free.off = (off+n == lfs->cfg->block_count) ? 0 : off+n;
+            lfs->free.ack -= n;
+
+            if (found < end) {
+#if LFS_ALLOC_RESERVE > 0 /* << EST */
+                if (lfs_alloc_findreserved(lfs, found) >= 0) {
+                    // kept for a file to grow into
+                    continue;
+                }
+#endif
+                // found a free block
+                lfs->free.map[found / 32] |= 1U << (found % 32);
+                lfs->free.inflight[found / 32] |= 1U << (found % 32);
+                lfs->free.nflight += 1;
+                *block = found;
+                return 0;
+            }
+        }
+
+        // check if the map is already up to date
+        if (lfs->free.built) {
+#if LFS_ALLOC_RESERVE > 0 /* << EST */
+            // only reserved blocks left? hand them out too
+            if (lfs_alloc_unreserve(lfs)) {
+                lfs->free.ack = lfs->cfg->block_count;
+                continue;
+            }
+#endif
+            LFS_ERROR("No more free space %"PRIu32, lfs->free.off);
+            return LFS_ERR_NOSPC;
+        }
+
+        // not every released block is tracked (e.g. replaced CTZ lists or
+        // relocated metadata pairs), find them with a traversal, the
+        // blocks in flight are kept in use so all blocks can be looked at
+        // again
+        lfs->free.valid = false;
+        lfs->free.ack = lfs->cfg->block_count;
+    }
+#else
     while (true) {
         while (lfs->free.i != lfs->free.size) {
-            lfs_block_t off = lfs->free.i;
+            // skip the blocks in use a word at a time << EST
+            lfs_block_t off = lfs_alloc_findfree(lfs->free.buffer,
+                    lfs->free.i, lfs->free.size);
+            lfs->free.ack -= off - lfs->free.i;
+            lfs->free.i = off;
+            if (off == lfs->free.size) {
+                break;
+            }
+
             lfs->free.i += 1;
             lfs->free.ack -= 1;
 
-            if (!(lfs->free.buffer[off / 32] & (1U << (off % 32)))) {
-                // found a free block
-                *block = (lfs->free.off + off) % lfs->cfg->block_count;
-
-                // eagerly find next off so an alloc ack can
-                // discredit old lookahead blocks
-                while (lfs->free.i != lfs->free.size &&
-                        (lfs->free.buffer[lfs->free.i / 32]
-                            & (1U << (lfs->free.i % 32)))) {
-                    lfs->free.i += 1;
-                    lfs->free.ack -= 1;
-                }
+            // found a free block
+            *block = (lfs->free.off + off) % lfs->cfg->block_count;
 
-                return 0;
-            }
+            // eagerly find next off so an alloc ack can
+            // discredit old lookahead blocks
+            lfs_block_t next = lfs_alloc_findfree(lfs->free.buffer,
+                    lfs->free.i, lfs->free.size);
+            lfs->free.ack -= next - lfs->free.i;
+            lfs->free.i = next;
+
+            return 0;
         }
 
         // check if we have looked at all blocks since last ack
@@ -587,19 +968,82 @@ static int lfs_alloc(lfs_t *lfs, lfs_block_t *block) {
             return LFS_ERR_NOSPC;
         }
 
-        lfs->free.off = (lfs->free.off + lfs->free.size)
-                % lfs->cfg->block_count;
-        lfs->free.size = lfs_min(8*lfs->cfg->lookahead_size, lfs->free.ack);
-        lfs->free.i = 0;
-
-        // find mask of free blocks from tree
-        memset(lfs->free.buffer, 0, lfs->cfg->lookahead_size);
-        int err = lfs_fs_rawtraverse(lfs, lfs_alloc_lookahead, lfs, true);
+        int err = lfs_alloc_scan(lfs); /* << EST */
         if (err) {
-            lfs_alloc_drop(lfs);
             return err;
         }
     }
+#endif
+}
+#endif
+
+#ifndef LFS_READONLY
+// allocate the block following prev if it is free, so the blocks of a file
+// end up next to each other and the block device can read and program
+// across them in one go, any free block otherwise << EST
+static int lfs_alloc_near(lfs_t *lfs, lfs_block_t prev, lfs_block_t *block) {
+    lfs_block_t hint = prev + 1;
+    if (prev < lfs->cfg->block_count && hint < lfs->cfg->block_count) {
+#if LFS_FREEMAP
+        if (lfs->free.valid &&
+                !(lfs->free.map[hint / 32] & (1U << (hint % 32)))) {
+            lfs->free.map[hint / 32] |= 1U << (hint % 32);
+            lfs->free.inflight[hint / 32] |= 1U << (hint % 32);
+            lfs->free.nflight += 1;
+            *block = hint;
+#if LFS_ALLOC_RESERVE > 0
+            lfs_alloc_reserve(lfs, hint, hint + 1);
+#endif
+            return 0;
+        }
+#else
+        // only blocks the lookahead knows to be free and has not handed
+        // out yet
+        lfs_block_t off = ((hint - lfs->free.off)
+                + lfs->cfg->block_count) % lfs->cfg->block_count;
+        if (off >= lfs->free.i && off < lfs->free.size &&
+                !(lfs->free.buffer[off / 32] & (1U << (off % 32)))) {
+            lfs->free.buffer[off / 32] |= 1U << (off % 32);
+            *block = hint;
+            return 0;
+        }
+#endif
+    }
+
+    int err = lfs_alloc(lfs, block);
+#if LFS_FREEMAP && LFS_ALLOC_RESERVE > 0
+    if (!err) {
+        // the file continues somewhere else, keep the block after it free
+        lfs_alloc_reserve(lfs, hint, *block + 1);
+    }
+#endif
+    return err;
+}
+#endif
+
+#if !defined(LFS_READONLY) && LFS_USEDCOUNT
+// a successful commit added blocks to the tree (diff > 0) or removed them
+// (diff < 0), keep the count of lfs_fs_size up to date << EST
+static void lfs_fs_addused(lfs_t *lfs, lfs_ssize_t diff) {
+    if (lfs->used_valid) {
+        lfs->used += diff;
+    }
+}
+#endif
+
+#ifndef LFS_READONLY
+// a commit failed, part of its changes may be on disk, so the state derived
+// from the commits can't be trusted anymore << EST
+static void lfs_fs_commitfailed(lfs_t *lfs) {
+#if LFS_USEDCOUNT
+    // count the used blocks again
+    lfs->used_valid = false;
+#endif
+#if LFS_CHECKPOINT
+    // the next mount walks the metadata pairs
+    lfs->ckpt_clean = false;
+#endif
+    (void)lfs;
 }
 #endif
 
@@ -610,6 +1054,8 @@ static lfs_stag_t lfs_dir_getslice(lfs_t *lfs, const lfs_mdir_t *dir,
     lfs_off_t off = dir->off;
     lfs_tag_t ntag = dir->etag;
     lfs_stag_t gdiff = 0;
+    // map the committed part of the block once, tags are then read in place << EST
+    const uint8_t *mapped = lfs_bd_map(lfs, NULL, dir->pair[0], 0, off);
 
     if (lfs_gstate_hasmovehere(&lfs->gdisk, dir->pair) &&
             lfs_tag_id(gmask) != 0 &&
@@ -622,11 +1068,16 @@ static lfs_stag_t lfs_dir_getslice(lfs_t *lfs, const lfs_mdir_t *dir,
     while (off >= sizeof(lfs_tag_t) + lfs_tag_dsize(ntag)) {
         off -= lfs_tag_dsize(ntag);
         lfs_tag_t tag = ntag;
-        int err = lfs_bd_read(lfs,
-                NULL, &lfs->rcache, sizeof(ntag),
-                dir->pair[0], off, &ntag, sizeof(ntag));
-        if (err) {
-            return err;
+        int err;
+        if (mapped) {
+            memcpy(&ntag, &mapped[off], sizeof(ntag));
+        } else {
+            err = lfs_bd_read(lfs,
+                    NULL, &lfs->rcache, sizeof(ntag),
+                    dir->pair[0], off, &ntag, sizeof(ntag));
+            if (err) {
+                return err;
+            }
         }
 
         ntag = (lfs_frombe32(ntag) ^ tag) & 0x7fffffff;
@@ -650,11 +1101,15 @@ static lfs_stag_t lfs_dir_getslice(lfs_t *lfs, const lfs_mdir_t *dir,
             }
 
             lfs_size_t diff = lfs_min(lfs_tag_size(tag), gsize);
-            err = lfs_bd_read(lfs,
-                    NULL, &lfs->rcache, diff,
-                    dir->pair[0], off+sizeof(tag)+goff, gbuffer, diff);
-            if (err) {
-                return err;
+            if (mapped && off+sizeof(tag)+goff+diff <= dir->off) {
+                memcpy(gbuffer, &mapped[off+sizeof(tag)+goff], diff);
+            } else {
+                err = lfs_bd_read(lfs,
+                        NULL, &lfs->rcache, diff,
+                        dir->pair[0], off+sizeof(tag)+goff, gbuffer, diff);
+                if (err) {
+                    return err;
+                }
             }
 
             memset((uint8_t*)gbuffer + diff, 0, gsize - diff);
@@ -995,6 +1450,49 @@ popped:
 }
 #endif
 
+#if LFS_FCACHE_SIZE > 0 /* << EST */
+// validated commits of the log in dir->pair[0] with revision dir->rev
+static struct lfs_fentry *lfs_fcache_find(lfs_t *lfs,
+        const lfs_mdir_t *dir) {
+    for (int i = 0; i < LFS_FCACHE_SIZE; i++) {
+        struct lfs_fentry *fentry = &lfs->fcache[i];
+        if (fentry->pair[0] != LFS_BLOCK_NULL &&
+                fentry->pair[0] == dir->pair[0] &&
+                fentry->pair[1] == dir->pair[1] &&
+                fentry->rev == dir->rev) {
+            return fentry;
+        }
+    }
+
+    return NULL;
+}
+
+static void lfs_fcache_insert(lfs_t *lfs, struct lfs_fentry *fentry,
+        const lfs_mdir_t *dir) {
+    if (!fentry) {
+        fentry = &lfs->fcache[lfs->fcache_next];
+        lfs->fcache_next = (lfs->fcache_next + 1) % LFS_FCACHE_SIZE;
+    }
+
+    fentry->pair[0] = dir->pair[0];
+    fentry->pair[1] = dir->pair[1];
+    fentry->rev = dir->rev;
+    fentry->off = dir->off;
+    fentry->etag = dir->etag;
+    fentry->count = dir->count;
+    fentry->split = dir->split;
+    fentry->tail[0] = dir->tail[0];
+    fentry->tail[1] = dir->tail[1];
+}
+
+static void lfs_fcache_drop(lfs_t *lfs) {
+    for (int i = 0; i < LFS_FCACHE_SIZE; i++) {
+        lfs->fcache[i].pair[0] = LFS_BLOCK_NULL;
+    }
+    lfs->fcache_next = 0;
+}
+#endif
+
 static lfs_stag_t lfs_dir_fetchmatch(lfs_t *lfs,
         lfs_mdir_t *dir, const lfs_block_t pair[2],
         lfs_tag_t fmask, lfs_tag_t ftag, uint16_t *id,
@@ -1032,6 +1530,20 @@ static lfs_stag_t lfs_dir_fetchmatch(lfs_t *lfs,
     dir->rev = revs[(r+0)%2];
     dir->off = 0; // nonzero = found some commits
 
+#if LFS_FCACHE_SIZE > 0 /* << EST */
+    // commits of the log checked by an earlier fetch don't need their crc
+    // checked again, the block has not been erased since
+    struct lfs_fentry *fentry = lfs_fcache_find(lfs, dir);
+    lfs_off_t valid = fentry ? fentry->off : 0;
+    if (fentry) {
+        lfs->fcache_hits += 1;
+    } else {
+        lfs->fcache_misses += 1;
+    }
+#else
+    const lfs_off_t valid = 0;
+#endif
+
     // now scan tags to fetch the actual dir and find possible match
     for (int i = 0; i < 2; i++) {
         lfs_off_t off = 0;
@@ -1046,6 +1558,25 @@ static lfs_stag_t lfs_dir_fetchmatch(lfs_t *lfs,
         uint32_t crc = lfs_crc(0xffffffff, &dir->rev, sizeof(dir->rev));
         dir->rev = lfs_fromle32(dir->rev);
 
+#if LFS_FCACHE_SIZE > 0 /* << EST */
+        if (fentry && !cb) {
+            // nothing to match, continue after the validated commits
+            off = fentry->off - lfs_tag_dsize(fentry->etag);
+            ptag = fentry->etag;
+            tempcount = fentry->count;
+            temptail[0] = fentry->tail[0];
+            temptail[1] = fentry->tail[1];
+            tempsplit = fentry->split;
+            dir->off = fentry->off;
+            dir->etag = fentry->etag;
+            dir->count = fentry->count;
+            dir->tail[0] = fentry->tail[0];
+            dir->tail[1] = fentry->tail[1];
+            dir->split = fentry->split;
+            crc = 0xffffffff;
+        }
+#endif
+
         while (true) {
             // extract next tag
             lfs_tag_t tag;
@@ -1062,7 +1593,11 @@ static lfs_stag_t lfs_dir_fetchmatch(lfs_t *lfs,
                 return err;
             }
 
-            crc = lfs_crc(crc, &tag, sizeof(tag));
+            // within validated commits? skip the crc << EST
+            bool checked = (off < valid);
+            if (!checked) {
+                crc = lfs_crc(crc, &tag, sizeof(tag));
+            }
             tag = lfs_frombe32(tag) ^ ptag;
 
             // next commit not yet programmed or we're not in valid range
@@ -1092,7 +1627,7 @@ static lfs_stag_t lfs_dir_fetchmatch(lfs_t *lfs,
                 }
                 dcrc = lfs_fromle32(dcrc);
 
-                if (crc != dcrc) {
+                if (!checked && crc != dcrc) { /* << EST */
                     dir->erased = false;
                     break;
                 }
@@ -1103,8 +1638,9 @@ static lfs_stag_t lfs_dir_fetchmatch(lfs_t *lfs,
                 // toss our crc into the filesystem seed for
                 // pseudorandom numbers, note we use another crc here
                 // as a collection function because it is sufficiently
-                // random and convenient
-                lfs->seed = lfs_crc(lfs->seed, &crc, sizeof(crc));
+                // random and convenient, dcrc equals crc but is also known
+                // for validated commits << EST
+                lfs->seed = lfs_crc(lfs->seed, &dcrc, sizeof(dcrc));
 
                 // update with what's found so far
                 besttag = tempbesttag;
@@ -1121,7 +1657,8 @@ static lfs_stag_t lfs_dir_fetchmatch(lfs_t *lfs,
             }
 
             // crc the entry first, hopefully leaving it in the cache
-            for (lfs_off_t j = sizeof(tag); j < lfs_tag_dsize(tag); j++) {
+            for (lfs_off_t j = sizeof(tag);
+                    !checked && j < lfs_tag_dsize(tag); j++) { /* << EST */
                 uint8_t dat;
                 err = lfs_bd_read(lfs,
                         NULL, &lfs->rcache, lfs->cfg->block_size,
@@ -1198,6 +1735,12 @@ static lfs_stag_t lfs_dir_fetchmatch(lfs_t *lfs,
 
         // consider what we have good enough
         if (dir->off > 0) {
+#if LFS_FCACHE_SIZE > 0 /* << EST */
+            if (!fentry || fentry->off != dir->off) {
+                lfs_fcache_insert(lfs, fentry, dir);
+            }
+#endif
+
             // synthetic move
             if (lfs_gstate_hasmovehere(&lfs->gdisk, dir->pair)) {
                 if (lfs_tag_id(lfs->gdisk.tag) == lfs_tag_id(besttag)) {
@@ -1225,6 +1768,10 @@ static lfs_stag_t lfs_dir_fetchmatch(lfs_t *lfs,
         // failed, try the other block?
         lfs_pair_swap(dir->pair);
         dir->rev = revs[(r+1)%2];
+#if LFS_FCACHE_SIZE > 0 /* << EST */
+        fentry = NULL;
+        valid = 0;
+#endif
     }
 
     LFS_ERROR("Corrupted dir pair at {0x%"PRIx32", 0x%"PRIx32"}",
@@ -1322,6 +1869,82 @@ static int lfs_dir_find_match(void *data,
     return LFS_CMP_EQ;
 }
 
+#if LFS_DCACHE_SIZE > 0 /* << EST */
+// path lookup cache, an entry stays valid until a commit touches one of its
+// metadata pairs
+static struct lfs_dentry *lfs_dcache_slot(lfs_t *lfs,
+        const lfs_block_t parent[2], const char *name, lfs_size_t namelen) {
+    // FNV-1a over the directory and the name
+    uint32_t hash = 2166136261u ^ parent[0];
+    for (lfs_size_t i = 0; i < namelen; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+
+    return &lfs->dcache[hash % LFS_DCACHE_SIZE];
+}
+
+static struct lfs_dentry *lfs_dcache_find(lfs_t *lfs,
+        const lfs_block_t parent[2], const char *name, lfs_size_t namelen) {
+    struct lfs_dentry *dentry = lfs_dcache_slot(lfs, parent, name, namelen);
+    if (dentry->parent[0] == LFS_BLOCK_NULL ||
+            dentry->parent[0] != parent[0] ||
+            dentry->parent[1] != parent[1] ||
+            lfs_tag_size(dentry->tag) != namelen ||
+            memcmp(dentry->name, name, namelen) != 0) {
+        return NULL;
+    }
+
+    // an entry with a pending move is treated as deleted by lfs_dir_fetchmatch
+    if (lfs_gstate_hasmovehere(&lfs->gdisk, dentry->pair) &&
+            lfs_tag_id(lfs->gdisk.tag) == lfs_tag_id(dentry->tag)) {
+        dentry->parent[0] = LFS_BLOCK_NULL;
+        return NULL;
+    }
+
+    return dentry;
+}
+
+static struct lfs_dentry *lfs_dcache_insert(lfs_t *lfs,
+        const lfs_block_t parent[2], const char *name, lfs_size_t namelen,
+        const lfs_mdir_t *dir, lfs_tag_t tag) {
+    if (namelen > LFS_DCACHE_NAME_MAX) {
+        return NULL;
+    }
+
+    struct lfs_dentry *dentry = lfs_dcache_slot(lfs, parent, name, namelen);
+    dentry->parent[0] = parent[0];
+    dentry->parent[1] = parent[1];
+    dentry->pair[0] = dir->pair[0];
+    dentry->pair[1] = dir->pair[1];
+    dentry->child[0] = LFS_BLOCK_NULL;
+    dentry->child[1] = LFS_BLOCK_NULL;
+    dentry->tag = tag;
+    memcpy(dentry->name, name, namelen);
+    return dentry;
+}
+
+#ifndef LFS_READONLY
+// drop all entries referring to a block of pair
+static void lfs_dcache_invalidate(lfs_t *lfs, const lfs_block_t pair[2]) {
+    for (int i = 0; i < LFS_DCACHE_SIZE; i++) {
+        struct lfs_dentry *dentry = &lfs->dcache[i];
+        if (dentry->parent[0] != LFS_BLOCK_NULL &&
+                (lfs_pair_cmp(dentry->parent, pair) == 0 ||
+                 lfs_pair_cmp(dentry->pair, pair) == 0 ||
+                 lfs_pair_cmp(dentry->child, pair) == 0)) {
+            dentry->parent[0] = LFS_BLOCK_NULL;
+        }
+    }
+}
+#endif
+
+static void lfs_dcache_drop(lfs_t *lfs) {
+    for (int i = 0; i < LFS_DCACHE_SIZE; i++) {
+        lfs->dcache[i].parent[0] = LFS_BLOCK_NULL;
+    }
+}
+#endif
+
 static lfs_stag_t lfs_dir_find(lfs_t *lfs, lfs_mdir_t *dir,
         const char **path, uint16_t *id) {
     // we reduce path to a single name if we can find it
@@ -1329,6 +1952,13 @@ static lfs_stag_t lfs_dir_find(lfs_t *lfs, lfs_mdir_t *dir,
     if (id) {
         *id = 0x3ff;
     }
+#if LFS_DCACHE_SIZE > 0 /* << EST */
+    // a directory found in the cache is not fetched unless it is the last
+    // name, its pair is epair
+    bool fetched = true;
+    lfs_block_t epair[2];
+    struct lfs_dentry *dentry = NULL;
+#endif
 
     // default to root dir
     lfs_stag_t tag = LFS_MKTAG(LFS_TYPE_DIR, 0x3ff, 0);
@@ -1374,6 +2004,14 @@ nextname:
 
         // found path
         if (name[0] == '\0') {
+#if LFS_DCACHE_SIZE > 0 /* << EST */
+            if (!fetched) {
+                int err = lfs_dir_fetch(lfs, dir, epair);
+                if (err) {
+                    return err;
+                }
+            }
+#endif
             return tag;
         }
 
@@ -1386,6 +2024,13 @@ nextname:
         }
 
         // grab the entry data
+#if LFS_DCACHE_SIZE > 0 /* << EST */
+        if (!fetched) {
+            // pair of the directory is known from the cache
+            dir->tail[0] = dentry->child[0];
+            dir->tail[1] = dentry->child[1];
+        } else
+#endif
         if (lfs_tag_id(tag) != 0x3ff) {
             lfs_stag_t res = lfs_dir_get(lfs, dir, LFS_MKTAG(0x700, 0x3ff, 0),
                     LFS_MKTAG(LFS_TYPE_STRUCT, lfs_tag_id(tag), 8), dir->tail);
@@ -1393,7 +2038,45 @@ nextname:
                 return res;
             }
             lfs_pair_fromle32(dir->tail);
+#if LFS_DCACHE_SIZE > 0 /* << EST */
+            if (dentry) {
+                dentry->child[0] = dir->tail[0];
+                dentry->child[1] = dir->tail[1];
+            }
+#endif
+        }
+
+#if LFS_DCACHE_SIZE > 0 /* << EST */
+        lfs_block_t parent[2] = {dir->tail[0], dir->tail[1]};
+        dentry = lfs_dcache_find(lfs, parent, name, namelen);
+        if (dentry) {
+            lfs->dcache_hits += 1;
+            tag = dentry->tag;
+            if (strchr(name, '/') == NULL ||
+                    dentry->child[0] == LFS_BLOCK_NULL) {
+                // the caller needs the metadata pair of the last name
+                int err = lfs_dir_fetch(lfs, dir, dentry->pair);
+                if (err) {
+                    return err;
+                }
+                fetched = true;
+
+                if (id && strchr(name, '/') == NULL) {
+                    *id = lfs_tag_id(tag);
+                }
+            } else {
+                epair[0] = dentry->pair[0];
+                epair[1] = dentry->pair[1];
+                fetched = false;
+            }
+
+            // to next name
+            name += namelen;
+            continue;
         }
+        lfs->dcache_misses += 1;
+        fetched = true;
+#endif
 
         // find entry matching name
         while (true) {
@@ -1417,6 +2100,10 @@ nextname:
             }
         }
 
+#if LFS_DCACHE_SIZE > 0 /* << EST */
+        dentry = lfs_dcache_insert(lfs, parent, name, namelen, dir, tag);
+#endif
+
         // to next name
         name += namelen;
     }
@@ -1608,6 +2295,10 @@ static int lfs_dir_alloc(lfs_t *lfs, lfs_mdir_t *dir) {
             return err;
         }
     }
+#if LFS_DCACHE_SIZE > 0 /* << EST */
+    // the blocks could have been in use by a dropped directory
+    lfs_dcache_invalidate(lfs, dir->pair);
+#endif
 
     // zero for reproducibility in case initial block is unreadable
     dir->rev = 0;
@@ -1660,6 +2351,9 @@ static int lfs_dir_drop(lfs_t *lfs, lfs_mdir_t *dir, lfs_mdir_t *tail) {
         return err;
     }
 
+#if LFS_USEDCOUNT /* << EST */
+    lfs_fs_addused(lfs, -2);
+#endif
     return 0;
 }
 #endif
@@ -1695,6 +2389,9 @@ static int lfs_dir_split(lfs_t *lfs,
         lfs->root[1] = tail.pair[1];
     }
 
+#if LFS_USEDCOUNT /* << EST */
+    lfs_fs_addused(lfs, +2);
+#endif
     return 0;
 }
 #endif
@@ -1976,7 +2673,14 @@ static int lfs_dir_splittingcompact(lfs_t *lfs, lfs_mdir_t *dir,
             && lfs_pair_cmp(dir->pair, (const lfs_block_t[2]){0, 1}) == 0) {
         // oh no! we're writing too much to the superblock,
         // should we expand?
+#if LFS_USEDCOUNT /* << EST */
+        // don't count the tree in the middle of an operation, the count
+        // would miss the changes the operation has committed so far
+        lfs_ssize_t size = (lfs->used_valid)
+                ? lfs_fs_rawsize(lfs) : lfs_fs_traversesize(lfs);
+#else
         lfs_ssize_t size = lfs_fs_rawsize(lfs);
+#endif
         if (size < 0) {
             return size;
         }
@@ -2006,11 +2710,33 @@ static int lfs_dir_splittingcompact(lfs_t *lfs, lfs_mdir_t *dir,
 #endif
 
 #ifndef LFS_READONLY
+// log size above which a metadata pair gets compacted early, compacted logs
+// stay below half of the metadata size (see lfs_dir_splittingcompact), so
+// the threshold is kept above that to not compact over and over << EST
+static lfs_size_t lfs_dir_compactthresh(lfs_t *lfs) {
+    lfs_size_t msize = (lfs->cfg->metadata_max ?
+            lfs->cfg->metadata_max : lfs->cfg->block_size);
+    lfs_size_t thresh = lfs->cfg->compact_thresh;
+    if (thresh == 0) {
+        // with large program sizes only a few commits fit, then compact
+        // when there is room for at most one more
+        thresh = lfs_min(msize - msize/8, msize - 8 - lfs->cfg->prog_size);
+    }
+
+    return lfs_max(thresh,
+            lfs_alignup(msize/2, lfs->cfg->prog_size) + lfs->cfg->prog_size);
+}
+
 static int lfs_dir_relocatingcommit(lfs_t *lfs, lfs_mdir_t *dir,
         const lfs_block_t pair[2],
         const struct lfs_mattr *attrs, int attrcount,
         lfs_mdir_t *pdir) {
     int state = 0;
+    const lfs_block_t otail[2] = {dir->tail[0], dir->tail[1]}; /* << EST */
+#if LFS_DCACHE_SIZE > 0 /* << EST */
+    // names in this pair may change ids or move
+    lfs_dcache_invalidate(lfs, pair);
+#endif
 
     // calculate changes to the directory
     bool hasdelete = false;
@@ -2043,6 +2769,13 @@ static int lfs_dir_relocatingcommit(lfs_t *lfs, lfs_mdir_t *dir,
         }
     }
 
+    // compact early while the log is still small << EST
+    if (dir->erased && lfs->cfg->compact_thresh != 0 &&
+            lfs->cfg->compact_thresh != (lfs_size_t)-1 &&
+            dir->off > lfs_dir_compactthresh(lfs)) {
+        goto compact;
+    }
+
     if (dir->erased) {
         // try to commit
         struct lfs_commit commit = {
@@ -2128,6 +2861,18 @@ compact:
     goto fixmlist;
 
 fixmlist:;
+#if LFS_DCACHE_SIZE > 0 /* << EST */
+    // and the pair may have been relocated
+    lfs_dcache_invalidate(lfs, dir->pair);
+#endif
+    if (!lfs_pair_sync(dir->pair, pair) ||
+            !lfs_pair_sync(dir->tail, otail)) { /* << EST */
+        // relocated, split or dropped, the pair lfs_fs_gc continues with
+        // may be gone
+        lfs->gc_tail[0] = 0;
+        lfs->gc_tail[1] = 1;
+    }
+
     // this complicated bit of logic is for fixing up any active
     // metadata-pairs that we may have affected
     //
@@ -2179,6 +2924,11 @@ fixmlist:;
 #ifndef LFS_READONLY
 static int lfs_dir_orphaningcommit(lfs_t *lfs, lfs_mdir_t *dir,
         const struct lfs_mattr *attrs, int attrcount) {
+#if LFS_CHECKPOINT /* << EST */
+    // the checkpoint is deleted before the first change
+    LFS_ASSERT(!lfs->ckpt_ondisk);
+#endif
+
     // check for any inline files that aren't RAM backed and
     // forcefully evict them, needed for filesystem consistency
     for (lfs_file_t *f = (lfs_file_t*)lfs->mlist; f; f = f->next) {
@@ -2237,6 +2987,9 @@ static int lfs_dir_orphaningcommit(lfs_t *lfs, lfs_mdir_t *dir,
             return state;
         }
 
+#if LFS_USEDCOUNT /* << EST */
+        lfs_fs_addused(lfs, -2);
+#endif
         ldir = pdir;
     }
 
@@ -2374,6 +3127,7 @@ static int lfs_dir_commit(lfs_t *lfs, lfs_mdir_t *dir,
         const struct lfs_mattr *attrs, int attrcount) {
     int orphans = lfs_dir_orphaningcommit(lfs, dir, attrs, attrcount);
     if (orphans < 0) {
+        lfs_fs_commitfailed(lfs); /* << EST */
         return orphans;
     }
 
@@ -2383,6 +3137,7 @@ static int lfs_dir_commit(lfs_t *lfs, lfs_mdir_t *dir,
         // created some
         int err = lfs_fs_deorphan(lfs, false);
         if (err) {
+            lfs_fs_commitfailed(lfs); /* << EST */
             return err;
         }
     }
@@ -2486,6 +3241,9 @@ static int lfs_rawmkdir(lfs_t *lfs, const char *path) {
         return err;
     }
 
+#if LFS_USEDCOUNT /* << EST */
+    lfs_fs_addused(lfs, +2);
+#endif
     return 0;
 }
 #endif
@@ -2655,6 +3413,39 @@ static int lfs_ctz_index(lfs_t *lfs, lfs_off_t *off) {
     return i;
 }
 
+#if LFS_USEDCOUNT /* << EST */
+// number of blocks of a CTZ skip-list of size bytes, follows from the size
+// alone so the list is not read
+static lfs_size_t lfs_ctz_count(lfs_t *lfs, lfs_size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+
+    lfs_off_t off = size - 1;
+    return lfs_ctz_index(lfs, &off) + 1;
+}
+
+#ifndef LFS_READONLY
+// number of blocks of the committed file id in dir, 0 if it is inline
+static lfs_ssize_t lfs_ctz_committed(lfs_t *lfs,
+        const lfs_mdir_t *dir, uint16_t id) {
+    struct lfs_ctz ctz;
+    lfs_stag_t tag = lfs_dir_get(lfs, dir, LFS_MKTAG(0x700, 0x3ff, 0),
+            LFS_MKTAG(LFS_TYPE_STRUCT, id, sizeof(ctz)), &ctz);
+    if (tag < 0) {
+        return tag;
+    }
+    lfs_ctz_fromle32(&ctz);
+
+    if (lfs_tag_type3(tag) != LFS_TYPE_CTZSTRUCT) {
+        return 0;
+    }
+
+    return lfs_ctz_count(lfs, ctz.size);
+}
+#endif
+#endif
+
 static int lfs_ctz_find(lfs_t *lfs,
         const lfs_cache_t *pcache, lfs_cache_t *rcache,
         lfs_block_t head, lfs_size_t size,
@@ -2689,15 +3480,85 @@ static int lfs_ctz_find(lfs_t *lfs,
     return 0;
 }
 
+// lfs_ctz_find for the list of a file, with the block index of the file
+// the walk starts at the nearest known block at or after pos << EST
+static int lfs_file_ctzfind(lfs_t *lfs, lfs_file_t *file,
+        lfs_size_t pos, lfs_block_t *block, lfs_off_t *off) {
+    lfs_block_t *index = file->cfg->index_buffer;
+    lfs_size_t count = file->cfg->index_size;
+    if (!index || count == 0 || file->ctz.size == 0) {
+        return lfs_ctz_find(lfs, NULL, &file->cache,
+                file->ctz.head, file->ctz.size, pos, block, off);
+    }
+
+    lfs_off_t current = lfs_ctz_index(lfs, &(lfs_off_t){file->ctz.size-1});
+    lfs_off_t target = lfs_ctz_index(lfs, &pos);
+    lfs_block_t head = file->ctz.head;
+
+    if (file->index.head != file->ctz.head ||
+            file->index.size != file->ctz.size) {
+        // new list, space the entries so they cover all of its blocks
+        file->index.head = file->ctz.head;
+        file->index.size = file->ctz.size;
+        file->index.shift = 0;
+        while ((current >> file->index.shift) >= count) {
+            file->index.shift += 1;
+        }
+
+        for (lfs_size_t i = 0; i < count; i++) {
+            index[i] = LFS_BLOCK_NULL;
+        }
+    }
+
+    // start at the nearest known block
+    lfs_off_t stride = (lfs_off_t)1 << file->index.shift;
+    for (lfs_off_t i = (target + stride-1) >> file->index.shift;
+            (i << file->index.shift) < current; i++) {
+        if (index[i] != LFS_BLOCK_NULL) {
+            current = i << file->index.shift;
+            head = index[i];
+            break;
+        }
+    }
+
+    while (true) {
+        if ((current & (stride-1)) == 0) {
+            index[current >> file->index.shift] = head;
+        }
+
+        if (current <= target) {
+            break;
+        }
+
+        lfs_size_t skip = lfs_min(
+                lfs_npw2(current-target+1) - 1,
+                lfs_ctz(current));
+
+        int err = lfs_bd_read(lfs,
+                NULL, &file->cache, sizeof(head),
+                head, 4*skip, &head, sizeof(head));
+        head = lfs_fromle32(head);
+        if (err) {
+            return err;
+        }
+
+        current -= 1 << skip;
+    }
+
+    *block = head;
+    *off = pos;
+    return 0;
+}
+
 #ifndef LFS_READONLY
 static int lfs_ctz_extend(lfs_t *lfs,
         lfs_cache_t *pcache, lfs_cache_t *rcache,
         lfs_block_t head, lfs_size_t size,
         lfs_block_t *block, lfs_off_t *off) {
     while (true) {
-        // go ahead and grab a block
+        // go ahead and grab a block, next to the head if possible << EST
         lfs_block_t nblock;
-        int err = lfs_alloc(lfs, &nblock);
+        int err = lfs_alloc_near(lfs, head, &nblock);
         if (err) {
             return err;
         }
@@ -2856,6 +3717,7 @@ static int lfs_file_rawopencfg(lfs_t *lfs, lfs_file_t *file,
     file->pos = 0;
     file->off = 0;
     file->cache.buffer = NULL;
+    file->index.head = LFS_BLOCK_NULL; /* << EST */
 
     // allocate entry for file if it doesn't exist
     lfs_stag_t tag = lfs_dir_find(lfs, &file->m, &path, &file->id);
@@ -3131,6 +3993,8 @@ static int lfs_file_flush(lfs_t *lfs, lfs_file_t *file) {
                 .flags = LFS_O_RDONLY,
                 .pos = file->pos,
                 .cache = lfs->rcache,
+                .index = file->index, /* << EST */
+                .cfg = file->cfg,
             };
             lfs_cache_drop(lfs, &lfs->rcache);
 
@@ -3155,9 +4019,11 @@ static int lfs_file_flush(lfs_t *lfs, lfs_file_t *file) {
                 }
             }
 
-            // write out what we have
+            // write out what we have, with a sync, so a block device which
+            // buffers the data reports a failure for this block and not for
+            // the next one it gets written to << EST
             while (true) {
-                int err = lfs_bd_flush(lfs, &file->cache, &lfs->rcache, true);
+                int err = lfs_bd_sync(lfs, &file->cache, &lfs->rcache, true);
                 if (err) {
                     if (err == LFS_ERR_CORRUPT) {
                         goto relocate;
@@ -3181,6 +4047,7 @@ relocate:
         // actual file updates
         file->ctz.head = file->block;
         file->ctz.size = file->pos;
+        file->index.head = LFS_BLOCK_NULL; /* << EST */
         file->flags &= ~LFS_F_WRITING;
         file->flags |= LFS_F_DIRTY;
 
@@ -3205,8 +4072,16 @@ static int lfs_file_rawsync(lfs_t *lfs, lfs_file_t *file) {
     }
 
 
-    if ((file->flags & LFS_F_DIRTY) &&
-            !lfs_pair_isnull(file->m.pair)) {
+    if ((file->flags & LFS_F_DIRTY) &&
+            !lfs_pair_isnull(file->m.pair)) {
+#if LFS_CHECKPOINT /* << EST */
+        // file->m is kept up to date if it is the superblock pair
+        err = lfs_fs_dropcheckpoint(lfs);
+        if (err) {
+            return err;
+        }
+#endif
+
         // update dir entry
         uint16_t type;
         const void *buffer;
@@ -3227,6 +4102,17 @@ static int lfs_file_rawsync(lfs_t *lfs, lfs_file_t *file) {
             size = sizeof(ctz);
         }
 
+#if LFS_USEDCOUNT /* << EST */
+        // blocks of the version this commit replaces
+        lfs_ssize_t oldused = 0;
+        if (lfs->used_valid) {
+            oldused = lfs_ctz_committed(lfs, &file->m, file->id);
+            if (oldused < 0) {
+                return oldused;
+            }
+        }
+#endif
+
         // commit file data and attributes
         err = lfs_dir_commit(lfs, &file->m, LFS_MKATTRS(
                 {LFS_MKTAG(type, file->id, size), buffer},
@@ -3237,6 +4123,12 @@ static int lfs_file_rawsync(lfs_t *lfs, lfs_file_t *file) {
             return err;
         }
 
+#if LFS_USEDCOUNT /* << EST */
+        lfs_fs_addused(lfs, ((type == LFS_TYPE_CTZSTRUCT)
+                ? (lfs_ssize_t)lfs_ctz_count(lfs, file->ctz.size) : 0)
+                - oldused);
+#endif
+
         file->flags &= ~LFS_F_DIRTY;
     }
 
@@ -3262,8 +4154,7 @@ static lfs_ssize_t lfs_file_flushedread(lfs_t *lfs, lfs_file_t *file,
         if (!(file->flags & LFS_F_READING) ||
                 file->off == lfs->cfg->block_size) {
             if (!(file->flags & LFS_F_INLINE)) {
-                int err = lfs_ctz_find(lfs, NULL, &file->cache,
-                        file->ctz.head, file->ctz.size,
+                int err = lfs_file_ctzfind(lfs, file, /* << EST */
                         file->pos, &file->block, &file->off);
                 if (err) {
                     return err;
@@ -3350,8 +4241,7 @@ static lfs_ssize_t lfs_file_flushedwrite(lfs_t *lfs, lfs_file_t *file,
             if (!(file->flags & LFS_F_INLINE)) {
                 if (!(file->flags & LFS_F_WRITING) && file->pos > 0) {
                     // find out which block we're extending from
-                    int err = lfs_ctz_find(lfs, NULL, &file->cache,
-                            file->ctz.head, file->ctz.size,
+                    int err = lfs_file_ctzfind(lfs, file, /* << EST */
                             file->pos-1, &file->block, &file->off);
                     if (err) {
                         file->flags |= LFS_F_ERRED;
@@ -3549,6 +4439,7 @@ static int lfs_file_rawtruncate(lfs_t *lfs, lfs_file_t *file, lfs_off_t size) {
         file->pos = size;
         file->ctz.head = file->block;
         file->ctz.size = size;
+        file->index.head = LFS_BLOCK_NULL; /* << EST */
         file->flags |= LFS_F_DIRTY | LFS_F_READING;
     } else if (size > oldsize) {
         // flush+seek if not already at end
@@ -3661,6 +4552,44 @@ static int lfs_rawremove(lfs_t *lfs, const char *path) {
         dir.id = 0;
         lfs->mlist = &dir;
     }
+#if LFS_FREEMAP /* << EST */
+    // blocks of the file, released after the commit
+    struct lfs_ctz ctz = {.head = LFS_BLOCK_NULL, .size = 0};
+    if (lfs_tag_type3(tag) == LFS_TYPE_REG) {
+        lfs_stag_t res = lfs_dir_get(lfs, &cwd, LFS_MKTAG(0x700, 0x3ff, 0),
+                LFS_MKTAG(LFS_TYPE_STRUCT, lfs_tag_id(tag), sizeof(ctz)),
+                &ctz);
+        if (res < 0) {
+            return (int)res;
+        }
+        lfs_ctz_fromle32(&ctz);
+
+        if (lfs_tag_type3(res) != LFS_TYPE_CTZSTRUCT) {
+            ctz.head = LFS_BLOCK_NULL;
+        }
+
+        // still open? a handle keeps using the blocks, also when it has
+        // appended to them and its head has moved on, so they stay in use
+        // until a traversal rebuilds the map
+        for (struct lfs_mlist *m = lfs->mlist; m; m = m->next) {
+            if (m->type == LFS_TYPE_REG && m->id == lfs_tag_id(tag) &&
+                    lfs_pair_cmp(m->m.pair, cwd.pair) == 0) {
+                ctz.head = LFS_BLOCK_NULL;
+            }
+        }
+    }
+#endif
+
+#if LFS_USEDCOUNT /* << EST */
+    // blocks of the file, no longer used after the commit
+    lfs_ssize_t fileused = 0;
+    if (lfs->used_valid && lfs_tag_type3(tag) == LFS_TYPE_REG) {
+        fileused = lfs_ctz_committed(lfs, &cwd, lfs_tag_id(tag));
+        if (fileused < 0) {
+            return (int)fileused;
+        }
+    }
+#endif
 
     // delete the entry
     err = lfs_dir_commit(lfs, &cwd, LFS_MKATTRS(
@@ -3670,6 +4599,9 @@ static int lfs_rawremove(lfs_t *lfs, const char *path) {
         return err;
     }
 
+#if LFS_USEDCOUNT /* << EST */
+    lfs_fs_addused(lfs, -fileused);
+#endif
     lfs->mlist = dir.next;
     if (lfs_tag_type3(tag) == LFS_TYPE_DIR) {
         // fix orphan
@@ -3687,7 +4619,20 @@ static int lfs_rawremove(lfs_t *lfs, const char *path) {
         if (err) {
             return err;
         }
+#if LFS_FREEMAP /* << EST */
+        lfs_alloc_release(lfs, dir.m.pair[0]);
+        lfs_alloc_release(lfs, dir.m.pair[1]);
+#endif
+    }
+#if LFS_FREEMAP /* << EST */
+    else if (ctz.head != LFS_BLOCK_NULL) {
+        err = lfs_ctz_traverse(lfs, NULL, &lfs->rcache,
+                ctz.head, ctz.size, lfs_alloc_release, lfs);
+        if (err) {
+            return err;
+        }
     }
+#endif
 
     return 0;
 }
@@ -3774,6 +4719,18 @@ static int lfs_rawrename(lfs_t *lfs, const char *oldpath, const char *newpath) {
         lfs->mlist = &prevdir;
     }
 
+#if LFS_USEDCOUNT /* << EST */
+    // blocks of the file we replace, no longer used after the commit
+    lfs_ssize_t prevused = 0;
+    if (lfs->used_valid && prevtag != LFS_ERR_NOENT &&
+            lfs_tag_type3(prevtag) == LFS_TYPE_REG) {
+        prevused = lfs_ctz_committed(lfs, &newcwd, newid);
+        if (prevused < 0) {
+            return (int)prevused;
+        }
+    }
+#endif
+
     if (!samepair) {
         lfs_fs_prepmove(lfs, newoldid, oldcwd.pair);
     }
@@ -3791,6 +4748,9 @@ static int lfs_rawrename(lfs_t *lfs, const char *oldpath, const char *newpath) {
         lfs->mlist = prevdir.next;
         return err;
     }
+#if LFS_USEDCOUNT /* << EST */
+    lfs_fs_addused(lfs, -prevused);
+#endif
 
     // let commit clean up after move (if we're different! otherwise move
     // logic already fixed it for us)
@@ -3865,6 +4825,13 @@ static lfs_ssize_t lfs_rawgetattr(lfs_t *lfs, const char *path,
 #ifndef LFS_READONLY
 static int lfs_commitattr(lfs_t *lfs, const char *path,
         uint8_t type, const void *buffer, lfs_size_t size) {
+#if LFS_CHECKPOINT /* << EST */
+    int res = lfs_fs_dropcheckpoint(lfs);
+    if (res) {
+        return res;
+    }
+#endif
+
     lfs_mdir_t cwd;
     lfs_stag_t tag = lfs_dir_find(lfs, &cwd, &path, NULL);
     if (tag < 0) {
@@ -3904,9 +4871,129 @@ static int lfs_rawremoveattr(lfs_t *lfs, const char *path, uint8_t type) {
 #endif
 
 
+/// Concurrent readers /// << EST
+#if defined(LFS_THREADSAFE) && LFS_READERS > 0
+static void lfs_readers_init(lfs_t *lfs) {
+    lfs->wgen = 0;
+    if (!lfs->cfg->rdlock) {
+        return;
+    }
+
+    // without memory readers fall back to the exclusive lock
+    LFS_ASSERT((uintptr_t)lfs->cfg->readers_buffer % 8 == 0);
+    struct lfs_reader *readers = lfs->cfg->readers_buffer;
+    if (!readers) {
+        readers = lfs_malloc(LFS_READERS_SIZE(lfs->cfg->cache_size));
+        if (!readers) {
+            LFS_WARN("No memory for %d readers, "
+                    "reads take the exclusive lock", LFS_READERS);
+            return;
+        }
+    }
+
+    uint8_t *buffer = (uint8_t*)&readers[LFS_READERS];
+    for (int i = 0; i < LFS_READERS; i++) {
+        lfs_t *r = &readers[i].lfs;
+        r->rcache.buffer = buffer;
+        buffer += lfs->cfg->cache_size;
+        lfs_cache_zero(lfs, &r->rcache);
+#if LFS_RCACHE_WAYS > 1
+        for (int j = 0; j < LFS_RCACHE_WAYS-1; j++) {
+            r->rcache_ways[j].buffer = buffer;
+            buffer += lfs->cfg->cache_size;
+            lfs_cache_zero(lfs, &r->rcache_ways[j]);
+        }
+        memset(r->rcache_used, 0, sizeof(r->rcache_used));
+        r->rcache_tick = 0;
+#endif
+        readers[i].gen = 0;
+        readers[i].busy = false;
+    }
+    lfs->readers = readers;
+}
+
+static void lfs_readers_deinit(lfs_t *lfs) {
+    if (lfs->readers) {
+        if (!lfs->cfg->readers_buffer) {
+            lfs_free(lfs->readers);
+        }
+        lfs->readers = NULL;
+    }
+}
+
+// claim a reader, the shared lock must be held, returns NULL if all
+// readers are busy
+static lfs_t *lfs_reader_begin(lfs_t *lfs) {
+    if (!lfs->readers) {
+        return NULL;
+    }
+
+    for (int i = 0; i < LFS_READERS; i++) {
+        struct lfs_reader *reader = &lfs->readers[i];
+        if (__atomic_test_and_set(&reader->busy, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+
+        // take over the filesystem state, but keep the read caches
+        lfs_t *r = &reader->lfs;
+        lfs_cache_t rcache = r->rcache;
+#if LFS_RCACHE_WAYS > 1
+        lfs_cache_t ways[LFS_RCACHE_WAYS-1];
+        uint32_t used[LFS_RCACHE_WAYS];
+        uint32_t tick = r->rcache_tick;
+        memcpy(ways, r->rcache_ways, sizeof(ways));
+        memcpy(used, r->rcache_used, sizeof(used));
+#endif
+        // other readers add their statistics to the filesystem at the same
+        // time, they are not copied
+        memcpy(r, lfs, offsetof(lfs_t, rcache_hits));
+        r->rcache = rcache;
+#if LFS_RCACHE_WAYS > 1
+        memcpy(r->rcache_ways, ways, sizeof(ways));
+        memcpy(r->rcache_used, used, sizeof(used));
+        r->rcache_tick = tick;
+#endif
+        r->readers = NULL;
+        r->rcache_hits = 0;
+        r->rcache_misses = 0;
+        r->dcache_hits = 0;
+        r->dcache_misses = 0;
+        r->fcache_hits = 0;
+        r->fcache_misses = 0;
+
+        if (reader->gen != lfs->wgen) {
+            // storage was modified since the read caches were loaded
+            lfs_cache_drop(r, &r->rcache);
+            reader->gen = lfs->wgen;
+        }
+        return r;
+    }
+
+    return NULL;
+}
+
+static void lfs_reader_end(lfs_t *lfs, lfs_t *r) {
+    struct lfs_reader *reader = (struct lfs_reader*)r;
+    __atomic_fetch_add(&lfs->rcache_hits, r->rcache_hits, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&lfs->rcache_misses, r->rcache_misses,
+            __ATOMIC_RELAXED);
+    __atomic_fetch_add(&lfs->dcache_hits, r->dcache_hits, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&lfs->dcache_misses, r->dcache_misses,
+            __ATOMIC_RELAXED);
+    __atomic_fetch_add(&lfs->fcache_hits, r->fcache_hits, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&lfs->fcache_misses, r->fcache_misses,
+            __ATOMIC_RELAXED);
+    __atomic_clear(&reader->busy, __ATOMIC_RELEASE);
+}
+#endif
+
+
 /// Filesystem operations ///
 static int lfs_init(lfs_t *lfs, const struct lfs_config *cfg) {
     lfs->cfg = cfg;
+#if defined(LFS_THREADSAFE) && LFS_READERS > 0 /* << EST */
+    lfs->readers = NULL;
+#endif
     int err = 0;
 
     // validate that the lfs-cfg sizes were initiated properly before
@@ -3945,6 +5032,44 @@ static int lfs_init(lfs_t *lfs, const struct lfs_config *cfg) {
         }
     }
 
+#if LFS_RCACHE_WAYS > 1 /* << EST */
+    // setup the other read cache entries
+    uint8_t *ways_buffer;
+    if (lfs->cfg->rcache_ways_buffer) {
+        ways_buffer = lfs->cfg->rcache_ways_buffer;
+    } else {
+        ways_buffer = lfs_malloc((LFS_RCACHE_WAYS-1)*lfs->cfg->cache_size);
+        if (!ways_buffer) {
+            err = LFS_ERR_NOMEM;
+            goto cleanup;
+        }
+    }
+    for (int i = 0; i < LFS_RCACHE_WAYS-1; i++) {
+        lfs->rcache_ways[i].buffer = ways_buffer + i*lfs->cfg->cache_size;
+        lfs_cache_zero(lfs, &lfs->rcache_ways[i]);
+    }
+    memset(lfs->rcache_used, 0, sizeof(lfs->rcache_used));
+    lfs->rcache_tick = 0;
+#endif
+    lfs->rcache_hits = 0; /* << EST */
+    lfs->rcache_misses = 0;
+    lfs->gc_tail[0] = 0; /* << EST */
+    lfs->gc_tail[1] = 1;
+#if LFS_USEDCOUNT /* << EST */
+    lfs->used = 0;
+    lfs->used_valid = false;
+#endif
+#if LFS_DCACHE_SIZE > 0 /* << EST */
+    lfs_dcache_drop(lfs);
+#endif
+    lfs->dcache_hits = 0; /* << EST */
+    lfs->dcache_misses = 0;
+#if LFS_FCACHE_SIZE > 0 /* << EST */
+    lfs_fcache_drop(lfs);
+#endif
+    lfs->fcache_hits = 0; /* << EST */
+    lfs->fcache_misses = 0;
+
     // setup program cache
     if (lfs->cfg->prog_buffer) {
         lfs->pcache.buffer = lfs->cfg->prog_buffer;
@@ -3960,6 +5085,7 @@ static int lfs_init(lfs_t *lfs, const struct lfs_config *cfg) {
     lfs_cache_zero(lfs, &lfs->rcache);
     lfs_cache_zero(lfs, &lfs->pcache);
 
+#if !LFS_FREEMAP /* << EST */
     // setup lookahead, must be multiple of 64-bits, 32-bit aligned
     LFS_ASSERT(lfs->cfg->lookahead_size > 0);
     LFS_ASSERT(lfs->cfg->lookahead_size % 8 == 0 &&
@@ -3973,6 +5099,28 @@ static int lfs_init(lfs_t *lfs, const struct lfs_config *cfg) {
             goto cleanup;
         }
     }
+#else
+    // setup free block map, it replaces the lookahead buffer
+    LFS_ASSERT((uintptr_t)lfs->cfg->freemap_buffer % 4 == 0);
+    if (lfs->cfg->freemap_buffer) {
+        lfs->free.map = lfs->cfg->freemap_buffer;
+    } else {
+        lfs->free.map = lfs_malloc(LFS_FREEMAP_SIZE(lfs->cfg->block_count));
+        if (!lfs->free.map) {
+            err = LFS_ERR_NOMEM;
+            goto cleanup;
+        }
+    }
+    lfs->free.inflight = lfs->free.map + (lfs->cfg->block_count+31)/32;
+    memset(lfs->free.inflight, 0, 4*((lfs->cfg->block_count+31)/32));
+    lfs->free.nflight = 0;
+    lfs->free.valid = false;
+    lfs->free.built = false;
+#if !defined(LFS_READONLY) && LFS_ALLOC_RESERVE > 0
+    lfs_alloc_unreserve(lfs);
+    lfs->free.nextreserved = 0;
+#endif
+#endif
 
     // check that the size limits are sane
     LFS_ASSERT(lfs->cfg->name_max <= LFS_NAME_MAX);
@@ -4006,6 +5154,13 @@ static int lfs_init(lfs_t *lfs, const struct lfs_config *cfg) {
 #ifdef LFS_MIGRATE
     lfs->lfs1 = NULL;
 #endif
+#if defined(LFS_THREADSAFE) && LFS_READERS > 0 /* << EST */
+    lfs_readers_init(lfs);
+#endif
+#if LFS_CHECKPOINT /* << EST */
+    lfs->ckpt_ondisk = false;
+    lfs->ckpt_clean = false;
+#endif
 
     return 0;
 
@@ -4024,12 +5179,174 @@ static int lfs_deinit(lfs_t *lfs) {
         lfs_free(lfs->pcache.buffer);
     }
 
+#if LFS_RCACHE_WAYS > 1 /* << EST */
+    if (!lfs->cfg->rcache_ways_buffer) {
+        lfs_free(lfs->rcache_ways[0].buffer);
+    }
+#endif
+
+#if !LFS_FREEMAP /* << EST */
     if (!lfs->cfg->lookahead_buffer) {
         lfs_free(lfs->free.buffer);
     }
+#else
+    if (!lfs->cfg->freemap_buffer) {
+        lfs_free(lfs->free.map);
+    }
+#endif
+
+#if defined(LFS_THREADSAFE) && LFS_READERS > 0 /* << EST */
+    lfs_readers_deinit(lfs);
+#endif
+
+    return 0;
+}
+
+#if LFS_CHECKPOINT /* << EST */
+// state of a clean unmount, kept in the superblock pair so lfs_rawmount
+// doesn't have to fetch every metadata pair for the global state
+typedef struct lfs_checkpoint {
+    lfs_block_t root[2];
+    lfs_gstate_t gstate;
+    uint32_t seed;
+} lfs_checkpoint_t;
+
+static void lfs_checkpoint_fromle32(lfs_checkpoint_t *ckpt) {
+    lfs_pair_fromle32(ckpt->root);
+    lfs_gstate_fromle32(&ckpt->gstate);
+    ckpt->seed = lfs_fromle32(ckpt->seed);
+}
+
+#ifndef LFS_READONLY
+static void lfs_checkpoint_tole32(lfs_checkpoint_t *ckpt) {
+    lfs_pair_tole32(ckpt->root);
+    lfs_gstate_tole32(&ckpt->gstate);
+    ckpt->seed = lfs_tole32(ckpt->seed);
+}
+#endif
+
+// matches the superblock like lfs_dir_find_match, and notes where the last
+// checkpoint of the pair is
+struct lfs_mount_match {
+    struct lfs_dir_find_match name;
+    lfs_tag_t tag;
+    struct lfs_diskoff disk;
+};
+
+static int lfs_mount_match(void *data,
+        lfs_tag_t tag, const void *buffer) {
+    struct lfs_mount_match *match = data;
+
+    if ((LFS_MKTAG(0x7ff, 0x3ff, 0) & tag) ==
+            LFS_MKTAG(LFS_TYPE_CHECKPOINT, 0x3ff, 0)) {
+        match->tag = tag;
+        match->disk = *(const struct lfs_diskoff*)buffer;
+        return LFS_CMP_LT;
+    } else if ((LFS_MKTAG(0x7ff, 0x3ff, 0) & tag) !=
+            LFS_MKTAG(LFS_TYPE_SUPERBLOCK, 0, 0)) {
+        return LFS_CMP_LT;
+    }
+
+    return lfs_dir_find_match(&match->name, tag, buffer);
+}
+
+// the checkpoint only counts if it is the last commit of the pair, anything
+// committed after it was written by someone not keeping it up to date
+static int lfs_mount_getcheckpoint(lfs_t *lfs, const lfs_mdir_t *dir,
+        const struct lfs_mount_match *match, lfs_checkpoint_t *ckpt) {
+    if (lfs_tag_size(match->tag) != sizeof(*ckpt) ||
+            match->disk.block != dir->pair[0] ||
+            dir->off != lfs_alignup(match->disk.off + sizeof(*ckpt)
+                + 2*sizeof(uint32_t), lfs->cfg->prog_size)) {
+        return false;
+    }
+
+    int err = lfs_bd_read(lfs,
+            NULL, &lfs->rcache, sizeof(*ckpt),
+            match->disk.block, match->disk.off, ckpt, sizeof(*ckpt));
+    if (err) {
+        return err;
+    }
+    lfs_checkpoint_fromle32(ckpt);
+
+    return true;
+}
+
+#ifndef LFS_READONLY
+static int lfs_fs_dropcheckpoint(lfs_t *lfs) {
+    if (!lfs->ckpt_ondisk) {
+        return 0;
+    }
+
+    // delete it before the first change, it won't match the pairs after it
+    lfs_mdir_t root;
+    int err = lfs_dir_fetch(lfs, &root, lfs->root);
+    if (err) {
+        return err;
+    }
+
+    lfs->ckpt_ondisk = false;
+    err = lfs_dir_commit(lfs, &root, LFS_MKATTRS(
+            {LFS_MKTAG(LFS_TYPE_CHECKPOINT, 0x3ff, 0x3ff), NULL}));
+    if (err) {
+        lfs->ckpt_ondisk = true;
+        return err;
+    }
+
+    return 0;
+}
+
+static int lfs_fs_writecheckpoint(lfs_t *lfs) {
+    if (!lfs->ckpt_clean || lfs->ckpt_ondisk) {
+        return 0;
+    }
+
+    // the checkpoint has to be the whole commit, pending global state
+    // would be committed along with it
+    lfs_gstate_t delta = {0};
+    lfs_gstate_xor(&delta, &lfs->gstate);
+    lfs_gstate_xor(&delta, &lfs->gdisk);
+    lfs_gstate_xor(&delta, &lfs->gdelta);
+    delta.tag &= ~LFS_MKTAG(0, 0, 0x3ff);
+    if (!lfs_gstate_iszero(&delta)) {
+        return 0;
+    }
+
+    lfs_mdir_t root;
+    int err = lfs_dir_fetch(lfs, &root, lfs->root);
+    if (err) {
+        return err;
+    }
+
+    // a compaction drops the checkpoint, but leaves room for it
+    for (int i = 0; i < 2 && !lfs->ckpt_ondisk; i++) {
+        lfs_checkpoint_t ckpt = {
+            .root = {lfs->root[0], lfs->root[1]},
+            .gstate = lfs->gdisk,
+            .seed = lfs->seed,
+        };
+        // the orphan count isn't on disk
+        ckpt.gstate.tag &= ~LFS_MKTAG(0, 0, 0x3ff);
+        lfs_checkpoint_tole32(&ckpt);
+        err = lfs_dir_commit(lfs, &root, LFS_MKATTRS(
+                {LFS_MKTAG(LFS_TYPE_CHECKPOINT, 0x3ff, sizeof(ckpt)), &ckpt}));
+        if (err) {
+            return err;
+        }
+
+        lfs_stag_t tag = lfs_dir_get(lfs, &root, LFS_MKTAG(0x7ff, 0x3ff, 0),
+                LFS_MKTAG(LFS_TYPE_CHECKPOINT, 0x3ff, 0), NULL);
+        if (tag < 0 && tag != LFS_ERR_NOENT) {
+            return tag;
+        }
+
+        lfs->ckpt_ondisk = (tag >= 0);
+    }
 
     return 0;
 }
+#endif
+#endif
 
 #ifndef LFS_READONLY
 static int lfs_rawformat(lfs_t *lfs, const struct lfs_config *cfg) {
@@ -4041,12 +5358,19 @@ static int lfs_rawformat(lfs_t *lfs, const struct lfs_config *cfg) {
         }
 
         // create free lookahead
+#if !LFS_FREEMAP /* << EST */
         memset(lfs->free.buffer, 0, lfs->cfg->lookahead_size);
+#endif
         lfs->free.off = 0;
         lfs->free.size = lfs_min(8*lfs->cfg->lookahead_size,
                 lfs->cfg->block_count);
         lfs->free.i = 0;
         lfs_alloc_ack(lfs);
+#if LFS_FREEMAP /* << EST */
+        // nothing is in use yet
+        memset(lfs->free.map, 0, 4*((lfs->cfg->block_count+31)/32));
+        lfs->free.valid = true;
+#endif
 
         // create root dir
         lfs_mdir_t root;
@@ -4106,6 +5430,9 @@ static int lfs_rawmount(lfs_t *lfs, const struct lfs_config *cfg) {
     // scan directory blocks for superblock and any global updates
     lfs_mdir_t dir = {.tail = {0, 1}};
     lfs_block_t cycle = 0;
+#if LFS_CHECKPOINT /* << EST */
+    lfs_checkpoint_t ckpt;
+#endif
     while (!lfs_pair_isnull(dir.tail)) {
         if (cycle >= lfs->cfg->block_count/2) {
             // loop detected
@@ -4115,12 +5442,22 @@ static int lfs_rawmount(lfs_t *lfs, const struct lfs_config *cfg) {
         cycle += 1;
 
         // fetch next block in tail list
+#if LFS_CHECKPOINT /* << EST */
+        // the superblock and checkpoint types only share the low bits
+        struct lfs_mount_match match = {{lfs, "littlefs", 8}, 0, {0, 0}};
+        lfs_stag_t tag = lfs_dir_fetchmatch(lfs, &dir, dir.tail,
+                LFS_MKTAG(0x0ff, 0, 0),
+                LFS_MKTAG(LFS_TYPE_SUPERBLOCK, 0, 8),
+                NULL,
+                lfs_mount_match, &match);
+#else
         lfs_stag_t tag = lfs_dir_fetchmatch(lfs, &dir, dir.tail,
                 LFS_MKTAG(0x7ff, 0x3ff, 0),
                 LFS_MKTAG(LFS_TYPE_SUPERBLOCK, 0, 8),
                 NULL,
                 lfs_dir_find_match, &(struct lfs_dir_find_match){
                     lfs, "littlefs", 8});
+#endif
         if (tag < 0) {
             err = tag;
             goto cleanup;
@@ -4201,6 +5538,23 @@ static int lfs_rawmount(lfs_t *lfs, const struct lfs_config *cfg) {
                 err = LFS_ERR_INVAL;
                 goto cleanup;
             }
+
+#if LFS_CHECKPOINT /* << EST */
+            // left by a clean unmount? then it has the global state of
+            // all pairs and we are done
+            if (match.tag) {
+                int res = lfs_mount_getcheckpoint(lfs, &dir, &match, &ckpt);
+                if (res < 0) {
+                    err = res;
+                    goto cleanup;
+                }
+
+                if (res && lfs_pair_cmp(lfs->root, ckpt.root) == 0) {
+                    lfs->ckpt_ondisk = true;
+                    break;
+                }
+            }
+#endif
         }
 
         // has gstate?
@@ -4216,6 +5570,13 @@ static int lfs_rawmount(lfs_t *lfs, const struct lfs_config *cfg) {
         goto cleanup;
     }
 
+#if LFS_CHECKPOINT /* << EST */
+    if (lfs->ckpt_ondisk) {
+        lfs->gstate = ckpt.gstate;
+        lfs->seed = lfs_crc(lfs->seed, &ckpt.seed, sizeof(ckpt.seed));
+    }
+#endif
+
     // update littlefs with gstate
     if (!lfs_gstate_iszero(&lfs->gstate)) {
         LFS_DEBUG("Found pending gstate 0x%08"PRIx32"%08"PRIx32"%08"PRIx32,
@@ -4231,6 +5592,9 @@ static int lfs_rawmount(lfs_t *lfs, const struct lfs_config *cfg) {
     lfs->free.off = lfs->seed % lfs->cfg->block_count;
     lfs_alloc_drop(lfs);
 
+#if LFS_CHECKPOINT /* << EST */
+    lfs->ckpt_clean = true;
+#endif
     return 0;
 
 cleanup:
@@ -4239,7 +5603,13 @@ cleanup:
 }
 
 static int lfs_rawunmount(lfs_t *lfs) {
+#if LFS_CHECKPOINT && !defined(LFS_READONLY) /* << EST */
+    int err = lfs_fs_writecheckpoint(lfs);
+    int res = lfs_deinit(lfs);
+    return err ? err : res;
+#else
     return lfs_deinit(lfs);
+#endif
 }
 
 
@@ -4530,9 +5900,13 @@ restart:
                                 dir.tail}));
                     lfs_pair_fromle32(dir.tail);
                     if (state < 0) {
+                        lfs_fs_commitfailed(lfs); /* << EST */
                         return state;
                     }
 
+#if LFS_USEDCOUNT /* << EST */
+                    lfs_fs_addused(lfs, -2);
+#endif
                     found += 1;
 
                     // did our commit create more orphans?
@@ -4572,57 +5946,327 @@ restart:
                             lfs_fs_prepmove(lfs, 0x3ff, NULL);
                         }
 
-                        lfs_pair_tole32(pair);
-                        state = lfs_dir_orphaningcommit(lfs, &pdir, LFS_MKATTRS(
-                                {LFS_MKTAG_IF(moveid != 0x3ff,
-                                    LFS_TYPE_DELETE, moveid, 0), NULL},
-                                {LFS_MKTAG(LFS_TYPE_SOFTTAIL, 0x3ff, 8),
-                                    pair}));
-                        lfs_pair_fromle32(pair);
-                        if (state < 0) {
-                            return state;
-                        }
+                        lfs_pair_tole32(pair);
+                        state = lfs_dir_orphaningcommit(lfs, &pdir, LFS_MKATTRS(
+                                {LFS_MKTAG_IF(moveid != 0x3ff,
+                                    LFS_TYPE_DELETE, moveid, 0), NULL},
+                                {LFS_MKTAG(LFS_TYPE_SOFTTAIL, 0x3ff, 8),
+                                    pair}));
+                        lfs_pair_fromle32(pair);
+                        if (state < 0) {
+                            lfs_fs_commitfailed(lfs); /* << EST */
+                            return state;
+                        }
+
+                        found += 1;
+
+                        // did our commit create more orphans?
+                        if (state == LFS_OK_ORPHANED) {
+                            goto restart;
+                        }
+
+                        // refetch tail
+                        continue;
+                    }
+                }
+            }
+
+            pdir = dir;
+        }
+    }
+
+    // mark orphans as fixed
+    return lfs_fs_preporphans(lfs, -lfs_min(
+            lfs_gstate_getorphans(&lfs->gstate),
+            found));
+}
+#endif
+
+#ifndef LFS_READONLY
+static int lfs_fs_forceconsistency(lfs_t *lfs) {
+#if LFS_CHECKPOINT /* << EST */
+    // before any global state is prepared for the operation
+    int err = lfs_fs_dropcheckpoint(lfs);
+    if (err) {
+        return err;
+    }
+
+    err = lfs_fs_demove(lfs);
+#else
+    int err = lfs_fs_demove(lfs);
+#endif
+    if (err) {
+        return err;
+    }
+
+    err = lfs_fs_deorphan(lfs, true);
+    if (err) {
+        return err;
+    }
+
+    return 0;
+}
+#endif
+
+#ifndef LFS_READONLY
+static lfs_ssize_t lfs_fs_rawgc(lfs_t *lfs, lfs_size_t budget) { /* << EST */
+    lfs_ssize_t steps = 0;
+
+    // resolve pending moves and orphans
+    if (budget > 0 && (lfs_gstate_hasmove(&lfs->gdisk) ||
+            lfs_gstate_hasorphans(&lfs->gstate))) {
+        int err = lfs_fs_forceconsistency(lfs);
+        if (err) {
+            return err;
+        }
+        budget -= 1;
+        steps += 1;
+    }
+
+    // nothing is in flight between operations
+    lfs_alloc_ack(lfs);
+#if LFS_FREEMAP
+    // build the free block map
+    if (budget > 0 && !lfs->free.valid) {
+        int err = lfs_alloc_mapbuild(lfs);
+        if (err) {
+            return err;
+        }
+        budget -= 1;
+        steps += 1;
+    }
+#else
+    // fill the lookahead buffer
+    if (budget > 0 && lfs->free.i == lfs->free.size) {
+        int err = lfs_alloc_scan(lfs);
+        if (err) {
+            return err;
+        }
+        budget -= 1;
+        steps += 1;
+    }
+#endif
+
+    // compact metadata pairs above the threshold, continue with the pair
+    // the last call stopped at. The threshold is clamped like for commits,
+    // a pair that was just compacted must not be compacted again
+    if (lfs->cfg->compact_thresh == (lfs_size_t)-1) {
+        return steps;
+    }
+    lfs_size_t thresh = lfs_dir_compactthresh(lfs);
 
-                        found += 1;
+    while (budget > 0) {
+        if (lfs_pair_isnull(lfs->gc_tail)) {
+            // start the next round at the superblock
+            lfs->gc_tail[0] = 0;
+            lfs->gc_tail[1] = 1;
+            break;
+        }
 
-                        // did our commit create more orphans?
-                        if (state == LFS_OK_ORPHANED) {
-                            goto restart;
-                        }
+        lfs_mdir_t mdir;
+        int err = lfs_dir_fetch(lfs, &mdir, lfs->gc_tail);
+        if (err) {
+            return err;
+        }
+        budget -= 1;
+        lfs->gc_tail[0] = mdir.tail[0];
+        lfs->gc_tail[1] = mdir.tail[1];
 
-                        // refetch tail
-                        continue;
-                    }
+        if (!mdir.erased || mdir.off > thresh) {
+#if LFS_CHECKPOINT /* << EST */
+            if (lfs->ckpt_ondisk) {
+                err = lfs_fs_dropcheckpoint(lfs);
+                if (err) {
+                    return err;
+                }
+
+                err = lfs_dir_fetch(lfs, &mdir, mdir.pair);
+                if (err) {
+                    return err;
                 }
             }
+#endif
 
-            pdir = dir;
+            // an empty commit to an unerased mdir compacts it
+            mdir.erased = false;
+            err = lfs_dir_commit(lfs, &mdir, NULL, 0);
+            if (err) {
+                return err;
+            }
+            budget -= (budget > 0) ? 1 : 0;
+            steps += 1;
         }
     }
 
-    // mark orphans as fixed
-    return lfs_fs_preporphans(lfs, -lfs_min(
-            lfs_gstate_getorphans(&lfs->gstate),
-            found));
+    return steps;
 }
 #endif
 
 #ifndef LFS_READONLY
-static int lfs_fs_forceconsistency(lfs_t *lfs) {
-    int err = lfs_fs_demove(lfs);
+// bring the state of the allocator up to date like the next lfs_alloc
+// would, so it knows which blocks come next << EST
+static int lfs_alloc_prepare(lfs_t *lfs) {
+#if LFS_FREEMAP
+    if (!lfs->free.valid) {
+        return lfs_alloc_mapbuild(lfs);
+    }
+#else
+    if (lfs->free.i == lfs->free.size && lfs->free.ack > 0) {
+        return lfs_alloc_scan(lfs);
+    }
+#endif
+    return 0;
+}
+
+// true if the allocator knows the block to be free and has not handed it
+// out, blocks in use or allocated and not committed yet are not << EST
+static bool lfs_alloc_isfree(lfs_t *lfs, lfs_block_t block) {
+#if LFS_FREEMAP
+    return lfs->free.valid
+            && !(lfs->free.map[block / 32] & (1U << (block % 32)));
+#else
+    lfs_block_t off = ((block - lfs->free.off)
+            + lfs->cfg->block_count) % lfs->cfg->block_count;
+    return off >= lfs->free.i && off < lfs->free.size
+            && !(lfs->free.buffer[off / 32] & (1U << (off % 32)));
+#endif
+}
+
+static lfs_ssize_t lfs_fs_rawnextfree(lfs_t *lfs,
+        lfs_block_t *blocks, lfs_size_t count) { /* << EST */
+    int err = lfs_alloc_prepare(lfs);
     if (err) {
         return err;
     }
 
-    err = lfs_fs_deorphan(lfs, true);
+    lfs_size_t n = 0;
+#if LFS_FREEMAP
+#if LFS_ALLOC_RESERVE > 0
+    // a growing file gets the block after its last one first, see
+    // lfs_alloc_near
+    for (int i = 0; i < LFS_ALLOC_RESERVE && n < count; i++) {
+        lfs_block_t block = lfs->free.reserved[i];
+        if (block < lfs->cfg->block_count && lfs_alloc_isfree(lfs, block)) {
+            blocks[n++] = block;
+        }
+    }
+#endif
+    // then the free blocks from where the last allocation stopped
+    for (lfs_block_t i = 0; i < lfs->cfg->block_count && n < count; i++) {
+        lfs_block_t block = (lfs->free.off + i) % lfs->cfg->block_count;
+#if LFS_ALLOC_RESERVE > 0
+        if (lfs_alloc_findreserved(lfs, block) >= 0) {
+            continue;
+        }
+#endif
+        if (lfs_alloc_isfree(lfs, block)) {
+            blocks[n++] = block;
+        }
+    }
+#else
+    // the free blocks of the lookahead window not handed out yet
+    for (lfs_block_t off = lfs->free.i; off < lfs->free.size && n < count;
+            off++) {
+        if (!(lfs->free.buffer[off / 32] & (1U << (off % 32)))) {
+            blocks[n++] = (lfs->free.off + off) % lfs->cfg->block_count;
+        }
+    }
+#endif
+
+    return n;
+}
+
+// call cb with the block of each metadata pair which holds the older
+// revision, the next compaction of the pair erases it. After a fetch the
+// newer revision is in pair[0], so the older one can be erased any time
+// between operations, like a compaction cut short after its erase << EST
+static int lfs_fs_traversestale(lfs_t *lfs,
+        int (*cb)(void *data, lfs_block_t block), void *data) {
+    lfs_mdir_t dir = {.tail = {0, 1}};
+    lfs_block_t cycle = 0;
+    while (!lfs_pair_isnull(dir.tail)) {
+        if (cycle >= lfs->cfg->block_count/2) {
+            // loop detected
+            return LFS_ERR_CORRUPT;
+        }
+        cycle += 1;
+
+        int err = lfs_dir_fetch(lfs, &dir, dir.tail);
+        if (err) {
+            return err;
+        }
+
+        err = cb(data, dir.pair[1]);
+        if (err) {
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+struct lfs_fs_blocklist {
+    lfs_block_t *blocks;
+    lfs_size_t count;
+    lfs_size_t n;
+};
+
+static int lfs_fs_blocklist_add(void *data, lfs_block_t block) {
+    struct lfs_fs_blocklist *list = data;
+    if (list->n == list->count) {
+        return 1; // full, stop
+    }
+
+    list->blocks[list->n++] = block;
+    return 0;
+}
+
+static int lfs_fs_blockmatch(void *data, lfs_block_t block) {
+    return block == *(const lfs_block_t*)data;
+}
+
+static lfs_ssize_t lfs_fs_rawnextstale(lfs_t *lfs,
+        lfs_block_t *blocks, lfs_size_t count) { /* << EST */
+    struct lfs_fs_blocklist list = {blocks, count, 0};
+    int err = lfs_fs_traversestale(lfs, lfs_fs_blocklist_add, &list);
+    if (err < 0) {
+        return err;
+    }
+
+    return list.n;
+}
+
+static int lfs_fs_rawerase(lfs_t *lfs, lfs_block_t block) { /* << EST */
+    if (block >= lfs->cfg->block_count) {
+        return LFS_ERR_INVAL;
+    }
+
+    // only free blocks and the older blocks of metadata pairs, erasing any
+    // other block in use or a block in flight loses data
+    int err = lfs_alloc_prepare(lfs);
     if (err) {
         return err;
     }
+    if (!lfs_alloc_isfree(lfs, block)) {
+        err = lfs_fs_traversestale(lfs, lfs_fs_blockmatch, &block);
+        if (err < 0) {
+            return err;
+        }
+        if (!err) {
+            return LFS_ERR_INVAL;
+        }
+    }
 
-    return 0;
+    // the read cache may still hold what the block had before it was freed
+    if (lfs->rcache.block == block) {
+        lfs_cache_drop(lfs, &lfs->rcache);
+    }
+
+    return lfs_bd_erase(lfs, block);
 }
 #endif
 
+#if !LFS_USEDCOUNT || !defined(LFS_READONLY) /* << EST */
 static int lfs_fs_size_count(void *p, lfs_block_t block) {
     (void)block;
     lfs_size_t *size = p;
@@ -4630,7 +6274,7 @@ static int lfs_fs_size_count(void *p, lfs_block_t block) {
     return 0;
 }
 
-static lfs_ssize_t lfs_fs_rawsize(lfs_t *lfs) {
+static lfs_ssize_t lfs_fs_traversesize(lfs_t *lfs) {
     lfs_size_t size = 0;
     int err = lfs_fs_rawtraverse(lfs, lfs_fs_size_count, &size, false);
     if (err) {
@@ -4639,6 +6283,85 @@ static lfs_ssize_t lfs_fs_rawsize(lfs_t *lfs) {
 
     return size;
 }
+#endif
+
+#if LFS_USEDCOUNT /* << EST */
+// count the blocks of the metadata pairs and of the committed files, as
+// lfs_fs_rawtraverse visits them, but without reading the CTZ skip-lists
+static int lfs_fs_countused(lfs_t *lfs) {
+    lfs_size_t used = 0;
+    lfs_mdir_t dir = {.tail = {0, 1}};
+    lfs_block_t cycle = 0;
+    while (!lfs_pair_isnull(dir.tail)) {
+        if (cycle >= lfs->cfg->block_count/2) {
+            // loop detected
+            return LFS_ERR_CORRUPT;
+        }
+        cycle += 1;
+        used += 2;
+
+        int err = lfs_dir_fetch(lfs, &dir, dir.tail);
+        if (err) {
+            return err;
+        }
+
+        for (uint16_t id = 0; id < dir.count; id++) {
+            struct lfs_ctz ctz;
+            lfs_stag_t tag = lfs_dir_get(lfs, &dir, LFS_MKTAG(0x700, 0x3ff, 0),
+                    LFS_MKTAG(LFS_TYPE_STRUCT, id, sizeof(ctz)), &ctz);
+            if (tag < 0) {
+                if (tag == LFS_ERR_NOENT) {
+                    continue;
+                }
+                return tag;
+            }
+            lfs_ctz_fromle32(&ctz);
+
+            if (lfs_tag_type3(tag) == LFS_TYPE_CTZSTRUCT) {
+                used += lfs_ctz_count(lfs, ctz.size);
+            }
+        }
+    }
+
+    lfs->used = used;
+    lfs->used_valid = true;
+    return 0;
+}
+#endif
+
+static lfs_ssize_t lfs_fs_rawsize(lfs_t *lfs) {
+#if LFS_USEDCOUNT /* << EST */
+    // the tree is counted once, later commits keep the count up to date
+    if (!lfs->used_valid) {
+        int err = lfs_fs_countused(lfs);
+        if (err) {
+            return err;
+        }
+    }
+
+    lfs_size_t size = lfs->used;
+#ifndef LFS_READONLY
+    // and the blocks of open files which are not committed yet
+    for (lfs_file_t *f = (lfs_file_t*)lfs->mlist; f; f = f->next) {
+        if (f->type != LFS_TYPE_REG || (f->flags & LFS_F_INLINE)) {
+            continue;
+        }
+
+        if (f->flags & LFS_F_DIRTY) {
+            size += lfs_ctz_count(lfs, f->ctz.size);
+        }
+
+        if (f->flags & LFS_F_WRITING) {
+            size += lfs_ctz_count(lfs, f->pos);
+        }
+    }
+#endif
+
+    return size;
+#else
+    return lfs_fs_traversesize(lfs);
+#endif
+}
 
 #ifdef LFS_MIGRATE
 ////// Migration from littelfs v1 below this //////
@@ -5300,6 +7023,44 @@ cleanup:
 #define LFS_UNLOCK(cfg) ((void)cfg)
 #endif
 
+// Read-only operations take the shared lock if there is one, and run on a
+// reader of their own so they don't touch the caches of the filesystem. If
+// no reader is left, they run on the filesystem with the exclusive lock.
+// << EST
+static int lfs_rdlock(lfs_t *lfs, lfs_t **r) {
+    *r = lfs;
+#if defined(LFS_THREADSAFE) && LFS_READERS > 0
+    if (lfs->cfg->rdlock) {
+        int err = lfs->cfg->rdlock(lfs->cfg);
+        if (err) {
+            return err;
+        }
+
+        *r = lfs_reader_begin(lfs);
+        if (*r) {
+            return 0;
+        }
+
+        lfs->cfg->rdunlock(lfs->cfg);
+        *r = lfs;
+    }
+#endif
+    return LFS_LOCK(lfs->cfg);
+}
+
+static void lfs_rdunlock(lfs_t *lfs, lfs_t *r) {
+#if defined(LFS_THREADSAFE) && LFS_READERS > 0
+    if (r != lfs) {
+        lfs_reader_end(lfs, r);
+        lfs->cfg->rdunlock(lfs->cfg);
+        return;
+    }
+#else
+    (void)r;
+#endif
+    LFS_UNLOCK(lfs->cfg);
+}
+
 // Public API
 #ifndef LFS_READONLY
 int lfs_format(lfs_t *lfs, const struct lfs_config *cfg) {
@@ -5408,32 +7169,34 @@ int lfs_rename(lfs_t *lfs, const char *oldpath, const char *newpath) {
 #endif
 
 int lfs_stat(lfs_t *lfs, const char *path, struct lfs_info *info) {
-    int err = LFS_LOCK(lfs->cfg);
+    lfs_t *r; /* << EST */
+    int err = lfs_rdlock(lfs, &r);
     if (err) {
         return err;
     }
     LFS_TRACE("lfs_stat(%p, \"%s\", %p)", (void*)lfs, path, (void*)info);
 
-    err = lfs_rawstat(lfs, path, info);
+    err = lfs_rawstat(r, path, info);
 
     LFS_TRACE("lfs_stat -> %d", err);
-    LFS_UNLOCK(lfs->cfg);
+    lfs_rdunlock(lfs, r);
     return err;
 }
 
 lfs_ssize_t lfs_getattr(lfs_t *lfs, const char *path,
         uint8_t type, void *buffer, lfs_size_t size) {
-    int err = LFS_LOCK(lfs->cfg);
+    lfs_t *r; /* << EST */
+    int err = lfs_rdlock(lfs, &r);
     if (err) {
         return err;
     }
     LFS_TRACE("lfs_getattr(%p, \"%s\", %"PRIu8", %p, %"PRIu32")",
             (void*)lfs, path, type, buffer, size);
 
-    lfs_ssize_t res = lfs_rawgetattr(lfs, path, type, buffer, size);
+    lfs_ssize_t res = lfs_rawgetattr(r, path, type, buffer, size);
 
     LFS_TRACE("lfs_getattr -> %"PRId32, res);
-    LFS_UNLOCK(lfs->cfg);
+    lfs_rdunlock(lfs, r);
     return res;
 }
 
@@ -5543,7 +7306,17 @@ int lfs_file_sync(lfs_t *lfs, lfs_file_t *file) {
 
 lfs_ssize_t lfs_file_read(lfs_t *lfs, lfs_file_t *file,
         void *buffer, lfs_size_t size) {
+#ifdef LFS_THREADSAFE /* << EST */
+    // a read-only file reads through its own cache only, it does not need
+    // a reader
+    bool shared = lfs->cfg->rdlock != NULL;
+#ifndef LFS_READONLY
+    shared = shared && (file->flags & LFS_O_RDWR) == LFS_O_RDONLY;
+#endif
+    int err = shared ? lfs->cfg->rdlock(lfs->cfg) : LFS_LOCK(lfs->cfg);
+#else
     int err = LFS_LOCK(lfs->cfg);
+#endif
     if (err) {
         return err;
     }
@@ -5554,7 +7327,15 @@ lfs_ssize_t lfs_file_read(lfs_t *lfs, lfs_file_t *file,
     lfs_ssize_t res = lfs_file_rawread(lfs, file, buffer, size);
 
     LFS_TRACE("lfs_file_read -> %"PRId32, res);
+#ifdef LFS_THREADSAFE /* << EST */
+    if (shared) {
+        lfs->cfg->rdunlock(lfs->cfg);
+    } else {
+        LFS_UNLOCK(lfs->cfg);
+    }
+#else
     LFS_UNLOCK(lfs->cfg);
+#endif
     return res;
 }
 
@@ -5702,17 +7483,18 @@ int lfs_dir_close(lfs_t *lfs, lfs_dir_t *dir) {
 }
 
 int lfs_dir_read(lfs_t *lfs, lfs_dir_t *dir, struct lfs_info *info) {
-    int err = LFS_LOCK(lfs->cfg);
+    lfs_t *r; /* << EST */
+    int err = lfs_rdlock(lfs, &r);
     if (err) {
         return err;
     }
     LFS_TRACE("lfs_dir_read(%p, %p, %p)",
             (void*)lfs, (void*)dir, (void*)info);
 
-    err = lfs_dir_rawread(lfs, dir, info);
+    err = lfs_dir_rawread(r, dir, info);
 
     LFS_TRACE("lfs_dir_read -> %d", err);
-    LFS_UNLOCK(lfs->cfg);
+    lfs_rdunlock(lfs, r);
     return err;
 }
 
@@ -5788,6 +7570,70 @@ int lfs_fs_traverse(lfs_t *lfs, int (*cb)(void *, lfs_block_t), void *data) {
     return err;
 }
 
+#ifndef LFS_READONLY
+lfs_ssize_t lfs_fs_gc(lfs_t *lfs, lfs_size_t budget) { /* << EST */
+    int err = LFS_LOCK(lfs->cfg);
+    if (err) {
+        return err;
+    }
+    LFS_TRACE("lfs_fs_gc(%p, %"PRIu32")", (void*)lfs, budget);
+
+    lfs_ssize_t res = lfs_fs_rawgc(lfs, budget);
+
+    LFS_TRACE("lfs_fs_gc -> %"PRId32, res);
+    LFS_UNLOCK(lfs->cfg);
+    return res;
+}
+#endif
+
+#ifndef LFS_READONLY
+lfs_ssize_t lfs_fs_nextfree(lfs_t *lfs,
+        lfs_block_t *blocks, lfs_size_t count) { /* << EST */
+    int err = LFS_LOCK(lfs->cfg);
+    if (err) {
+        return err;
+    }
+    LFS_TRACE("lfs_fs_nextfree(%p, %p, %"PRIu32")",
+            (void*)lfs, (void*)blocks, count);
+
+    lfs_ssize_t res = lfs_fs_rawnextfree(lfs, blocks, count);
+
+    LFS_TRACE("lfs_fs_nextfree -> %"PRId32, res);
+    LFS_UNLOCK(lfs->cfg);
+    return res;
+}
+
+lfs_ssize_t lfs_fs_nextstale(lfs_t *lfs,
+        lfs_block_t *blocks, lfs_size_t count) { /* << EST */
+    int err = LFS_LOCK(lfs->cfg);
+    if (err) {
+        return err;
+    }
+    LFS_TRACE("lfs_fs_nextstale(%p, %p, %"PRIu32")",
+            (void*)lfs, (void*)blocks, count);
+
+    lfs_ssize_t res = lfs_fs_rawnextstale(lfs, blocks, count);
+
+    LFS_TRACE("lfs_fs_nextstale -> %"PRId32, res);
+    LFS_UNLOCK(lfs->cfg);
+    return res;
+}
+
+int lfs_fs_erase(lfs_t *lfs, lfs_block_t block) { /* << EST */
+    int err = LFS_LOCK(lfs->cfg);
+    if (err) {
+        return err;
+    }
+    LFS_TRACE("lfs_fs_erase(%p, 0x%"PRIx32")", (void*)lfs, block);
+
+    err = lfs_fs_rawerase(lfs, block);
+
+    LFS_TRACE("lfs_fs_erase -> %d", err);
+    LFS_UNLOCK(lfs->cfg);
+    return err;
+}
+#endif
+
 #ifdef LFS_MIGRATE
 int lfs_migrate(lfs_t *lfs, const struct lfs_config *cfg) {
     int err = LFS_LOCK(cfg);
@@ -68,6 +68,10 @@ typedef uint32_t lfs_block_t;
 #define LFS_ATTR_MAX 1022
 #endif
 
+// Size in bytes of the free block map of LFS_FREEMAP, the used blocks and
+// the blocks allocated since the last ack, one bit each << EST
+#define LFS_FREEMAP_SIZE(block_count) (2*4*(((block_count)+31)/32))
+
 // Possible error codes, these are negative to allow
 // valid positive return values
 enum lfs_error {
@@ -111,6 +115,7 @@ enum lfs_type {
     LFS_TYPE_DIRSTRUCT      = 0x200,
     LFS_TYPE_CTZSTRUCT      = 0x202,
     LFS_TYPE_INLINESTRUCT   = 0x201,
+    LFS_TYPE_CHECKPOINT     = 0x2ff, // << EST
     LFS_TYPE_SOFTTAIL       = 0x600,
     LFS_TYPE_HARDTAIL       = 0x601,
     LFS_TYPE_MOVESTATE      = 0x7ff,
@@ -178,9 +183,19 @@ struct lfs_config {
     int (*erase)(const struct lfs_config *c, lfs_block_t block);
 
     // Sync the state of the underlying block device. Negative error codes
-    // are propagated to the user.
+    // are propagated to the user. Also called before programmed data gets
+    // read back to check it. << EST
+    // May return LFS_ERR_CORRUPT if a buffered program failed, the block
+    // it was for is then considered bad.
     int (*sync)(const struct lfs_config *c);
 
+    // Optional, may be NULL: map a region of a block for reading it in
+    // place, without a copy through the caches. Returns 0 and sets *buffer
+    // if the region is directly readable, a negative error code if it has
+    // to be read with the read function.
+    int (*map)(const struct lfs_config *c, lfs_block_t block,
+            lfs_off_t off, lfs_size_t size, const void **buffer); /* << EST */
+
 #ifdef LFS_THREADSAFE
     // Lock the underlying block device. Negative error codes
     // are propagated to the user.
@@ -189,6 +204,17 @@ struct lfs_config {
     // Unlock the underlying block device. Negative error codes
     // are propagated to the user.
     int (*unlock)(const struct lfs_config *c);
+
+    // Optional, may be NULL: lock the underlying block device for reading,
+    // shared by any number of readers but never together with lock. Used
+    // for lfs_file_read on read-only files, lfs_stat, lfs_getattr and
+    // lfs_dir_read, all other operations use lock. If NULL, lock is used
+    // for everything. Negative error codes are propagated to the user.
+    int (*rdlock)(const struct lfs_config *c); /* << EST */
+
+    // Release a lock taken with rdlock. Negative error codes are
+    // propagated to the user.
+    int (*rdunlock)(const struct lfs_config *c); /* << EST */
 #endif
 
     // Minimum size of a block read in bytes. All read operations will be a
@@ -226,7 +252,8 @@ struct lfs_config {
     // Size of the lookahead buffer in bytes. A larger lookahead buffer
     // increases the number of blocks found during an allocation pass. The
     // lookahead buffer is stored as a compact bitmap, so each byte of RAM
-    // can track 8 blocks. Must be a multiple of 8.
+    // can track 8 blocks. Must be a multiple of 8. Not used with LFS_FREEMAP,
+    // the free block map takes its place << EST
     lfs_size_t lookahead_size;
 
     // Optional statically allocated read buffer. Must be cache_size.
@@ -239,7 +266,7 @@ struct lfs_config {
 
     // Optional statically allocated lookahead buffer. Must be lookahead_size
     // and aligned to a 32-bit boundary. By default lfs_malloc is used to
-    // allocate this buffer.
+    // allocate this buffer. Not used with LFS_FREEMAP << EST
     void *lookahead_buffer;
 
     // Optional upper limit on length of file names in bytes. No downside for
@@ -263,6 +290,32 @@ struct lfs_config {
     // can help bound the metadata compaction time. Must be <= block_size.
     // Defaults to block_size when zero.
     lfs_size_t metadata_max;
+
+    // Threshold for metadata compaction during lfs_fs_gc in bytes. Metadata
+    // pairs that exceed this threshold will be compacted during lfs_fs_gc.
+    // Defaults to ~88% of metadata_max when zero, or less if that leaves no
+    // room for another prog_size commit. -1 disables metadata compaction
+    // during lfs_fs_gc. When set, a commit to a metadata pair above the
+    // threshold compacts it instead of appending to its log. At least half
+    // of metadata_max plus prog_size is used for both, as a compacted pair
+    // may fill up to that and would be compacted over and over.
+    lfs_size_t compact_thresh; /* << EST */
+
+    // Optional statically allocated buffer for the read cache entries
+    // besides read_buffer. Must be (LFS_RCACHE_WAYS-1)*cache_size.
+    // By default lfs_malloc is used to allocate this buffer.
+    void *rcache_ways_buffer; /* << EST */
+
+    // Optional statically allocated buffer for the free block map of
+    // LFS_FREEMAP. Must be LFS_FREEMAP_SIZE(block_count) and aligned to a
+    // 32-bit boundary. By default lfs_malloc is used to allocate this buffer.
+    void *freemap_buffer; /* << EST */
+
+    // Optional statically allocated buffer for the state and the read caches
+    // of the concurrent readers of rdlock. Must be
+    // LFS_READERS_SIZE(cache_size) and aligned to a 64-bit boundary. By
+    // default lfs_malloc is used to allocate this buffer.
+    void *readers_buffer; /* << EST */
 };
 
 // File info structure
@@ -315,6 +368,14 @@ struct lfs_file_config {
 
     // Number of custom attributes in the list
     lfs_size_t attr_count;
+
+    // Optional block index of the file, index_size block addresses. Blocks
+    // found while walking the CTZ skip-list are kept, so reads and seeks
+    // start at the nearest known block instead of the head of the list.
+    lfs_block_t *index_buffer; /* << EST */
+
+    // Number of entries of index_buffer, 0 if there is no block index
+    lfs_size_t index_size; /* << EST */
 };
 
 
@@ -366,6 +427,14 @@ typedef struct lfs_file {
     lfs_off_t off;
     lfs_cache_t cache;
 
+    // CTZ skip-list described by the block index, entry i of the index
+    // holds the block with index i << shift << EST
+    struct lfs_ctz_index {
+        lfs_block_t head;
+        lfs_size_t size;
+        uint8_t shift;
+    } index;
+
     const struct lfs_file_config *cfg;
 } lfs_file_t;
 
@@ -387,8 +456,48 @@ typedef struct lfs_gstate {
 typedef struct lfs {
     lfs_cache_t rcache;
     lfs_cache_t pcache;
+#if LFS_RCACHE_WAYS > 1 /* << EST */
+    // more read cache entries besides rcache, with use stamps for the
+    // replacement, rcache_used[0] belongs to rcache
+    lfs_cache_t rcache_ways[LFS_RCACHE_WAYS-1];
+    uint32_t rcache_used[LFS_RCACHE_WAYS];
+    uint32_t rcache_tick;
+#endif
+#if LFS_DCACHE_SIZE > 0 /* << EST */
+    // path lookup cache, maps a name in a directory to its entry
+    struct lfs_dentry {
+        lfs_block_t parent[2];  // first pair of the directory, null if unused
+        lfs_block_t pair[2];    // metadata pair holding the entry
+        lfs_block_t child[2];   // pair of a directory entry, null if unknown
+        uint32_t tag;           // name tag of the entry
+        char name[LFS_DCACHE_NAME_MAX];
+    } dcache[LFS_DCACHE_SIZE];
+#endif
+#if LFS_FCACHE_SIZE > 0 /* << EST */
+    // metadata pairs checked by a fetch, their commits up to off are known
+    // to be valid as long as none of the blocks gets erased
+    struct lfs_fentry {
+        lfs_block_t pair[2];    // pair[0] holds the log, null if unused
+        uint32_t rev;           // revision count of pair[0]
+        lfs_off_t off;          // end of the last valid commit
+        uint32_t etag;          // state of the fetch at off
+        uint16_t count;
+        bool split;
+        lfs_block_t tail[2];
+    } fcache[LFS_FCACHE_SIZE];
+    uint8_t fcache_next;    // entry replaced next
+#endif
 
     lfs_block_t root[2];
+    lfs_block_t gc_tail[2]; // next metadata pair for lfs_fs_gc << EST
+#if LFS_CHECKPOINT /* << EST */
+    bool ckpt_ondisk;       // the superblock pair holds a valid mount checkpoint
+    bool ckpt_clean;        // no commit failed, the state can be checkpointed
+#endif
+#if LFS_USEDCOUNT /* << EST */
+    lfs_size_t used;        // blocks of the metadata pairs and committed files
+    bool used_valid;        // used has been counted since the mount
+#endif
     struct lfs_mlist {
         struct lfs_mlist *next;
         uint16_t id;
@@ -406,7 +515,21 @@ typedef struct lfs {
         lfs_block_t size;
         lfs_block_t i;
         lfs_block_t ack;
+#if !LFS_FREEMAP /* << EST */
         uint32_t *buffer;
+#else
+        uint32_t *map;          // bit set: block is in use, one bit per block
+        uint32_t *inflight;     // bit set: block allocated since the last ack
+        lfs_block_t nflight;    // number of blocks allocated since the last ack
+        bool valid;             // map has been built by a traversal
+        bool built;             // map has been built since the last ack
+#if LFS_ALLOC_RESERVE > 0
+        // blocks following the last block of a file, only allocated for
+        // that file as long as there are other free blocks
+        lfs_block_t reserved[LFS_ALLOC_RESERVE];
+        uint8_t nextreserved;   // entry replaced next
+#endif
+#endif
     } free;
 
     const struct lfs_config *cfg;
@@ -414,11 +537,40 @@ typedef struct lfs {
     lfs_size_t file_max;
     lfs_size_t attr_max;
 
+#if defined(LFS_THREADSAFE) && LFS_READERS > 0 /* << EST */
+    struct lfs_reader *readers; // state of the concurrent readers, or NULL
+    uint32_t wgen;              // bumped each time the storage is modified
+#endif
+
 #ifdef LFS_MIGRATE
     struct lfs1 *lfs1;
 #endif
+
+    // cache statistics, last as readers add to them while others copy the
+    // state before them << EST
+    uint32_t rcache_hits;   // reads served by the read cache
+    uint32_t rcache_misses; // reads which loaded a read cache entry
+    uint32_t dcache_hits;   // names found in the path lookup cache
+    uint32_t dcache_misses; // names searched in the metadata
+    uint32_t fcache_hits;   // fetches which skipped validated commits
+    uint32_t fcache_misses; // fetches which checked all commits
 } lfs_t;
 
+#if defined(LFS_THREADSAFE) && LFS_READERS > 0 /* << EST */
+// A reader works on a copy of the filesystem state with read caches of its
+// own, so readers holding the shared lock don't modify anything they share.
+struct lfs_reader {
+    lfs_t lfs;          // copy of the filesystem state
+    uint32_t gen;       // wgen of the filesystem the read caches belong to
+    bool busy;          // claimed by a reader
+};
+
+// Size in bytes of the readers_buffer, the readers followed by their read
+// caches
+#define LFS_READERS_SIZE(cache_size) \
+    (LFS_READERS*(sizeof(struct lfs_reader) + LFS_RCACHE_WAYS*(cache_size)))
+#endif
+
 
 /// Filesystem functions ///
 
@@ -445,7 +597,9 @@ int lfs_mount(lfs_t *lfs, const struct lfs_config *config);
 
 // Unmounts a littlefs
 //
-// Does nothing besides releasing any allocated resources.
+// Does nothing besides releasing any allocated resources. With LFS_CHECKPOINT
+// the mount state is committed to the superblock pair first, unless the
+// checkpoint found by lfs_mount is still valid or a commit failed. << EST
 // Returns a negative error code on failure.
 int lfs_unmount(lfs_t *lfs);
 
@@ -664,6 +818,10 @@ int lfs_dir_rewind(lfs_t *lfs, lfs_dir_t *dir);
 // Note: Result is best effort. If files share COW structures, the returned
 // size may be larger than the filesystem actually is.
 //
+// With LFS_USEDCOUNT the filesystem is traversed by the first call after
+// mounting only, later calls return the count kept up to date by each
+// change without accessing the block device. << EST
+//
 // Returns the number of allocated blocks, or a negative error code on failure.
 lfs_ssize_t lfs_fs_size(lfs_t *lfs);
 
@@ -676,6 +834,55 @@ lfs_ssize_t lfs_fs_size(lfs_t *lfs);
 // Returns a negative error code on failure.
 int lfs_fs_traverse(lfs_t *lfs, int (*cb)(void*, lfs_block_t), void *data);
 
+#ifndef LFS_READONLY
+// Do maintenance work in advance, meant to be called when idle << EST
+//
+// Resolves pending orphans and moves, fills the lookahead buffer (or builds
+// the free block map with LFS_FREEMAP) and compacts metadata pairs above
+// compact_thresh (see lfs_config), so this work does not happen inside later
+// writes. The work is bounded by budget: looking at a metadata pair and each
+// maintenance step take one unit. The next call continues with the next
+// metadata pair.
+//
+// Returns the number of maintenance steps done, 0 if there was nothing to
+// do, or a negative error code on failure.
+lfs_ssize_t lfs_fs_gc(lfs_t *lfs, lfs_size_t budget);
+#endif
+
+#ifndef LFS_READONLY
+// Find the free blocks the allocator hands out next << EST
+//
+// Fills blocks with up to count blocks, in the order the allocator takes
+// them. Without LFS_FREEMAP only the blocks of the current lookahead window
+// are known. The blocks are not allocated, the next filesystem operation
+// may change the order.
+//
+// Returns the number of blocks found, or a negative error code on failure.
+lfs_ssize_t lfs_fs_nextfree(lfs_t *lfs, lfs_block_t *blocks, lfs_size_t count);
+
+// Find the blocks the next compactions of metadata pairs erase << EST
+//
+// Each metadata pair has its newer revision in one block and the older one
+// in the other, a compaction erases the older one and writes the pair into
+// it. Fills blocks with up to count of these older blocks, starting with the
+// superblock pair. Once erased, the pair has no copy of its previous revision
+// until its next compaction.
+//
+// Returns the number of blocks found, or a negative error code on failure.
+lfs_ssize_t lfs_fs_nextstale(lfs_t *lfs, lfs_block_t *blocks, lfs_size_t count);
+
+// Erase a block ahead of its use, meant to be called when idle << EST
+//
+// Only blocks the allocator knows to be free (lfs_fs_nextfree) and the older
+// blocks of metadata pairs (lfs_fs_nextstale) are erased. The caches of
+// littlefs forget the old content of the block, like for an erase littlefs
+// does itself.
+//
+// Returns LFS_ERR_INVAL for any other block, in use or allocated and not
+// committed yet, or a negative error code on failure.
+int lfs_fs_erase(lfs_t *lfs, lfs_block_t block);
+#endif
+
 #ifndef LFS_READONLY
 #ifdef LFS_MIGRATE
 // Attempts to migrate a previous version of littlefs
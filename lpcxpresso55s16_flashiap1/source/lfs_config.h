@@ -13,5 +13,75 @@
     /*!< 1: if LittleFS module is enabled; 0: no littleFS support */
 #endif
 
+#ifndef LITTLEFS_CONFIG_USE_POOL
+  #include "McuLittleFSconfig.h"
+  #define LITTLEFS_CONFIG_USE_POOL   McuLittleFS_CONFIG_POOL
+    /*!< 1: lfs_malloc() and lfs_free() use the fixed-size pool of McuLittleFS instead of the heap */
+#endif
+
+#ifndef LFS_RCACHE_WAYS
+  #define LFS_RCACHE_WAYS            (4)
+    /*!< number of read cache entries of the file system, the least recently used one gets replaced. 1: single read cache */
+#endif
+
+#ifndef LFS_FREEMAP
+  #define LFS_FREEMAP                (1)
+    /*!< 1: the block allocator keeps a bitmap of the used blocks of the whole device, the file system gets traversed only to build it; 0: lookahead window, the file system gets traversed for each window */
+#endif
+
+#ifndef LFS_FCACHE_SIZE
+  #define LFS_FCACHE_SIZE            (8)
+    /*!< number of metadata pairs of which lfs_dir_fetch() remembers the validated commits, so a fetch only checks new commits. 0 to disable it */
+#endif
+
+#ifndef LFS_ALLOC_RESERVE
+  #define LFS_ALLOC_RESERVE          (4)
+    /*!< with LFS_FREEMAP: number of files for which the block after their last block is kept free, so they grow into adjacent blocks. 0 to disable it */
+#endif
+
+#ifndef LFS_USEDCOUNT
+  #define LFS_USEDCOUNT              (1)
+    /*!< 1: the used blocks are counted once after mounting and then updated with each change, lfs_fs_size() does not traverse the file system; 0: lfs_fs_size() traverses the file system on each call */
+#endif
+
+#if !defined(LFS_CHECKPOINT) && defined(McuLittleFS_CONFIG_CHECKPOINT)
+  #define LFS_CHECKPOINT             McuLittleFS_CONFIG_CHECKPOINT /* the volume of McuLittleFS */
+#endif
+
+#ifndef LFS_CHECKPOINT
+  #define LFS_CHECKPOINT             (0)
+    /*!< 1: lfs_unmount() leaves the root pair, the global state and the allocator seed in the superblock pair, so the next lfs_mount() only fetches the pair with the superblock. The checkpoint gets deleted before the first change after mounting. The volume must not be written by a littlefs without this option while a checkpoint is on it, so it is off unless McuLittleFS_CONFIG_CHECKPOINT turns it on for the volume of the firmware */
+#endif
+
+#ifndef LFS_DCACHE_SIZE
+  #define LFS_DCACHE_SIZE            (8)
+    /*!< number of entries of the path lookup cache of lfs_dir_find(), 0 to disable it */
+#endif
+
+#ifndef LFS_DCACHE_NAME_MAX
+  #define LFS_DCACHE_NAME_MAX        (24)
+    /*!< names longer than this are not kept in the path lookup cache */
+#endif
+
+#ifndef LFS_READERS
+  #define LFS_READERS                (2)
+    /*!< with LFS_THREADSAFE and the rdlock() callback: number of lfs_stat(), lfs_getattr() and lfs_dir_read() calls which can run at the same time,
+         each with its own read cache, see LFS_READERS_SIZE() for readers_buffer. lfs_file_read() of LFS_O_RDONLY files takes the shared lock
+         as well, it reads through the cache of the file and needs no reader. Without memory for the readers the other calls take the exclusive lock */
+#endif
+
+#define LFS_CRC_BACKEND_NIBBLE       (0) /*!< software, 16 entry table, half a byte per step */
+#define LFS_CRC_BACKEND_SLICE8       (1) /*!< software, 8 KByte of tables, eight bytes per step */
+#define LFS_CRC_BACKEND_WORD         (2) /*!< software, 4 KByte of tables, one aligned word per step */
+
+#ifndef LFS_CRC_BACKEND
+  #define LFS_CRC_BACKEND            LFS_CRC_BACKEND_WORD
+    /*!< implementation of lfs_crc(), one of LFS_CRC_BACKEND_* */
+#endif
+
+#ifndef LFS_CRC_CHECK
+  #define LFS_CRC_CHECK              (0)
+    /*!< 1: provide lfs_crc_check() to compare lfs_crc() with the 16 entry table implementation */
+#endif
 
 #endif /* LFS_CONFIG_H_ */
@@ -219,11 +219,25 @@ static inline uint32_t lfs_tobe32(uint32_t a) {
 // Calculate CRC-32 with polynomial = 0x04c11db7
 uint32_t lfs_crc(uint32_t crc, const void *buffer, size_t size);
 
+#if LFS_CRC_CHECK /* << EST */
+// Check lfs_crc of LFS_CRC_BACKEND against the small table implementation,
+// returns true if they match
+bool lfs_crc_check(void);
+#endif
+
+#if LITTLEFS_CONFIG_USE_POOL /* << EST */
+// fixed-size pool of McuLittleFS, see McuLittleFS_CONFIG_POOL
+void *McuLFS_PoolAlloc(size_t size);
+void McuLFS_PoolFree(void *p);
+#endif
+
 // Allocate memory, only used if buffers are not provided to littlefs
 // Note, memory must be 64-bit aligned
 static inline void *lfs_malloc(size_t size) {
 #ifndef LFS_NO_MALLOC
-  #if LITTLEFS_CONFIG_USE_FREERTOS_HEAP /* << EST */
+  #if LITTLEFS_CONFIG_USE_POOL /* << EST */
+    return McuLFS_PoolAlloc(size);
+  #elif LITTLEFS_CONFIG_USE_FREERTOS_HEAP /* << EST */
     return pvPortMalloc(size);
   #else
     return malloc(size);
@@ -237,7 +251,9 @@ static inline void *lfs_malloc(size_t size) {
 // Deallocate memory, only used if buffers are not provided to littlefs
 static inline void lfs_free(void *p) {
 #ifndef LFS_NO_MALLOC
-  #if LITTLEFS_CONFIG_USE_FREERTOS_HEAP /* << EST */
+  #if LITTLEFS_CONFIG_USE_POOL /* << EST */
+    McuLFS_PoolFree(p);
+  #elif LITTLEFS_CONFIG_USE_FREERTOS_HEAP /* << EST */
     vPortFree(p);
   #else
     free(p);
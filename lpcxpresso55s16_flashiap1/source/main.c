@@ -5,6 +5,7 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
+#include <stdio.h>
 #include "fsl_debug_console.h"
 #include "pin_mux.h"
 #include "board.h"
@@ -13,10 +14,62 @@
 #include "fsl_common.h"
 #include "fsl_power.h"
 
+#include "McuLib.h"
 #include "McuLittleFS.h"
 #include "McuLittleFSBlockDevice.h"
+
+#define APP_LOG_PERIOD_MS  (10000U) // the application appends a line to its log this often
+#define APP_IDLE_MS        (50U)    // quiet time after a file system access before the idle hooks run
+
+static volatile uint32_t tickMs; // milliseconds since boot, counted by SysTick
+
+void SysTick_Handler(void)
+{
+    tickMs++;
+}
+
+// the application: appends a line to its log, the first call does the
+// deferred mount unless the idle hooks have done it already
+static void AppLog(uint32_t now)
+{
+    static lfs_file_t file;
+    static uint32_t nofLines;
+    char line[32];
+
+    if (McuLFS_openFile(&file, (uint8_t*)"log.txt") != ERR_OK) {
+        return;
+    }
+    snprintf(line, sizeof(line), "%u: %u ms", (unsigned)nofLines++, (unsigned)now);
+    if (McuLFS_writeLine(&file, (uint8_t*)line) == ERR_OK) { // closes the file on failure
+        McuLFS_closeFile(&file);
+    }
+}
+
+// one unit of idle work per call, false once there is nothing left to do
+static bool IdleWork(void)
+{
+    static uint32_t nofPreErases;
+
+    if (McuLFS_Gc(1) == ERR_BUSY) { // does the deferred mount first
+        return true;
+    }
+#if McuLittleFS_CONFIG_PREERASE_POOL_SIZE>0
+    // one block at most per call, as many calls as McuLFS_PreErase() looks
+    // at blocks: the next free ones and the next stale ones
+    if (nofPreErases < 2 * McuLittleFS_CONFIG_PREERASE_POOL_SIZE) {
+        nofPreErases++;
+        return McuLFS_PreErase(1) == ERR_OK;
+    }
+#endif
+    nofPreErases = 0;
+    return false;
+}
+
 int main()
 {
+    uint32_t now, lastAccess, lastLog, lastIdle;
+    bool idleDone;
+
     /* Init board hardware. */
     /* set BOD VBAT level to 1.65V */
     POWER_SetBodVbatLevel(kPOWER_BodVbatLevel1650mv, kPOWER_BodHystLevel50mv, false);
@@ -29,19 +82,41 @@ int main()
     BOARD_InitBootPins();
     BOARD_BootClockFROHF96M();
     BOARD_InitDebugConsole();
-    int res;
-    res = McuLittleFS_block_device_init();
+    SysTick_Config(SystemCoreClock / 1000U);
+#if LFS_CRC_CHECK
+    if (!lfs_crc_check()) {
+        PRINTF("lfs_crc() does not match the reference implementation!\r\n");
+    }
+#endif
 
-    int err = McuLFS_Mount();
+    // mount on first use instead of on the boot path, together with loading
+    // the partition table, and format if we can't mount the filesystem on a
+    // blank partition, this should only happen on the first boot
+    McuLFS_MountLazy(true);
+    McuLFS_PrintMountStats();
 
-    // reformat if we can't mount the filesystem
-    // this should only happen on the first boot
-    if (err) {
+    // the first log line is the first file system access: it mounts (first
+    // access path). An application which does not touch the file system
+    // right away gets it mounted by the idle hooks after APP_IDLE_MS.
+    lastLog = lastAccess = lastIdle = tickMs;
+    AppLog(lastLog);
+    McuLFS_PrintMountStats();
+    idleDone = false;
 
-    	McuLFS_Format();
-    	McuLFS_Mount();
+    for(;;) {
+        now = tickMs;
+        if (now - lastLog >= APP_LOG_PERIOD_MS) {
+            lastLog = lastAccess = now;
+            AppLog(now);
+            idleDone = false; // the write may have left something to do
+        } else if (!idleDone && now - lastAccess >= APP_IDLE_MS && now != lastIdle) {
+            // idle: one unit of garbage collection or pre-erase per tick, so
+            // an access which comes now waits for one unit at most
+            lastIdle = now;
+            idleDone = !IdleWork();
+        }
+        __WFI(); // sleep until the next tick
     }
-
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -68,8 +68,16 @@ void HardFault_Handler(void){
             "B  _process      \n"
             "_MSP:  \n"
             "MRS    R0, MSP \n"
-        // Load the instruction that triggered hard fault
         "_process:     \n"
+        // Let McuFlash recover from a guarded read of erased flash
+            "PUSH   {R0, LR} \n"
+            "BL     McuFlash_HardFaultHook \n"
+            "MOV    R2, R0 \n"
+            "POP    {R0, R1} \n"
+            "MOV    LR, R1 \n"
+            "CMP    R2, #0 \n"
+            "BNE    _flash_return \n"
+        // Load the instruction that triggered hard fault
             "LDR    R1,[R0,#24] \n"
             "LDRH    R2,[r1] \n"
         // Semihosting instruction is "BKPT 0xAB" (0xBEAB)
@@ -91,6 +99,9 @@ void HardFault_Handler(void){
     		    "STR R1,[ R0,#0 ] \n" // R0 is at location 0 on stack
     	// Return from hard fault handler to application
             "BX LR \n"
+        // McuFlash has redirected the stacked PC, return to it
+        "_flash_return: \n"
+            "BX LR \n"
         ".syntax divided\n") ;
 }
 